@@ -0,0 +1,470 @@
+// pokemem can run as a small headless agent (pokemem --agent <socket>), e.g. as root, so that
+// the UI doesn't need any special permissions to access other processes' memory.
+// the UI connects to the agent's Unix socket, and the agent opens /proc/<pid>/mem and sends back
+// the file descriptor, so reading and writing memory goes straight to the kernel with nothing
+// copied through the socket. the agent also reads /proc/<pid>/maps and stops/continues processes,
+// and opens the files needed to look at soft-dirty bits (see profile.c).
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <signal.h>
+
+typedef enum {
+	AGENT_OPEN, // open /proc/<arg[0]>/mem with the flags arg[1]. the file descriptor comes with the reply.
+	AGENT_MAPS, // read /proc/<arg[0]>/maps. its contents come after the reply.
+	AGENT_SIGNAL, // send the signal arg[1] (SIGSTOP or SIGCONT) to process arg[0]
+	AGENT_PAGEMAP, // open /proc/<arg[0]>/pagemap for reading. the file descriptor comes with the reply.
+	AGENT_CLEAR_REFS // open /proc/<arg[0]>/clear_refs for writing. the file descriptor comes with the reply.
+} AgentRequest;
+
+// requests and replies are one of these, followed by size bytes.
+// for replies, arg[0] is 0 on success, or an errno value.
+typedef struct {
+	uint32_t request; // an AgentRequest
+	uint32_t size;
+	int64_t arg[2];
+} AgentMessage;
+
+#define AGENT_MAX_CLIENTS 16
+#define AGENT_MAX_STOPPED 64
+#define AGENT_MAPS_MAX_SIZE ((size_t)64 << 20)
+// how long the agent waits for a client to finish sending a request (or take a reply) before dropping it,
+// so that one stuck client can't hold up the others
+#define AGENT_CLIENT_TIMEOUT_MS 2000
+
+// send a message, along with the file descriptor fd (if it's not -1)
+static bool agent_send(int sock, AgentMessage const *message, void const *data, int fd) {
+	struct iovec iov[2] = {{(void *)message, sizeof *message}, {(void *)data, message->size}};
+	union {
+		struct cmsghdr header;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	memset(&control, 0, sizeof control);
+	struct msghdr msg = {0};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = message->size ? 2 : 1;
+	if (fd >= 0) {
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof fd);
+	}
+	size_t total = sizeof *message + message->size;
+	ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	if (n < 0) return false;
+	// (the file descriptor has been sent with the first byte, so the rest can just be written)
+	for (size_t done = (size_t)n; done < total; ) {
+		char const *p = done < sizeof *message ? (char const *)message + done : (char const *)data + (done - sizeof *message);
+		size_t len = done < sizeof *message ? sizeof *message - done : total - done;
+		ssize_t m = send(sock, p, len, MSG_NOSIGNAL);
+		if (m <= 0) return false;
+		done += (size_t)m;
+	}
+	return true;
+}
+
+// receive a message header (and a file descriptor if one was sent with it, otherwise *fd is set to -1)
+static bool agent_receive(int sock, AgentMessage *message, int *fd) {
+	struct iovec iov = {message, sizeof *message};
+	union {
+		struct cmsghdr header;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	memset(&control, 0, sizeof control);
+	struct msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof control.buf;
+	*fd = -1;
+	ssize_t n = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(fd, CMSG_DATA(cmsg), sizeof *fd);
+	if (n != (ssize_t)sizeof *message) {
+		if (*fd >= 0) close(*fd);
+		*fd = -1;
+		return false;
+	}
+	return true;
+}
+
+// --- the UI's side ---
+
+// send a request to the agent and wait for the reply. returns false (and sets errno) on failure.
+// if fd isn't NULL, it's set to the file descriptor sent with the reply.
+// if data isn't NULL, it's set to what came after the reply (allocated with malloc), and *data_size to its size.
+// (this can be called from any thread)
+static bool agent_request(State const *state, AgentRequest request, int64_t arg0, int64_t arg1, int *out_fd, char **data, size_t *data_size) {
+	AgentMessage message = {request, 0, {arg0, arg1}};
+	AgentMessage reply = {0};
+	int fd = -1;
+	int error = 0;
+	if (data) *data = NULL;
+	if (out_fd) *out_fd = -1;
+	// (requests from different threads take turns. this is all that changes in state.)
+	GMutex *mutex = (GMutex *)&state->agent_mutex;
+	g_mutex_lock(mutex);
+	if (!agent_send(state->agent, &message, NULL, -1) || !agent_receive(state->agent, &reply, &fd)) {
+		error = EPIPE;
+	} else {
+		char *contents = reply.size ? malloc(reply.size) : NULL;
+		if (contents && recv(state->agent, contents, reply.size, MSG_WAITALL) != (ssize_t)reply.size)
+			error = EPIPE;
+		if (reply.size && !contents) {
+			// still read what came after the reply, so that the next reply lines up
+			char discard[4096];
+			for (size_t left = reply.size; left && !error; ) {
+				ssize_t n = recv(state->agent, discard, left < sizeof discard ? left : sizeof discard, MSG_WAITALL);
+				if (n <= 0) error = EPIPE;
+				else left -= (size_t)n;
+			}
+			if (!error) error = ENOMEM;
+		}
+		if (data) {
+			*data = contents;
+			*data_size = reply.size;
+		} else {
+			free(contents);
+		}
+		if (!error) error = (int)reply.arg[0];
+	}
+	g_mutex_unlock(mutex);
+	if (error || !out_fd) {
+		if (fd >= 0) close(fd);
+	} else {
+		*out_fd = fd;
+	}
+	if (error) {
+		if (data) {
+			free(*data);
+			*data = NULL;
+		}
+		errno = error;
+		return false;
+	}
+	return true;
+}
+
+// open /proc/<pid>/mem, through the agent if we're connected to one. returns -1 on failure (and sets errno).
+static int agent_open_memory(State *state, PID pid, int flags) {
+	if (state->agent) {
+		int fd = -1;
+		if (agent_request(state, AGENT_OPEN, pid, flags, &fd, NULL, NULL) && fd == -1)
+			errno = EPROTO;
+		return fd;
+	}
+	char name[64];
+	sprintf(name, "/proc/%lld/mem", (long long)pid);
+	return open(name, flags);
+}
+
+// open a /proc/<pid> file which the agent sends back with request, or name directly if we're not connected to one
+static int agent_open_proc_file(State *state, PID pid, AgentRequest request, char const *file, int flags) {
+	if (state->agent) {
+		int fd = -1;
+		if (agent_request(state, request, pid, 0, &fd, NULL, NULL) && fd == -1)
+			errno = EPROTO;
+		return fd;
+	}
+	char name[64];
+	sprintf(name, "/proc/%lld/%s", (long long)pid, file);
+	return open(name, flags | O_CLOEXEC);
+}
+
+// open /proc/<pid>/pagemap for reading. returns -1 on failure (and sets errno).
+static int agent_open_pagemap(State *state, PID pid) {
+	return agent_open_proc_file(state, pid, AGENT_PAGEMAP, "pagemap", O_RDONLY);
+}
+
+// open /proc/<pid>/clear_refs for writing. returns -1 on failure (and sets errno).
+static int agent_open_clear_refs(State *state, PID pid) {
+	return agent_open_proc_file(state, pid, AGENT_CLEAR_REFS, "clear_refs", O_WRONLY);
+}
+
+// open /proc/<pid>/maps, through the agent if we're connected to one. returns NULL on failure (and sets errno).
+static FILE *agent_open_maps(State *state, PID pid) {
+	if (state->agent) {
+		char *contents = NULL;
+		size_t size = 0;
+		if (!agent_request(state, AGENT_MAPS, pid, 0, NULL, &contents, &size))
+			return NULL;
+		// (the contents are copied so they can be freed here)
+		FILE *fp = tmpfile();
+		if (fp) {
+			fwrite(contents, 1, size, fp);
+			rewind(fp);
+		}
+		free(contents);
+		return fp;
+	}
+	char name[64];
+	sprintf(name, "/proc/%lld/maps", (long long)pid);
+	return fopen(name, "rb");
+}
+
+// send signal sig to process pid, through the agent if we're connected to one
+// (this can be called from any thread)
+static int agent_kill(State const *state, PID pid, int sig) {
+	// memory files and core dumps (see source.c) have nothing to stop,
+	// and kill() with pid <= 0 would signal whole process groups
+	if (pid <= 0) return 0;
+	if (state->agent)
+		return agent_request(state, AGENT_SIGNAL, pid, sig, NULL, NULL, NULL) ? 0 : -1;
+	return kill(pid, sig);
+}
+
+// connect to the agent listening on path. returns false (after showing an error) on failure.
+static bool agent_connect(State *state, char const *path) {
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof addr.sun_path) {
+		display_error(state, "Socket path too long: %s", path);
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock == -1 || connect(sock, (struct sockaddr const *)&addr, sizeof addr) == -1) {
+		display_error(state, "Couldn't connect to the agent at %s: %s.", path, strerror(errno));
+		if (sock != -1) close(sock);
+		return false;
+	}
+	state->agent = sock;
+	return true;
+}
+
+static void agent_disconnect(State *state) {
+	if (state->agent) close(state->agent);
+	state->agent = 0;
+}
+
+// --- the agent's side ---
+
+typedef struct {
+	int sock;
+	uid_t uid; // user the client is running as (from SO_PEERCRED)
+	// the processes this client has stopped (and not continued), so they can be continued if it goes away
+	PID stopped[AGENT_MAX_STOPPED];
+	unsigned n_stopped;
+} AgentClient;
+
+static void agent_client_close(AgentClient *client) {
+	for (unsigned i = 0; i < client->n_stopped; ++i)
+		kill(client->stopped[i], SIGCONT);
+	close(client->sock);
+	memset(client, 0, sizeof *client);
+	client->sock = -1;
+}
+
+// can client write to (or clear the soft-dirty bits of) the process whose /proc directory is proc_dir?
+// only if the client is root, or the process runs as the client's user (with all of its user IDs),
+// so the agent doesn't let its owner write to processes they couldn't touch anyway, like root's daemons.
+static bool agent_may_write(AgentClient const *client, int proc_dir) {
+	if (client->uid == 0) return true;
+	int status_fd = openat(proc_dir, "status", O_RDONLY | O_CLOEXEC);
+	FILE *status = status_fd == -1 ? NULL : fdopen(status_fd, "r");
+	if (!status) {
+		if (status_fd != -1) close(status_fd);
+		return false;
+	}
+	bool allowed = false;
+	char line[256];
+	while (fgets(line, sizeof line, status)) {
+		unsigned long uids[4];
+		if (sscanf(line, "Uid: %lu %lu %lu %lu", &uids[0], &uids[1], &uids[2], &uids[3]) == 4) {
+			allowed = true;
+			for (int i = 0; i < 4; ++i)
+				allowed &= uids[i] == client->uid;
+			break;
+		}
+	}
+	fclose(status);
+	return allowed;
+}
+
+// handle a request from a client. returns false if the client should be disconnected.
+static bool agent_handle(AgentClient *client) {
+	AgentMessage request = {0}, reply = {0};
+	int unused_fd;
+	if (!agent_receive(client->sock, &request, &unused_fd)) return false;
+	if (unused_fd >= 0) close(unused_fd);
+	if (request.size) return false; // requests don't have anything after them
+	reply.request = request.request;
+	PID pid = (PID)request.arg[0];
+	if (pid <= 0 || pid != request.arg[0]) {
+		reply.arg[0] = ESRCH;
+		return agent_send(client->sock, &reply, NULL, -1);
+	}
+	char name[64];
+	switch (request.request) {
+	case AGENT_OPEN:
+	case AGENT_PAGEMAP:
+	case AGENT_CLEAR_REFS: {
+		int flags = (int)request.arg[1];
+		char const *file = "mem";
+		if (request.request == AGENT_PAGEMAP) {
+			flags = O_RDONLY;
+			file = "pagemap";
+		} else if (request.request == AGENT_CLEAR_REFS) {
+			flags = O_WRONLY;
+			file = "clear_refs";
+		} else if (flags != O_RDONLY && flags != O_WRONLY && flags != O_RDWR) {
+			reply.arg[0] = EINVAL;
+			break;
+		}
+		sprintf(name, "/proc/%lld", (long long)pid);
+		int proc_dir = open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		int fd = proc_dir == -1 ? -1 : openat(proc_dir, file, flags | O_CLOEXEC);
+		if (fd == -1) {
+			reply.arg[0] = errno;
+			if (proc_dir != -1) close(proc_dir);
+			break;
+		}
+		// (this is checked after opening, through the same directory, so the process can't be swapped out
+		// in between -- a file descriptor for mem stays with the memory it was opened for)
+		if (flags != O_RDONLY && !agent_may_write(client, proc_dir)) {
+			reply.arg[0] = EPERM;
+			close(fd);
+			close(proc_dir);
+			break;
+		}
+		close(proc_dir);
+		bool success = agent_send(client->sock, &reply, NULL, fd);
+		close(fd);
+		return success;
+	}
+	case AGENT_MAPS: {
+		sprintf(name, "/proc/%lld/maps", (long long)pid);
+		FILE *fp = fopen(name, "rb");
+		if (!fp) {
+			reply.arg[0] = errno;
+			break;
+		}
+		// (maps files can't be seeked to the end to find their size)
+		char *contents = NULL;
+		size_t size = 0, capacity = 0;
+		while (!feof(fp) && size < AGENT_MAPS_MAX_SIZE) {
+			if (size == capacity) {
+				capacity = capacity * 2 + 65536;
+				char *new_contents = realloc(contents, capacity);
+				if (!new_contents) break;
+				contents = new_contents;
+			}
+			size_t n = fread(contents + size, 1, capacity - size, fp);
+			if (!n) break;
+			size += n;
+		}
+		fclose(fp);
+		reply.size = (uint32_t)size;
+		bool success = agent_send(client->sock, &reply, contents, -1);
+		free(contents);
+		return success;
+	}
+	case AGENT_SIGNAL: {
+		int sig = (int)request.arg[1];
+		if (sig != SIGSTOP && sig != SIGCONT) {
+			reply.arg[0] = EINVAL;
+			break;
+		}
+		if (kill(pid, sig) == -1) {
+			reply.arg[0] = errno;
+			break;
+		}
+		// keep track of which processes are stopped
+		unsigned i;
+		for (i = 0; i < client->n_stopped && client->stopped[i] != pid; ++i);
+		if (sig == SIGSTOP && i == client->n_stopped && i < AGENT_MAX_STOPPED)
+			client->stopped[client->n_stopped++] = pid;
+		else if (sig == SIGCONT && i < client->n_stopped)
+			client->stopped[i] = client->stopped[--client->n_stopped];
+	} break;
+	default:
+		reply.arg[0] = EINVAL;
+		break;
+	}
+	return agent_send(client->sock, &reply, NULL, -1);
+}
+
+// run the agent, listening on the Unix socket at path. only root and the user who started the agent
+// (or who ran sudo) can connect to it. they can read and stop any process, but only write to
+// processes running as themselves (see agent_may_write). returns the exit status.
+static int agent_main(char const *path) {
+	uid_t owner = getuid();
+	gid_t owner_group = getgid();
+	char const *sudo_uid = getenv("SUDO_UID"), *sudo_gid = getenv("SUDO_GID");
+	if (sudo_uid) owner = (uid_t)atol(sudo_uid);
+	if (sudo_gid) owner_group = (gid_t)atol(sudo_gid);
+
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return EXIT_FAILURE;
+	}
+	strcpy(addr.sun_path, path);
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener == -1) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	unlink(path);
+	// (the socket is created without any permissions, and then given to the owner)
+	mode_t prev_umask = umask(0777);
+	int bound = bind(listener, (struct sockaddr const *)&addr, sizeof addr);
+	umask(prev_umask);
+	if (bound == -1 || chown(path, owner, owner_group) == -1 || chmod(path, 0600) == -1 || listen(listener, 4) == -1) {
+		fprintf(stderr, "Couldn't listen on %s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	fprintf(stderr, "pokemem agent listening on %s\n", path);
+
+	AgentClient clients[AGENT_MAX_CLIENTS];
+	for (int i = 0; i < AGENT_MAX_CLIENTS; ++i) {
+		memset(&clients[i], 0, sizeof clients[i]);
+		clients[i].sock = -1;
+	}
+	while (true) {
+		struct pollfd fds[AGENT_MAX_CLIENTS + 1] = {0};
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		for (int i = 0; i < AGENT_MAX_CLIENTS; ++i) {
+			fds[i + 1].fd = clients[i].sock;
+			fds[i + 1].events = POLLIN;
+		}
+		if (poll(fds, AGENT_MAX_CLIENTS + 1, -1) == -1) {
+			if (errno == EINTR) continue;
+			perror("poll");
+			return EXIT_FAILURE;
+		}
+		for (int i = 0; i < AGENT_MAX_CLIENTS; ++i)
+			if (fds[i + 1].revents && !agent_handle(&clients[i]))
+				agent_client_close(&clients[i]);
+		if (fds[0].revents & POLLIN) {
+			int sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+			if (sock == -1) continue;
+			struct ucred cred = {0};
+			socklen_t cred_len = sizeof cred;
+			int slot = -1;
+			for (int i = 0; i < AGENT_MAX_CLIENTS; ++i)
+				if (clients[i].sock == -1)
+					slot = i;
+			if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1
+				|| (cred.uid != 0 && cred.uid != owner) || slot == -1) {
+				close(sock);
+				continue;
+			}
+			// (requests are read with MSG_WAITALL, so a client which sends half of one would hold up everyone else)
+			struct timeval timeout = {AGENT_CLIENT_TIMEOUT_MS / 1000, AGENT_CLIENT_TIMEOUT_MS % 1000 * 1000};
+			setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+			setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+			clients[slot].sock = sock;
+			clients[slot].uid = cred.uid;
+		}
+	}
+}
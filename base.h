@@ -1,5 +1,6 @@
 // types and stuff needed everywhere
 
+#define _GNU_SOURCE // for process_vm_readv/writev
 #include <gtk/gtk.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -12,6 +13,9 @@
 #include <ctype.h>
 #include <wctype.h>
 #include <math.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/uio.h>
 
 typedef pid_t PID;
 typedef uint64_t Address;
@@ -36,33 +40,215 @@ typedef enum {
 	TYPE_F32,
 	TYPE_F64
 } DataType;
+#define DATA_TYPE_COUNT 13
 
 typedef enum {
 	SEARCH_ENTER_VALUE,
 	SEARCH_SAME_DIFFERENT
 } SearchType;
 
+// how far off floating-point values can be from what's entered and still match
+typedef struct {
+	double amount;
+	bool relative; // if true, amount is a fraction of the value (e.g. 0.1 for 10%)
+} FloatTolerance;
+
+// group searches look for other values (fields) near each candidate, e.g. to find
+// a struct containing a u32 100, a f32 3.5 and a u16 7.
+#define GROUP_MAX_FIELDS 8
+#define GROUP_MAX_WINDOW 1024
+typedef struct {
+	DataType type;
+	uint64_t lo, hi; // range of values which match (see data_range_from_str)
+} GroupField;
+
+typedef struct {
+	unsigned n_fields; // 0 if this isn't a group search
+	GroupField fields[GROUP_MAX_FIELDS];
+	size_t window; // fields must start less than this many bytes before/after the candidate
+} Group;
+
+// candidate bitsets are split into blocks of BITSET_BLOCK_WORDS words (4096 positions).
+// blocks where every bit is clear or every bit is set don't need memory for their words,
+// so memory use goes down as candidates are eliminated, and empty blocks can be skipped quickly.
+#define BITSET_BLOCK_WORDS 64
+typedef enum {
+	BITSET_CLEAR,
+	BITSET_SET,
+	BITSET_MIXED
+} BitsetBlock;
+
+typedef struct {
+	Address n_words;
+	Address n_blocks;
+	uint8_t *summary; // a BitsetBlock for each block
+	uint64_t **leaves; // words for each BITSET_MIXED block (NULL for other blocks)
+} Bitset;
+
+// what's in a memory map. searches go through the maps in this order,
+// so that the ones most likely to have the value in them are searched first.
+typedef enum {
+	MAP_KIND_HEAP,
+	MAP_KIND_ANON, // no pathname
+	MAP_KIND_STACK,
+	MAP_KIND_SPECIAL, // e.g. [vvar]
+	MAP_KIND_FILE
+} MapKind;
+#define MAP_KIND_COUNT 5
+
+// a user-defined struct, which the memory view can show the fields of (see layout_parse)
+#define LAYOUT_MAX_FIELDS 64
+#define LAYOUT_MAX_SIZE 65536
+typedef struct {
+	char name[32];
+	DataType type;
+	Address offset; // from the start of the struct
+} LayoutField;
+
+typedef struct {
+	unsigned n_fields; // 0 if no layout is being used
+	LayoutField fields[LAYOUT_MAX_FIELDS]; // in order of offset
+	Address size; // where the last field ends
+	Address stride; // distance between the structs in an array of them
+} Layout;
+
+// how much of a process's memory is read at once (see read_tuning_calibrate)
+typedef struct {
+	size_t run_max; // most bytes to read at once
+	size_t gap_max; // stretches of memory this big (or smaller) with nothing of interest in them are read
+	                // over, rather than starting a new read after them
+} ReadTuning;
+
 // a memory map
 typedef struct {
 	Address lo, size;
+	uint32_t kind; // a MapKind
+	uint32_t padding;
 } Map;
 
+// rules for which memory maps to search, as well as the protection (see region_filter_parse)
+#define REGION_FILTER_MAX_RULES 16
+typedef enum {
+	REGION_RULE_ANON, // maps with no pathname
+	REGION_RULE_FILE, // file-backed maps
+	REGION_RULE_NAME, // maps with a special name, like [heap]
+	REGION_RULE_GLOB, // maps whose pathname matches a glob, like *libc*
+	REGION_RULE_SIZE_MIN, // maps at least size bytes long
+	REGION_RULE_SIZE_MAX // maps at most size bytes long
+} RegionRuleKind;
+
+typedef struct {
+	RegionRuleKind kind;
+	bool exclude; // skip maps which match this rule, rather than including them
+	Address size;
+	char pattern[128];
+} RegionRule;
+
+typedef struct {
+	unsigned n_rules; // 0 to search every map
+	RegionRule rules[REGION_FILTER_MAX_RULES];
+} RegionFilter;
+
+// a process being searched (see search_start)
+typedef struct {
+	PID pid;
+	Map *maps; // maps at the start of the search
+	unsigned nmaps;
+	Address total_memory; // total size of maps
+	// for each data type being searched for (NULL for other types), a bitset, where the ith bit
+	// corresponds to whether position #i in the process's memory is a search candidate.
+	Bitset *search_candidates[DATA_TYPE_COUNT];
+	Address n_candidates[DATA_TYPE_COUNT];
+	// for each data type being searched for, the number of candidates in each map (see process_count_candidates)
+	Address *map_candidates[DATA_TYPE_COUNT];
+	char **map_names; // pathname of each map (NULL if it's not known -- see process_read_map_names)
+	// a hash of each page of memory from the last time it was checked (0 if it hasn't been),
+	// so that pages which haven't changed can be skipped (see search_pass_signature)
+	uint64_t *page_hashes;
+	uint64_t page_hashes_signature; // the signature of the steps page_hashes is for
+	FILE *prev_memory; // used by same/different search to hold the memory at the previous step
+} Process;
+
+// the step of a search which is currently running (see search_update)
+typedef struct SearchPass SearchPass;
+
+// search candidates being written to a file (see export_start)
+typedef struct Export Export;
+
+// which pages of a process's memory have been changing (see profile_start)
+typedef struct Profile Profile;
+
+// a row of the memory view, with the value it had when it was last refreshed (see memory_view_refresh)
+typedef struct {
+	PID pid;
+	Address addr;
+	DataType type;
+	uint64_t value;
+	bool valid; // could the value be read?
+	bool shown; // has value been put in the memory view?
+} MemoryViewRow;
+
+// a change to memory which can be undone, e.g. setting all of the candidates to a value (see journal_begin)
+typedef struct {
+	off_t start; // where its writes start in Journal.fp
+	Address n_writes;
+	char what[64]; // e.g. "set all"
+} JournalOp;
+
+// a record of the old and new bytes of every write to memory
+typedef struct {
+	FILE *fp; // temporary file which the writes are appended to
+	JournalOp *ops;
+	unsigned n_ops;
+} Journal;
+
 typedef struct {
 	GtkWindow *window;
 	GtkBuilder *builder;
 	bool stop_while_accessing_memory;
+	bool snapshot_memory; // when searching, only stop the process while copying its memory (see read_ahead_start)
+	bool skip_unchanged_pages; // see Process.page_hashes
 	long editing_memory; // index of memory value being edited, or -1 if none is
 	PID pid;
+	// all of the selected processes (pids[0] == pid). they're all searched at once.
+	PID *pids;
+	unsigned n_pids;
 	Address total_memory; // total amount of memory used by process, in bytes
+	Address all_total_memory; // total_memory, added up over all of the selected processes
 	Map *maps;
+	RegionFilter region_filter; // which maps are searched (from the "region-filter" entry)
 	Address memory_view_address;
-	unsigned memory_view_n_items; // # of entries to show
+	unsigned memory_view_n_items; // # of entries to show (or structs, if there's a layout)
+	Layout layout; // from the "layout" entry. it's used when memory_view_address is set.
 	unsigned nmaps;
 	DataType data_type;
 	SearchType search_type;
+	FloatTolerance float_tolerance;
+	Group group; // the group from the last step of an enter-value search
 	GtkWidget *prev_focus;
-	uint64_t *search_candidates; // this is a bit array, where the ith bit corresponds to whether byte #i in the processes memory is a search candidate.
-	FILE *prev_memory; // used by same/different search to hold the memory at the previous step
+	bool searching;
+	bool search_unaligned; // are there search candidates at every byte offset, rather than just multiples of the item size?
+	// the processes being searched (processes[0] is pid). they all search for the same types.
+	Process *processes;
+	unsigned n_processes;
+	Address n_candidates[DATA_TYPE_COUNT]; // total over all processes
+	SearchPass *search_pass; // NULL if no step is running
+	Export *export; // NULL if no export is running
+	Profile *profile; // NULL if memory activity hasn't been profiled (or the profile has been thrown away)
+	MemoryViewRow *view_rows; // NULL if the rows of the memory view have changed since the last refresh
+	unsigned n_view_rows;
+	DataType view_rows_type; // data type the values in view_rows were shown as
+	int *view_readers; // for each of pids, a reader kept open between auto-refreshes (see memory_view_reader)
+	gint64 auto_refresh_next; // when the memory view should next be auto-refreshed
+	gint64 auto_refresh_interval; // time between auto-refreshes, in microseconds
+	Journal journal;
+	// only show the candidates in the map starting at region_focus_lo in process region_focus_pid
+	// in the memory view (region_focus_pid is 0 to show every map's candidates -- see regions_do_focus)
+	PID region_focus_pid;
+	Address region_focus_lo;
+	ReadTuning read_tuning; // from timing reads when the search was started (zeroed if it hasn't been yet)
+	int agent; // socket connected to the agent (see agent.c), or 0 if memory is accessed directly
+	GMutex agent_mutex;
 } State;
 
 static void display_dialog_box_nofmt(State *state, GtkMessageType type, char const *message) {
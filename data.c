@@ -39,6 +39,27 @@ static DataType data_type_from_name(char const *name) {
 	return TYPE_U8;
 }
 
+// inverse of data_type_from_name
+static char const *data_type_name(DataType type) {
+	switch (type) {
+	case TYPE_U8:    return "u8";
+	case TYPE_S8:    return "s8";
+	case TYPE_U16:   return "u16";
+	case TYPE_S16:   return "s16";
+	case TYPE_U32:   return "u32";
+	case TYPE_S32:   return "s32";
+	case TYPE_U64:   return "u64";
+	case TYPE_S64:   return "s64";
+	case TYPE_ASCII: return "ascii";
+	case TYPE_UTF16: return "utf16";
+	case TYPE_UTF32: return "utf32";
+	case TYPE_F32:   return "f32";
+	case TYPE_F64:   return "f64";
+	}
+	assert(0);
+	return "";
+}
+
 static size_t data_type_size(DataType type) {
 	switch (type) {
 	case TYPE_U8:
@@ -62,6 +83,10 @@ static size_t data_type_size(DataType type) {
 	return (size_t)-1;
 }
 
+static bool data_type_is_float(DataType type) {
+	return type == TYPE_F32 || type == TYPE_F64;
+}
+
 // set str to "a" for 'a', "\\n" for '\n', "\\xff" for (wchar_t)255, etc.
 static void char_to_str(uint32_t c, char *str, size_t str_size) {
 	if (c <= WINT_MAX && iswgraph((wint_t)c)) {
@@ -127,20 +152,69 @@ static void data_to_str(void const *value, DataType type, char *str, size_t str_
 	}
 }
 
-// returns true on success, false if str is not a well-formatted value
+// parse a decimal integer which has to be at most max.
+// (unlike sscanf, this doesn't wrap around out-of-range values like -3 or 300 for a u8)
+static bool unsigned_from_str(char const *str, uint64_t max, uint64_t *value) {
+	while (isspace((unsigned char)*str)) ++str;
+	if (*str == '-') return false;
+	char *end;
+	errno = 0;
+	unsigned long long v = strtoull(str, &end, 10);
+	if (end == str || *end || errno == ERANGE || v > max) return false;
+	*value = v;
+	return true;
+}
+
+// parse a decimal integer which has to be in [min, max]
+static bool signed_from_str(char const *str, int64_t min, int64_t max, int64_t *value) {
+	char *end;
+	errno = 0;
+	long long v = strtoll(str, &end, 10);
+	if (end == str || *end || errno == ERANGE || v < min || v > max) return false;
+	*value = v;
+	return true;
+}
+
+// returns true on success, false if str is not a well-formatted value (or is out of range for type)
 static bool data_from_str(char const *str, DataType type, void *value) {
 	int len = (int)strlen(str);
 	int w = 0;
 	uint32_t c = 0;
+	uint64_t u = 0;
+	int64_t s = 0;
 	switch (type) {
-	case TYPE_U8:  return sscanf(str, "%" SCNu8  "%n", (uint8_t  *)value, &w) == 1 && w == len;
-	case TYPE_S8:  return sscanf(str, "%" SCNd8  "%n", ( int8_t  *)value, &w) == 1 && w == len;
-	case TYPE_U16: return sscanf(str, "%" SCNu16 "%n", (uint16_t *)value, &w) == 1 && w == len;
-	case TYPE_S16: return sscanf(str, "%" SCNd16 "%n", ( int16_t *)value, &w) == 1 && w == len;
-	case TYPE_U32: return sscanf(str, "%" SCNu32 "%n", (uint32_t *)value, &w) == 1 && w == len;
-	case TYPE_S32: return sscanf(str, "%" SCNd32 "%n", ( int32_t *)value, &w) == 1 && w == len;
-	case TYPE_U64: return sscanf(str, "%" SCNu64 "%n", (uint64_t *)value, &w) == 1 && w == len;
-	case TYPE_S64: return sscanf(str, "%" SCNd64 "%n", ( int64_t *)value, &w) == 1 && w == len;
+	case TYPE_U8:
+		if (!unsigned_from_str(str, UINT8_MAX, &u)) return false;
+		*(uint8_t *)value = (uint8_t)u;
+		return true;
+	case TYPE_S8:
+		if (!signed_from_str(str, INT8_MIN, INT8_MAX, &s)) return false;
+		*(int8_t *)value = (int8_t)s;
+		return true;
+	case TYPE_U16:
+		if (!unsigned_from_str(str, UINT16_MAX, &u)) return false;
+		*(uint16_t *)value = (uint16_t)u;
+		return true;
+	case TYPE_S16:
+		if (!signed_from_str(str, INT16_MIN, INT16_MAX, &s)) return false;
+		*(int16_t *)value = (int16_t)s;
+		return true;
+	case TYPE_U32:
+		if (!unsigned_from_str(str, UINT32_MAX, &u)) return false;
+		*(uint32_t *)value = (uint32_t)u;
+		return true;
+	case TYPE_S32:
+		if (!signed_from_str(str, INT32_MIN, INT32_MAX, &s)) return false;
+		*(int32_t *)value = (int32_t)s;
+		return true;
+	case TYPE_U64:
+		if (!unsigned_from_str(str, UINT64_MAX, &u)) return false;
+		*(uint64_t *)value = u;
+		return true;
+	case TYPE_S64:
+		if (!signed_from_str(str, INT64_MIN, INT64_MAX, &s)) return false;
+		*(int64_t *)value = s;
+		return true;
 	case TYPE_F32: return sscanf(str, "%f"       "%n", (float    *)value, &w) == 1 && w == len;
 	case TYPE_F64: return sscanf(str, "%lf"      "%n", (double   *)value, &w) == 1 && w == len;
 	case TYPE_ASCII:
@@ -162,28 +236,363 @@ static bool data_from_str(char const *str, DataType type, void *value) {
 	return false;
 }
 
-// returns whether or not the values are equal, or in the case of floating-point numbers,
-// approximately equal
-static bool data_equal(DataType type, void const *a, void const *b) {
-	double af, bf;
+// parses a tolerance like "0.5" (absolute) or "10%" (relative).
+static bool float_tolerance_from_str(char const *str, FloatTolerance *tolerance) {
+	char *end;
+	double amount = strtod(str, &end);
+	if (end == str || !(amount >= 0) || isinf(amount)) return false;
+	bool relative = false;
+	if (*end == '%') {
+		relative = true;
+		amount /= 100;
+		++end;
+	}
+	if (*end) return false;
+	tolerance->amount = amount;
+	tolerance->relative = relative;
+	return true;
+}
+
+// get the range of values [*lo, *hi] which are within the tolerance of value.
+// this only needs to be done once per search step, so that checking each value
+// is just two comparisons (which are false for NaN, and for infinity since the range is finite).
+static void float_range(double value, FloatTolerance tolerance, double *lo, double *hi) {
+	double delta = tolerance.relative ? fabs(value) * tolerance.amount : tolerance.amount;
+	*lo = value - delta;
+	*hi = value + delta;
+}
+
+// like float_range, but *value, *lo and *hi have type TYPE_F32 or TYPE_F64.
+// for 32-bit floats, the range is rounded outwards so nothing in it is lost.
+static void data_float_range(DataType type, void const *value, FloatTolerance tolerance, void *lo, void *hi) {
+	double lo64, hi64;
 	switch (type) {
-	case TYPE_F32:
-		af = *(float *)a, bf = *(float *)b;
-		goto floats;
-	case TYPE_F64:
-		af = *(double *)a, bf = *(double *)b;
-		goto floats;
-	floats: {
-		if (isinf(af) || isinf(bf) || isnan(af) || isnan(bf))
-			return false;
-		// special handling for small numbers
-		if (fabs(af) < 0.1 && fabs(bf) < 0.1)
-			return true;
-		double ab = af / bf;
-		double threshold = 1.1; // allow a 10% difference.
-		return ab >= (1/threshold) && ab <= threshold;
+	case TYPE_F32: {
+		float_range(*(float const *)value, tolerance, &lo64, &hi64);
+		float lo32 = (float)lo64, hi32 = (float)hi64;
+		if ((double)lo32 > lo64) lo32 = nextafterf(lo32, -INFINITY);
+		if ((double)hi32 < hi64) hi32 = nextafterf(hi32, INFINITY);
+		*(float *)lo = lo32;
+		*(float *)hi = hi32;
 	} break;
+	case TYPE_F64:
+		float_range(*(double const *)value, tolerance, (double *)lo, (double *)hi);
+		break;
 	default:
-		return memcmp(a, b, data_type_size(type)) == 0;
+		assert(0);
+		break;
+	}
+}
+
+// is b within the tolerance of a? (without any branches)
+static bool float_same(double a, double b, FloatTolerance tolerance) {
+	double relative = tolerance.relative ? tolerance.amount : 0;
+	double absolute = tolerance.relative ? 0 : tolerance.amount;
+	double delta = fabs(a) * relative + absolute;
+	// infinities/NaNs are never the same as anything
+	return isfinite(a) & (b >= a - delta) & (b <= a + delta);
+}
+
+// remove whitespace from the end of s
+static void str_trim_end(char *s) {
+	size_t n = strlen(s);
+	while (n > 0 && isspace((unsigned char)s[n-1]))
+		s[--n] = '\0';
+}
+
+// get the value of an integer type as a 64-bit integer (sign-extended for signed types)
+static uint64_t data_to_u64(DataType type, void const *value) {
+	switch (type) {
+	case TYPE_U8:  return *(uint8_t  const *)value;
+	case TYPE_U16: return *(uint16_t const *)value;
+	case TYPE_U32: return *(uint32_t const *)value;
+	case TYPE_U64: return *(uint64_t const *)value;
+	case TYPE_S8:  return (uint64_t)*(int8_t  const *)value;
+	case TYPE_S16: return (uint64_t)*(int16_t const *)value;
+	case TYPE_S32: return (uint64_t)*(int32_t const *)value;
+	case TYPE_S64: return (uint64_t)*(int64_t const *)value;
+	default: assert(0); return 0;
+	}
+}
+
+static bool data_type_is_signed(DataType type) {
+	return type == TYPE_S8 || type == TYPE_S16 || type == TYPE_S32 || type == TYPE_S64;
+}
+
+// parses a search value for a numeric type, and gets the (inclusive) range [*lo, *hi]
+// of values which match it. the value can be one of:
+//    x       (for floating-point types, anything within the tolerance of x)
+//    a..b    (anything from a to b)
+//    <x  <=x  >x  >=x
+// if nothing can match (e.g. "<0" for an unsigned type), *lo > *hi.
+static bool data_range_from_str(char const *str, DataType type, FloatTolerance tolerance, void *lo, void *hi) {
+	enum { EQ, LT, LE, GT, GE, BETWEEN } op = EQ;
+	char a[64] = {0}, b[64] = {0};
+	size_t item_size = data_type_size(type);
+	
+	while (isspace((unsigned char)*str)) ++str;
+	char const *dots = strstr(str, "..");
+	if (*str == '<' || *str == '>') {
+		bool or_equal = str[1] == '=';
+		op = *str == '<' ? (or_equal ? LE : LT) : (or_equal ? GE : GT);
+		str += 1 + or_equal;
+		while (isspace((unsigned char)*str)) ++str;
+		snprintf(a, sizeof a, "%s", str);
+	} else if (dots) {
+		op = BETWEEN;
+		snprintf(a, sizeof a, "%.*s", (int)(dots - str), str);
+		char const *rest = dots + 2;
+		while (isspace((unsigned char)*rest)) ++rest;
+		snprintf(b, sizeof b, "%s", rest);
+	} else {
+		snprintf(a, sizeof a, "%s", str);
+	}
+	str_trim_end(a);
+	str_trim_end(b);
+	
+	uint64_t x = 0;
+	if (!data_from_str(a, type, &x)) return false;
+	if (op == BETWEEN) {
+		if (!data_from_str(b, type, hi)) return false;
+		memcpy(lo, &x, item_size);
+		return true;
+	}
+	
+	if (data_type_is_float(type)) {
+		bool f32 = type == TYPE_F32;
+		float v32; double v64;
+		memcpy(&v32, &x, sizeof v32);
+		memcpy(&v64, &x, sizeof v64);
+		double v = f32 ? v32 : v64;
+		double lo64 = -INFINITY, hi64 = INFINITY;
+		switch (op) {
+		case EQ:
+			data_float_range(type, &x, tolerance, lo, hi);
+			return true;
+		case LE: hi64 = v; break;
+		case GE: lo64 = v; break;
+		// the next floating-point number in the right direction
+		case LT: hi64 = f32 ? nextafterf((float)v, -INFINITY) : nextafter(v, -INFINITY); break;
+		case GT: lo64 = f32 ? nextafterf((float)v, INFINITY) : nextafter(v, INFINITY); break;
+		case BETWEEN: assert(0); break;
+		}
+		if (f32) {
+			*(float *)lo = (float)lo64;
+			*(float *)hi = (float)hi64;
+		} else {
+			*(double *)lo = lo64;
+			*(double *)hi = hi64;
+		}
+		return true;
+	}
+	
+	// integers
+	unsigned bits = (unsigned)item_size * 8;
+	bool is_signed = data_type_is_signed(type);
+	uint64_t min, max; // as (sign-extended) 64-bit integers
+	if (is_signed) {
+		min = (uint64_t)-1 << (bits - 1);
+		max = ~min;
+	} else {
+		min = 0;
+		max = bits == 64 ? UINT64_MAX : MASK64(bits) - 1;
+	}
+	uint64_t v = data_to_u64(type, &x);
+	uint64_t l = v, h = v;
+	switch (op) {
+	case EQ: break;
+	case LE: l = min; break;
+	case GE: h = max; break;
+	case LT:
+		l = min;
+		if (v == min) l = max, h = min; // nothing
+		else h = v - 1;
+		break;
+	case GT:
+		h = max;
+		if (v == max) l = max, h = min; // nothing
+		else l = v + 1;
+		break;
+	case BETWEEN: assert(0); break;
+	}
+	// (this is little-endian only, but so is the rest of pokemem)
+	memcpy(lo, &l, item_size);
+	memcpy(hi, &h, item_size);
+	return true;
+}
+
+// is value in the (inclusive) range [lo, hi] from data_range_from_str?
+static bool data_in_range(DataType type, void const *value, void const *lo, void const *hi) {
+	switch (type) {
+	#define IN_RANGE_CASE(type, T) \
+	case type: { \
+		T x, l, h; \
+		memcpy(&x, value, sizeof x); memcpy(&l, lo, sizeof l); memcpy(&h, hi, sizeof h); \
+		return x >= l && x <= h; \
+	}
+	IN_RANGE_CASE(TYPE_U8,  uint8_t)
+	IN_RANGE_CASE(TYPE_S8,  int8_t)
+	IN_RANGE_CASE(TYPE_U16, uint16_t)
+	IN_RANGE_CASE(TYPE_S16, int16_t)
+	IN_RANGE_CASE(TYPE_U32, uint32_t)
+	IN_RANGE_CASE(TYPE_S32, int32_t)
+	IN_RANGE_CASE(TYPE_U64, uint64_t)
+	IN_RANGE_CASE(TYPE_S64, int64_t)
+	IN_RANGE_CASE(TYPE_F32, float)
+	IN_RANGE_CASE(TYPE_F64, double)
+	#undef IN_RANGE_CASE
+	default: assert(0); return false;
+	}
+}
+
+// maximum number of characters in a string search
+#define STRING_MAX_CHARS 256
+
+// case folding for case-insensitive string searches
+static uint32_t char_fold_case(DataType type, uint32_t c) {
+	if (c < 128)
+		return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+	if (type == TYPE_ASCII || c > WINT_MAX)
+		return c;
+	return (uint32_t)towlower((wint_t)c);
+}
+
+// does anything other than c itself fold to the same thing as c?
+static bool char_has_case(DataType type, uint32_t c) {
+	if (c < 128)
+		return isalpha((int)c) != 0;
+	if (type == TYPE_ASCII || c > WINT_MAX)
+		return false;
+	return towlower((wint_t)c) != (wint_t)c || towupper((wint_t)c) != (wint_t)c;
+}
+
+// parses a string to search for with type TYPE_ASCII, TYPE_UTF16 or TYPE_UTF32.
+// the escapes \n, \t, \r, \v, \0, \\, \xHH, \uHHHH and \UHHHHHHHH are allowed.
+// *out is filled with (at most STRING_MAX_CHARS) items of the given type,
+// e.g. UTF-16 code units. returns the number of items, or 0 if str isn't valid.
+static size_t string_from_str(char const *str, DataType type, uint32_t *out) {
+	size_t len = strlen(str), n = 0;
+	char const *p = str, *end = str + len;
+	while (p < end) {
+		uint32_t c = 0;
+		if (*p == '\\') {
+			int digits = 0;
+			switch (p[1]) {
+			case 'n': c = '\n'; break;
+			case 't': c = '\t'; break;
+			case 'r': c = '\r'; break;
+			case 'v': c = '\v'; break;
+			case '0': c = '\0'; break;
+			case '\\': c = '\\'; break;
+			case 'x': digits = 2; break;
+			case 'u': digits = 4; break;
+			case 'U': digits = 8; break;
+			default: return 0;
+			}
+			p += 2;
+			if (digits) {
+				for (int i = 0; i < digits; ++i, ++p) {
+					if (!isxdigit((unsigned char)*p)) return 0;
+					c = c << 4 | (uint32_t)(isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+				}
+			}
+		} else {
+			size_t w = unicode_utf8_to_utf32(&c, p, (size_t)(end - p));
+			if (w == 0 || w > 4) return 0;
+			p += w;
+		}
+		switch (type) {
+		case TYPE_ASCII:
+			if (c > 127) return 0;
+			if (n >= STRING_MAX_CHARS) return 0;
+			out[n++] = c;
+			break;
+		case TYPE_UTF16:
+			if (c > 0x10FFFF) return 0;
+			if (c > 0xFFFF) {
+				// surrogate pair
+				if (n + 2 > STRING_MAX_CHARS) return 0;
+				c -= 0x10000;
+				out[n++] = 0xD800 | (c >> 10);
+				out[n++] = 0xDC00 | (c & 0x3FF);
+			} else {
+				if (n >= STRING_MAX_CHARS) return 0;
+				out[n++] = c;
+			}
+			break;
+		case TYPE_UTF32:
+			if (c > 0x10FFFF) return 0;
+			if (n >= STRING_MAX_CHARS) return 0;
+			out[n++] = c;
+			break;
+		default:
+			assert(0);
+			return 0;
+		}
+	}
+	return n;
+}
+
+static bool data_type_is_string(DataType type) {
+	return type == TYPE_ASCII || type == TYPE_UTF16 || type == TYPE_UTF32;
+}
+
+// parse a struct layout: fields like "hp s32 0" (name, type, offset), separated by commas or lines.
+// "stride 64" sets the distance between the structs in an array (by default, it's the size of the struct).
+// lines starting with # are ignored. returns false if the layout is invalid.
+static bool layout_parse(char const *str, Layout *layout) {
+	memset(layout, 0, sizeof *layout);
+	while (*str) {
+		size_t len = strcspn(str, ",\n");
+		char item[256], name[64], type_name[16], offset_str[32];
+		snprintf(item, sizeof item, "%.*s", (int)len, str);
+		str += len;
+		if (*str) ++str;
+		int n_words = sscanf(item, " %63s %15s %31s", name, type_name, offset_str);
+		if (n_words <= 0 || *name == '#') continue;
+		if (n_words == 2 && strcmp(name, "stride") == 0) {
+			char *end;
+			layout->stride = strtoull(type_name, &end, strncmp(type_name, "0x", 2) == 0 ? 16 : 10);
+			if (*end || !layout->stride || layout->stride > LAYOUT_MAX_SIZE) return false;
+			continue;
+		}
+		if (n_words != 3 || strlen(name) >= sizeof layout->fields[0].name || layout->n_fields >= LAYOUT_MAX_FIELDS)
+			return false;
+		int type = -1;
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+			if (strcmp(type_name, data_type_name((DataType)t)) == 0)
+				type = t;
+		if (type == -1) return false;
+		char const *offset_start = offset_str + (*offset_str == '+');
+		char *end;
+		Address offset = strtoull(offset_start, &end, strncmp(offset_start, "0x", 2) == 0 ? 16 : 10);
+		if (end == offset_start || *end || offset + data_type_size((DataType)type) > LAYOUT_MAX_SIZE) return false;
+		// keep the fields in order of offset
+		unsigned f = layout->n_fields++;
+		while (f > 0 && layout->fields[f - 1].offset > offset) {
+			layout->fields[f] = layout->fields[f - 1];
+			--f;
+		}
+		LayoutField *field = &layout->fields[f];
+		strcpy(field->name, name);
+		field->type = (DataType)type;
+		field->offset = offset;
+		Address field_end = offset + data_type_size(field->type);
+		if (field_end > layout->size) layout->size = field_end;
+	}
+	if (!layout->stride) layout->stride = layout->size;
+	return true;
+}
+
+// write out a layout the way layout_parse takes it, with the given separator between fields
+static void layout_to_str(Layout const *layout, char const *separator, char *out, size_t out_size) {
+	size_t len = 0;
+	*out = '\0';
+	for (unsigned f = 0; f < layout->n_fields; ++f) {
+		LayoutField const *field = &layout->fields[f];
+		snprintf(out + len, out_size - len, "%s%s %s %" PRIdADDR, f ? separator : "", field->name, data_type_name(field->type), field->offset);
+		len += strlen(out + len);
 	}
+	if (layout->n_fields && layout->stride != layout->size)
+		snprintf(out + len, out_size - len, "%sstride %" PRIdADDR, separator, layout->stride);
 }
@@ -0,0 +1,496 @@
+// exporting search candidates (addresses, current values and previous values) for other programs to look at
+//
+// this runs on its own thread, so it doesn't hold up the UI, and it reads the memory with the candidates
+// in it a run at a time (like search steps do). there are two formats:
+// CSV, with the columns pid,address,value -- addresses are in hex. for same/different searches, there's
+// also a previous column, with the value at the last step.
+// binary, which is made of columns so it's easy to load into e.g. numpy:
+//    ExportHeader
+//    blocks of up to EXPORT_BLOCK_ROWS candidates from the same process, each of which is:
+//       ExportBlock
+//       uint64_t addresses[n_rows]
+//       values[n_rows] (each one value_size bytes)
+//       previous values[n_rows] (if flags has EXPORT_HAS_PREVIOUS)
+//    an ExportBlock with n_rows = 0, which marks the end (if it isn't there, the export didn't finish)
+// everything is in the native byte order.
+
+static char const EXPORT_IDENT[4] = {'\xff', 'C', 'A', 'N'};
+#define EXPORT_VERSION 1
+#define EXPORT_BLOCK_ROWS 65536
+#define EXPORT_HAS_PREVIOUS 1
+// bytes of CSV text which are built up before being written out
+#define EXPORT_CSV_BUFFER_SIZE 65536
+
+typedef enum {
+	EXPORT_CSV,
+	EXPORT_BINARY
+} ExportFormat;
+
+typedef struct {
+	char ident[4];
+	uint32_t version;
+	uint32_t data_type;
+	uint32_t value_size;
+	uint32_t flags;
+	uint32_t padding;
+} ExportHeader;
+
+typedef struct {
+	uint32_t n_rows;
+	uint32_t pid;
+} ExportBlock;
+
+struct Export {
+	State const *state;
+	ExportFormat format;
+	FILE *fp;
+	char filename[256];
+	DataType type;
+	size_t stride, value_size;
+	ReadTuning tuning;
+	bool snapshot; // read all of a process's memory before resuming it (see read_ahead_start)
+	bool stop_while_accessing_memory;
+	// the processes being searched. these don't change while the export is running.
+	Process const *processes;
+	unsigned n_processes;
+	int *readers; // for each process (0 if it couldn't be read)
+	bool has_previous; // are the previous values being exported?
+	Address n_rows_total;
+	gint64 start_time;
+	GThread *thread; // NULL if the export is done on the main thread
+	GMutex mutex;
+	// these are protected by mutex
+	Address n_rows_done;
+	bool done;
+	bool cancel;
+	bool out_of_memory;
+	int write_errno; // nonzero if there was an error writing to the file
+};
+
+// rows waiting to be written out
+typedef struct {
+	Export *export;
+	PID pid;
+	size_t n_rows;
+	char *csv; // EXPORT_CSV_BUFFER_SIZE bytes
+	Address *addresses; // these are EXPORT_BLOCK_ROWS long
+	uint8_t *values;
+	uint8_t *previous;
+} ExportRows;
+
+// write a number in decimal. returns a pointer to the end of it.
+static char *export_decimal(char *out, uint64_t x) {
+	char digits[24];
+	int n = 0;
+	do {
+		digits[n++] = (char)('0' + x % 10);
+		x /= 10;
+	} while (x);
+	while (n) *out++ = digits[--n];
+	return out;
+}
+
+static char *export_hex(char *out, uint64_t x) {
+	char digits[16];
+	int n = 0;
+	do {
+		digits[n++] = "0123456789abcdef"[x & 0xf];
+		x >>= 4;
+	} while (x);
+	while (n) *out++ = digits[--n];
+	return out;
+}
+
+// write a value as CSV (quoted if it needs to be). this writes at most 64 bytes.
+static char *export_csv_value(char *out, DataType type, uint8_t const *value) {
+	uint64_t x = 0;
+	memcpy(&x, value, data_type_size(type));
+	switch (type) {
+	case TYPE_U8: case TYPE_U16: case TYPE_U32: case TYPE_U64:
+		return export_decimal(out, x);
+	case TYPE_S8: case TYPE_S16: case TYPE_S32: case TYPE_S64: {
+		// sign-extend it
+		unsigned bits = 8 * (unsigned)data_type_size(type);
+		int64_t s = (int64_t)(x << (64 - bits)) >> (64 - bits);
+		if (s < 0) {
+			*out++ = '-';
+			return export_decimal(out, (uint64_t)0 - (uint64_t)s);
+		}
+		return export_decimal(out, (uint64_t)s);
+	}
+	case TYPE_F32: {
+		float f;
+		memcpy(&f, value, sizeof f);
+		// (enough digits that the exact value can be gotten back)
+		return out + snprintf(out, 64, "%.9g", f);
+	}
+	case TYPE_F64: {
+		double d;
+		memcpy(&d, value, sizeof d);
+		return out + snprintf(out, 64, "%.17g", d);
+	}
+	case TYPE_ASCII: case TYPE_UTF16: case TYPE_UTF32: {
+		char str[32];
+		data_to_str(value, type, str, sizeof str);
+		if (strpbrk(str, ",\"")) {
+			*out++ = '"';
+			for (char const *p = str; *p; ++p) {
+				if (*p == '"') *out++ = '"';
+				*out++ = *p;
+			}
+			*out++ = '"';
+			return out;
+		}
+		size_t len = strlen(str);
+		memcpy(out, str, len);
+		return out + len;
+	}
+	}
+	return out;
+}
+
+// write out the rows which have been added (this is called whenever the buffers fill up)
+static void export_rows_flush(ExportRows *rows) {
+	Export *export = rows->export;
+	if (!rows->n_rows) return;
+	switch (export->format) {
+	case EXPORT_CSV:
+		break;
+	case EXPORT_BINARY: {
+		ExportBlock block = {(uint32_t)rows->n_rows, (uint32_t)rows->pid};
+		fwrite(&block, sizeof block, 1, export->fp);
+		fwrite(rows->addresses, sizeof *rows->addresses, rows->n_rows, export->fp);
+		fwrite(rows->values, export->value_size, rows->n_rows, export->fp);
+		if (export->has_previous)
+			fwrite(rows->previous, export->value_size, rows->n_rows, export->fp);
+	} break;
+	}
+	rows->n_rows = 0;
+}
+
+static void export_row(ExportRows *rows, Address addr, uint8_t const *value, uint8_t const *previous) {
+	Export *export = rows->export;
+	switch (export->format) {
+	case EXPORT_CSV: {
+		char *line = rows->csv + rows->n_rows;
+		line = export_decimal(line, (uint64_t)rows->pid);
+		*line++ = ',';
+		line = export_hex(line, addr);
+		*line++ = ',';
+		line = export_csv_value(line, export->type, value);
+		if (previous) {
+			*line++ = ',';
+			line = export_csv_value(line, export->type, previous);
+		}
+		*line++ = '\n';
+		// (for CSV, n_rows is the number of bytes in the buffer)
+		rows->n_rows = (size_t)(line - rows->csv);
+		if (rows->n_rows > EXPORT_CSV_BUFFER_SIZE - 256) {
+			fwrite(rows->csv, 1, rows->n_rows, export->fp);
+			rows->n_rows = 0;
+		}
+	} break;
+	case EXPORT_BINARY: {
+		size_t i = rows->n_rows++;
+		rows->addresses[i] = addr;
+		memcpy(&rows->values[i * export->value_size], value, export->value_size);
+		if (previous)
+			memcpy(&rows->previous[i * export->value_size], previous, export->value_size);
+		if (rows->n_rows == EXPORT_BLOCK_ROWS)
+			export_rows_flush(rows);
+	} break;
+	}
+}
+
+// export the candidates in process #p. returns false if the export was cancelled or there wasn't enough memory.
+static bool export_process(Export *export, ExportRows *rows, unsigned p) {
+	Process const *proc = &export->processes[p];
+	Bitset const *candidates = proc->search_candidates[export->type];
+	int reader = export->readers[p];
+	size_t stride = export->stride;
+	if (!candidates || !reader) return true;
+	// for CSV, the rows are written as they're added, so the pid is right for the rows in the buffer already
+	if (export->format == EXPORT_BINARY)
+		export_rows_flush(rows);
+	rows->pid = proc->pid;
+
+	// find the stretches of memory with candidates in them, each of which is read all at once (like search_process)
+	SearchRun *runs = NULL;
+	size_t n_runs = 0;
+	Address *map_offset = calloc(proc->nmaps + 1, sizeof *map_offset);
+	bool success = map_offset != NULL;
+	for (unsigned m = 0; success && m < proc->nmaps; ++m)
+		map_offset[m + 1] = map_offset[m] + proc->maps[m].size;
+	if (success) {
+		Bitset *type_candidates[DATA_TYPE_COUNT] = {0};
+		size_t type_stride[DATA_TYPE_COUNT] = {0};
+		type_candidates[export->type] = (Bitset *)candidates;
+		type_stride[export->type] = stride;
+		success = search_runs_find(proc, type_candidates, type_stride, map_offset, export->tuning, &runs, &n_runs);
+	}
+
+	// values which start near the end of a run can go past it (for unaligned candidates), so read a bit more
+	ReadRequest *requests = NULL;
+	if (success && n_runs) {
+		requests = calloc(n_runs, sizeof *requests);
+		if (!requests) success = false;
+	}
+	for (size_t r = 0; success && r < n_runs; ++r) {
+		SearchRun const *run = &runs[r];
+		Map const *map = &proc->maps[run->map];
+		size_t after = 8;
+		if (after > map->size - run->offset - run->size)
+			after = (size_t)(map->size - run->offset - run->size);
+		requests[r].addr = map->lo + run->offset;
+		requests[r].size = run->size + after;
+		requests[r].buffer_size = run->size + 8;
+		requests[r].buffer_offset = 0;
+	}
+	uint8_t *prevbuf = NULL;
+	if (success && export->has_previous) {
+		prevbuf = malloc(export->tuning.run_max + 8);
+		if (!prevbuf) success = false;
+	}
+
+	ReadAhead read_ahead;
+	if (success && !read_ahead_start(&read_ahead, reader, requests, n_runs,
+		export->stop_while_accessing_memory && export->snapshot)) {
+		success = false;
+	}
+	bool cancel = false;
+	if (success) {
+		if (read_ahead.snapshot)
+			memory_reader_resume(export->state, proc->pid);
+		int prev_fd = export->has_previous ? fileno(proc->prev_memory) : -1;
+		for (size_t r = 0; r < n_runs; ++r) {
+			SearchRun const *run = &runs[r];
+			Map const *map = &proc->maps[run->map];
+			Address run_start = map_offset[run->map] + run->offset;
+			g_mutex_lock(&export->mutex);
+			cancel = export->cancel;
+			g_mutex_unlock(&export->mutex);
+			if (cancel) break;
+			uint8_t const *run_bytes = read_ahead_get(&read_ahead, r);
+			if (prevbuf) {
+				// (pread doesn't move the file position, which the main thread might be using)
+				memset(prevbuf, 0, run->size + 8);
+				pread(prev_fd, prevbuf, run->size + 8, (off_t)run_start);
+			}
+			Address first = run_start / stride;
+			Address n_positions = run->size / stride;
+			Address n_rows = 0;
+			for (Address w = first / 64; w < (first + n_positions) / 64; ++w) {
+				uint64_t bits = bitset_words(candidates, w)[0];
+				while (bits) {
+					Address i = w * 64 + (Address)__builtin_ctzll(bits) - first;
+					bits &= bits - 1;
+					export_row(rows, map->lo + run->offset + i * stride, &run_bytes[i * stride],
+						prevbuf ? &prevbuf[i * stride] : NULL);
+					++n_rows;
+				}
+			}
+			read_ahead_release(&read_ahead, r);
+			g_mutex_lock(&export->mutex);
+			export->n_rows_done += n_rows;
+			g_mutex_unlock(&export->mutex);
+		}
+		read_ahead_stop(&read_ahead);
+	}
+	free(prevbuf);
+	free(requests);
+	free(runs);
+	free(map_offset);
+	if (!success) {
+		g_mutex_lock(&export->mutex);
+		export->out_of_memory = true;
+		g_mutex_unlock(&export->mutex);
+	}
+	return success && !cancel;
+}
+
+static gpointer export_thread(gpointer user_data) {
+	Export *export = user_data;
+	ExportRows rows = {0};
+	rows.export = export;
+	bool success = true;
+	switch (export->format) {
+	case EXPORT_CSV:
+		rows.csv = malloc(EXPORT_CSV_BUFFER_SIZE);
+		success = rows.csv != NULL;
+		if (success) {
+			fputs(export->has_previous ? "pid,address,value,previous\n" : "pid,address,value\n", export->fp);
+		}
+		break;
+	case EXPORT_BINARY: {
+		rows.addresses = malloc(EXPORT_BLOCK_ROWS * sizeof *rows.addresses);
+		rows.values = malloc(EXPORT_BLOCK_ROWS * export->value_size);
+		rows.previous = malloc(EXPORT_BLOCK_ROWS * export->value_size);
+		success = rows.addresses && rows.values && rows.previous;
+		if (success) {
+			ExportHeader header = {0};
+			memcpy(header.ident, EXPORT_IDENT, sizeof header.ident);
+			header.version = EXPORT_VERSION;
+			header.data_type = export->type;
+			header.value_size = (uint32_t)export->value_size;
+			header.flags = export->has_previous ? EXPORT_HAS_PREVIOUS : 0;
+			fwrite(&header, sizeof header, 1, export->fp);
+		}
+	} break;
+	}
+	if (success) {
+		for (unsigned p = 0; p < export->n_processes && success; ++p)
+			success = export_process(export, &rows, p);
+		switch (export->format) {
+		case EXPORT_CSV:
+			fwrite(rows.csv, 1, rows.n_rows, export->fp);
+			break;
+		case EXPORT_BINARY:
+			export_rows_flush(&rows);
+			if (success) {
+				ExportBlock end = {0};
+				fwrite(&end, sizeof end, 1, export->fp);
+			}
+			break;
+		}
+	}
+	// (errno is per-thread, so get it here)
+	int write_errno = 0;
+	if (fflush(export->fp) != 0 || ferror(export->fp))
+		write_errno = errno ? errno : EIO;
+	free(rows.csv);
+	free(rows.addresses);
+	free(rows.values);
+	free(rows.previous);
+	g_mutex_lock(&export->mutex);
+	if (!success && !export->cancel) export->out_of_memory = true;
+	export->write_errno = write_errno;
+	export->done = true;
+	g_mutex_unlock(&export->mutex);
+	return NULL;
+}
+
+static void export_show(State *state, char const *text) {
+	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(state->builder, "export-status")), text);
+}
+
+// start exporting the candidates for state->data_type to a file
+static void export_start(State *state, char const *filename, ExportFormat format) {
+	if (!searching_for(state, state->data_type)) return;
+	if (state->export) {
+		display_error_nofmt(state, "An export is already running.");
+		return;
+	}
+	if (state->search_pass) {
+		display_error_nofmt(state, "Wait for the search step to finish first.");
+		return;
+	}
+	Export *export = calloc(1, sizeof *export);
+	if (export) export->readers = calloc(state->n_processes, sizeof *export->readers);
+	if (!export || !export->readers) {
+		free(export);
+		display_error_nofmt(state, "Not enough memory available for export.");
+		return;
+	}
+	export->fp = fopen(filename, "wb");
+	if (!export->fp) {
+		display_error(state, "Couldn't open %s: %s.", filename, strerror(errno));
+		free(export->readers);
+		free(export);
+		return;
+	}
+	// the rows are buffered up anyway, so write them out in big pieces
+	setvbuf(export->fp, NULL, _IOFBF, 1 << 20);
+	snprintf(export->filename, sizeof export->filename, "%s", filename);
+	export->state = state;
+	export->format = format;
+	export->type = state->data_type;
+	export->stride = search_stride(state, state->data_type);
+	export->value_size = data_type_size(state->data_type);
+	export->tuning = read_tuning(state);
+	export->stop_while_accessing_memory = state->stop_while_accessing_memory;
+	export->snapshot = state->snapshot_memory;
+	export->processes = state->processes;
+	export->n_processes = state->n_processes;
+	export->has_previous = state->search_type == SEARCH_SAME_DIFFERENT;
+	export->n_rows_total = state->n_candidates[state->data_type];
+	for (unsigned p = 0; p < state->n_processes; ++p) {
+		Process *proc = &state->processes[p];
+		if (!proc->prev_memory)
+			export->has_previous = false;
+		else
+			fflush(proc->prev_memory); // (so that export_process can read it)
+		// (this stops the process, if that's turned on, until the export is done)
+		export->readers[p] = memory_reader_open(state, proc->pid);
+	}
+	g_mutex_init(&export->mutex);
+	export->start_time = g_get_monotonic_time();
+	state->export = export;
+	export_show(state, "Exporting...");
+	GError *error = NULL;
+	export->thread = g_thread_try_new("export", export_thread, export, &error);
+	if (!export->thread) {
+		// just do it here
+		g_clear_error(&error);
+		export_thread(export);
+	}
+}
+
+// wait for the export to finish, and close it (showing how it went if show is true)
+static void export_end(State *state, bool show) {
+	Export *export = state->export;
+	if (export->thread)
+		g_thread_join(export->thread);
+	// (do this first, so that closing the readers lets the processes continue)
+	state->export = NULL;
+	for (unsigned p = 0; p < export->n_processes; ++p)
+		if (export->readers[p])
+			memory_reader_close(state, export->processes[p].pid, export->readers[p]);
+	int write_errno = export->write_errno;
+	if (fclose(export->fp) != 0 && !write_errno)
+		write_errno = errno;
+	char text[512];
+	double seconds = (double)(g_get_monotonic_time() - export->start_time) * 1e-6;
+	if (!show) {
+		// (we're quitting)
+	} else if (export->out_of_memory) {
+		snprintf(text, sizeof text, "Export failed.");
+		display_error_nofmt(state, "Not enough memory available for export.");
+	} else if (write_errno) {
+		snprintf(text, sizeof text, "Export failed.");
+		display_error(state, "Couldn't write to %s: %s.", export->filename, strerror(write_errno));
+	} else if (export->cancel) {
+		snprintf(text, sizeof text, "Export stopped after %" PRIdADDR " candidates.", export->n_rows_done);
+	} else {
+		snprintf(text, sizeof text, "Exported %" PRIdADDR " candidates in %.1fs.", export->n_rows_done, seconds);
+	}
+	if (show) export_show(state, text);
+	g_mutex_clear(&export->mutex);
+	free(export->readers);
+	free(export);
+}
+
+// show how the export is going (and finish it if it's done)
+static void export_poll(State *state) {
+	Export *export = state->export;
+	g_mutex_lock(&export->mutex);
+	bool done = export->done;
+	Address n_rows_done = export->n_rows_done;
+	g_mutex_unlock(&export->mutex);
+	if (done) {
+		export_end(state, true);
+		return;
+	}
+	char text[128];
+	snprintf(text, sizeof text, "Exported %" PRIdADDR " of %" PRIdADDR " candidates...", n_rows_done, export->n_rows_total);
+	export_show(state, text);
+}
+
+// stop the export (if there is one), leaving what's been written so far in the file
+static void export_stop(State *state, bool show) {
+	Export *export = state->export;
+	if (!export) return;
+	g_mutex_lock(&export->mutex);
+	export->cancel = true;
+	g_mutex_unlock(&export->mutex);
+	export_end(state, show);
+}
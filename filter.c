@@ -0,0 +1,597 @@
+// filter expressions, for finding values which are stored in a funny way,
+// e.g. x / 8 == 100, x ^ 0x5a5a == 1234, (x >> 4) & 0xff == 12, x - p == 5.
+//
+// x is the current value, and p is the value at the last step (same/different searches only).
+// the operators are (loosest first): || && ! comparisons | ^ & << >> + - * / % and unary - ~.
+// unlike C, comparisons are looser than the bitwise operators, so x & 0xff == 12 does what it looks like.
+// integer types are worked with as (sign-extended) 64-bit integers, and floating-point ones as doubles,
+// where == and != use the floating-point tolerance.
+//
+// an expression is compiled into bytecode for a stack machine, which is run on 64 positions at once
+// (see filter_eval_int) -- each instruction is a simple loop over 64 values, which the compiler can vectorize.
+
+#define FILTER_MAX_NODES 64
+#define FILTER_MAX_DEPTH 16
+// most nested parentheses and unary operators (each one is a level of recursion when parsing)
+#define FILTER_MAX_NESTING 64
+
+typedef enum {
+	FILTER_X,
+	FILTER_P,
+	FILTER_CONST,
+	// unary
+	FILTER_NEG,
+	FILTER_COMPL,
+	FILTER_NOT,
+	// binary
+	FILTER_MUL,
+	FILTER_DIV,
+	FILTER_MOD,
+	FILTER_ADD,
+	FILTER_SUB,
+	FILTER_SHL,
+	FILTER_SHR,
+	FILTER_AND,
+	FILTER_XOR,
+	FILTER_OR,
+	FILTER_EQ,
+	FILTER_NE,
+	FILTER_LT,
+	FILTER_LE,
+	FILTER_GT,
+	FILTER_GE,
+	FILTER_LAND,
+	FILTER_LOR
+} FilterOpcode;
+
+typedef struct {
+	uint8_t opcode; // a FilterOpcode
+	uint8_t constant; // FILTER_CONST: index into consts
+} FilterOp;
+
+typedef struct {
+	bool is_float; // are values doubles, rather than 64-bit integers?
+	bool uses_prev; // does it use p?
+	FloatTolerance tolerance; // for == and != with floats
+	unsigned n_code;
+	FilterOp code[FILTER_MAX_NODES];
+	// for floating-point types, these hold the bits of doubles
+	int64_t consts[FILTER_MAX_NODES];
+	// if the expression boils down to comparing x with a constant, the same thing written the way
+	// the current value box takes it (e.g. 100 or <=5), so that the usual scan functions can be used.
+	// "" otherwise.
+	char simple[64];
+} Filter;
+
+// the expression as a tree, while it's being compiled
+typedef struct {
+	uint8_t opcode;
+	uint8_t a, b; // operands
+	int64_t i; // FILTER_CONST, for integer types
+	double f; // FILTER_CONST, for floating-point types
+} FilterNode;
+
+typedef struct {
+	char const *s;
+	bool is_float;
+	FilterNode nodes[FILTER_MAX_NODES];
+	unsigned n_nodes;
+	unsigned nesting; // current level of parentheses and unary operators (see filter_nest)
+	char *error;
+	size_t error_size;
+} FilterParser;
+
+static void filter_skip_space(FilterParser *parser) {
+	while (isspace((unsigned char)*parser->s)) ++parser->s;
+}
+
+// does the expression continue with the operator op? (if so, skip over it)
+static bool filter_accept(FilterParser *parser, char const *op) {
+	filter_skip_space(parser);
+	size_t len = strlen(op);
+	if (strncmp(parser->s, op, len) != 0) return false;
+	// don't mistake < for <=, & for &&, etc.
+	char next = parser->s[len];
+	if (len == 1 && (next == '=' || (next == *op && strchr("<>&|", *op))) && strchr("<>=!&|", *op))
+		return false;
+	parser->s += len;
+	return true;
+}
+
+// returns the index of the new node, or -1 if there are too many
+static int filter_node(FilterParser *parser, FilterOpcode opcode, int a, int b) {
+	if (a < 0 || b < 0) return -1;
+	if (parser->n_nodes >= FILTER_MAX_NODES) {
+		snprintf(parser->error, parser->error_size, "expression is too long");
+		return -1;
+	}
+	FilterNode *node = &parser->nodes[parser->n_nodes];
+	memset(node, 0, sizeof *node);
+	node->opcode = (uint8_t)opcode;
+	node->a = (uint8_t)a;
+	node->b = (uint8_t)b;
+	return (int)parser->n_nodes++;
+}
+
+static bool filter_is_comparison(FilterOpcode opcode) {
+	return opcode >= FILTER_EQ && opcode <= FILTER_GE;
+}
+
+// evaluate an operator on integers.
+// (everything wraps around, dividing by zero gives zero, and shifts only use the bottom 6 bits)
+static int64_t filter_op_int(FilterOpcode opcode, int64_t a, int64_t b) {
+	uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+	switch (opcode) {
+	case FILTER_NEG: return (int64_t)(0 - ua);
+	case FILTER_COMPL: return ~a;
+	case FILTER_NOT: return !a;
+	case FILTER_MUL: return (int64_t)(ua * ub);
+	case FILTER_DIV: return b == 0 ? 0 : b == -1 ? (int64_t)(0 - ua) : a / b;
+	case FILTER_MOD: return b == 0 || b == -1 ? 0 : a % b;
+	case FILTER_ADD: return (int64_t)(ua + ub);
+	case FILTER_SUB: return (int64_t)(ua - ub);
+	case FILTER_SHL: return (int64_t)(ua << (ub & 63));
+	case FILTER_SHR: return a >> (ub & 63);
+	case FILTER_AND: return a & b;
+	case FILTER_XOR: return a ^ b;
+	case FILTER_OR: return a | b;
+	case FILTER_EQ: return a == b;
+	case FILTER_NE: return a != b;
+	case FILTER_LT: return a < b;
+	case FILTER_LE: return a <= b;
+	case FILTER_GT: return a > b;
+	case FILTER_GE: return a >= b;
+	case FILTER_LAND: return a && b;
+	case FILTER_LOR: return a || b;
+	default: assert(0); return 0;
+	}
+}
+
+static double filter_op_float(FilterOpcode opcode, double a, double b, FloatTolerance tolerance) {
+	switch (opcode) {
+	case FILTER_NEG: return -a;
+	case FILTER_NOT: return a == 0;
+	case FILTER_MUL: return a * b;
+	case FILTER_DIV: return a / b;
+	case FILTER_MOD: return fmod(a, b);
+	case FILTER_ADD: return a + b;
+	case FILTER_SUB: return a - b;
+	case FILTER_EQ: return float_same(b, a, tolerance);
+	case FILTER_NE: return !float_same(b, a, tolerance);
+	case FILTER_LT: return a < b;
+	case FILTER_LE: return a <= b;
+	case FILTER_GT: return a > b;
+	case FILTER_GE: return a >= b;
+	case FILTER_LAND: return a != 0 && b != 0;
+	case FILTER_LOR: return a != 0 || b != 0;
+	default: assert(0); return 0;
+	}
+}
+
+static int filter_parse_or(FilterParser *parser);
+
+// go one level deeper into parentheses or unary operators. returns false if that's too deep,
+// so that something like ------...x can't run out of stack.
+static bool filter_nest(FilterParser *parser) {
+	if (parser->nesting >= FILTER_MAX_NESTING) {
+		snprintf(parser->error, parser->error_size, "expression is nested too deeply");
+		return false;
+	}
+	++parser->nesting;
+	return true;
+}
+
+static int filter_parse_operand(FilterParser *parser) {
+	filter_skip_space(parser);
+	char const *s = parser->s;
+	if (*s == '(') {
+		++parser->s;
+		int node = filter_parse_or(parser);
+		if (node < 0) return -1;
+		if (!filter_accept(parser, ")")) {
+			snprintf(parser->error, parser->error_size, "missing )");
+			return -1;
+		}
+		return node;
+	}
+	if ((*s == 'x' || *s == 'p') && !isalnum((unsigned char)s[1]) && s[1] != '_') {
+		++parser->s;
+		return filter_node(parser, *s == 'x' ? FILTER_X : FILTER_P, 0, 0);
+	}
+	if (isdigit((unsigned char)*s) || *s == '.') {
+		char *end_int = NULL, *end_float = NULL;
+		// (no octal -- 010 is 10)
+		int base = s[0] == '0' && (s[1] == 'x' || s[1] == 'X') ? 16 : 10;
+		errno = 0;
+		long long i = strtoll(s, &end_int, base);
+		bool int_overflow = errno == ERANGE;
+		if (int_overflow) {
+			// e.g. 0xffffffffffffffff
+			errno = 0;
+			i = (long long)strtoull(s, &end_int, base);
+			int_overflow = errno == ERANGE;
+		}
+		double f = strtod(s, &end_float);
+		bool is_int = end_int >= end_float && !int_overflow;
+		int node = filter_node(parser, FILTER_CONST, 0, 0);
+		if (node < 0) return -1;
+		if (parser->is_float) {
+			parser->nodes[node].f = is_int ? (double)i : f;
+		} else if (is_int) {
+			parser->nodes[node].i = i;
+		} else {
+			snprintf(parser->error, parser->error_size, "%.*s isn't an integer", (int)(end_float - s), s);
+			return -1;
+		}
+		parser->s = is_int ? end_int : end_float;
+		return node;
+	}
+	if (*s)
+		snprintf(parser->error, parser->error_size, "unexpected %.16s", s);
+	else
+		snprintf(parser->error, parser->error_size, "expression ends too soon");
+	return -1;
+}
+
+static int filter_parse_unary(FilterParser *parser) {
+	if (!filter_nest(parser)) return -1;
+	int node;
+	if (filter_accept(parser, "-")) {
+		node = filter_node(parser, FILTER_NEG, filter_parse_unary(parser), 0);
+	} else if (filter_accept(parser, "~")) {
+		if (parser->is_float) {
+			snprintf(parser->error, parser->error_size, "~ only works on integers");
+			node = -1;
+		} else {
+			node = filter_node(parser, FILTER_COMPL, filter_parse_unary(parser), 0);
+		}
+	} else if (filter_accept(parser, "+")) {
+		node = filter_parse_unary(parser);
+	} else {
+		// (this is where parentheses recurse too)
+		node = filter_parse_operand(parser);
+	}
+	--parser->nesting;
+	return node;
+}
+
+// operators for each level of precedence, tightest first
+static struct {
+	char const *op;
+	FilterOpcode opcode;
+} const filter_binary_ops[][4] = {
+	{{"*", FILTER_MUL}, {"/", FILTER_DIV}, {"%", FILTER_MOD}},
+	{{"+", FILTER_ADD}, {"-", FILTER_SUB}},
+	{{"<<", FILTER_SHL}, {">>", FILTER_SHR}},
+	{{"&", FILTER_AND}},
+	{{"^", FILTER_XOR}},
+	{{"|", FILTER_OR}},
+};
+
+static int filter_parse_binary(FilterParser *parser, int level) {
+	if (level < 0) return filter_parse_unary(parser);
+	int node = filter_parse_binary(parser, level - 1);
+	while (node >= 0) {
+		FilterOpcode opcode = FILTER_X;
+		for (int i = 0; i < 4 && filter_binary_ops[level][i].op; ++i) {
+			if (filter_accept(parser, filter_binary_ops[level][i].op)) {
+				opcode = filter_binary_ops[level][i].opcode;
+				break;
+			}
+		}
+		if (opcode == FILTER_X) break;
+		if (parser->is_float && opcode >= FILTER_SHL && opcode <= FILTER_OR) {
+			snprintf(parser->error, parser->error_size, "bitwise operators only work on integers");
+			return -1;
+		}
+		node = filter_node(parser, opcode, node, filter_parse_binary(parser, level - 1));
+	}
+	return node;
+}
+
+static int filter_parse_comparison(FilterParser *parser) {
+	if (filter_accept(parser, "!")) {
+		if (!filter_nest(parser)) return -1;
+		int node = filter_node(parser, FILTER_NOT, filter_parse_comparison(parser), 0);
+		--parser->nesting;
+		return node;
+	}
+	int node = filter_parse_binary(parser, (int)(sizeof filter_binary_ops / sizeof *filter_binary_ops) - 1);
+	static struct {
+		char const *op;
+		FilterOpcode opcode;
+	} const comparisons[] = {
+		{"==", FILTER_EQ}, {"!=", FILTER_NE}, {"<=", FILTER_LE}, {">=", FILTER_GE},
+		{"<", FILTER_LT}, {">", FILTER_GT}, {"=", FILTER_EQ},
+	};
+	for (size_t i = 0; node >= 0 && i < sizeof comparisons / sizeof *comparisons; ++i) {
+		if (filter_accept(parser, comparisons[i].op))
+			return filter_node(parser, comparisons[i].opcode, node,
+				filter_parse_binary(parser, (int)(sizeof filter_binary_ops / sizeof *filter_binary_ops) - 1));
+	}
+	return node;
+}
+
+static int filter_parse_and(FilterParser *parser) {
+	int node = filter_parse_comparison(parser);
+	while (node >= 0 && filter_accept(parser, "&&"))
+		node = filter_node(parser, FILTER_LAND, node, filter_parse_comparison(parser));
+	return node;
+}
+
+static int filter_parse_or(FilterParser *parser) {
+	int node = filter_parse_and(parser);
+	while (node >= 0 && filter_accept(parser, "||"))
+		node = filter_node(parser, FILTER_LOR, node, filter_parse_and(parser));
+	return node;
+}
+
+// replace operators on constants with their values. returns the node.
+static int filter_fold(FilterParser *parser, int index, FloatTolerance tolerance) {
+	FilterNode *node = &parser->nodes[index];
+	if (node->opcode <= FILTER_CONST) return index;
+	bool unary = node->opcode <= FILTER_NOT;
+	node->a = (uint8_t)filter_fold(parser, node->a, tolerance);
+	if (!unary) node->b = (uint8_t)filter_fold(parser, node->b, tolerance);
+	FilterNode const *a = &parser->nodes[node->a], *b = unary ? a : &parser->nodes[node->b];
+	if (a->opcode == FILTER_CONST && b->opcode == FILTER_CONST) {
+		if (parser->is_float)
+			node->f = filter_op_float((FilterOpcode)node->opcode, a->f, b->f, tolerance);
+		else
+			node->i = filter_op_int((FilterOpcode)node->opcode, a->i, b->i);
+		node->opcode = FILTER_CONST;
+	}
+	return index;
+}
+
+// write the bytecode for a node. returns the stack depth needed, or -1 if it's too deep.
+static int filter_emit(FilterParser *parser, Filter *filter, int index) {
+	FilterNode const *node = &parser->nodes[index];
+	FilterOp *op = &filter->code[filter->n_code++];
+	int depth = 1;
+	if (node->opcode == FILTER_CONST) {
+		op->constant = (uint8_t)(op - filter->code);
+		if (parser->is_float)
+			memcpy(&filter->consts[op->constant], &node->f, sizeof node->f);
+		else
+			filter->consts[op->constant] = node->i;
+	} else if (node->opcode > FILTER_CONST) {
+		// operands first
+		filter->n_code--;
+		int depth_a = filter_emit(parser, filter, node->a);
+		depth = depth_a;
+		if (node->opcode > FILTER_NOT) {
+			int depth_b = filter_emit(parser, filter, node->b);
+			if (depth_b < 0) return -1;
+			if (depth_b + 1 > depth) depth = depth_b + 1;
+		}
+		if (depth_a < 0 || depth > FILTER_MAX_DEPTH) return -1;
+		op = &filter->code[filter->n_code++];
+	}
+	op->opcode = node->opcode;
+	if (node->opcode == FILTER_P) filter->uses_prev = true;
+	return depth;
+}
+
+static bool filter_uses_value(FilterParser const *parser, int index) {
+	FilterNode const *node = &parser->nodes[index];
+	if (node->opcode == FILTER_X || node->opcode == FILTER_P) return true;
+	if (node->opcode == FILTER_CONST) return false;
+	return filter_uses_value(parser, node->a) || (node->opcode > FILTER_NOT && filter_uses_value(parser, node->b));
+}
+
+// can x be c, for an integer type? (expressions see x as a 64-bit integer, sign-extended for signed types)
+static bool filter_in_range(DataType type, int64_t c) {
+	unsigned bits = 8 * (unsigned)data_type_size(type);
+	if (bits == 64) return true;
+	int64_t limit = (int64_t)1 << (bits - data_type_is_signed(type));
+	return data_type_is_signed(type) ? c >= -limit && c < limit : c >= 0 && c < limit;
+}
+
+// if the expression is just a comparison of x with a constant, write it the way data_range_from_str takes it.
+// this has to match exactly what evaluating the expression would, so constants x can't be are left alone.
+static void filter_simplify(FilterParser const *parser, int root, DataType type, Filter *filter) {
+	FilterNode const *node = &parser->nodes[root];
+	filter->simple[0] = '\0';
+	FilterOpcode opcode = (FilterOpcode)node->opcode;
+	if (!filter_is_comparison(opcode) || opcode == FILTER_NE) return;
+	int side = node->a, other = node->b;
+	if (parser->nodes[side].opcode == FILTER_CONST) {
+		side = node->b, other = node->a;
+		// 5 < x is x > 5
+		switch (opcode) {
+		case FILTER_LT: opcode = FILTER_GT; break;
+		case FILTER_LE: opcode = FILTER_GE; break;
+		case FILTER_GT: opcode = FILTER_LT; break;
+		case FILTER_GE: opcode = FILTER_LE; break;
+		default: break;
+		}
+	}
+	if (parser->nodes[other].opcode != FILTER_CONST) return;
+	int64_t c = parser->nodes[other].i;
+	if (!parser->is_float && opcode == FILTER_EQ) {
+		// undo things like x + 5 == 10 or x ^ 0x5a == 100, which can't change which values are equal
+		while (true) {
+			FilterNode const *n = &parser->nodes[side];
+			if (n->opcode != FILTER_ADD && n->opcode != FILTER_SUB && n->opcode != FILTER_XOR) break;
+			FilterNode const *a = &parser->nodes[n->a], *b = &parser->nodes[n->b];
+			if (b->opcode == FILTER_CONST) {
+				c = n->opcode == FILTER_ADD ? filter_op_int(FILTER_SUB, c, b->i)
+					: n->opcode == FILTER_SUB ? filter_op_int(FILTER_ADD, c, b->i)
+					: c ^ b->i;
+				side = n->a;
+			} else if (a->opcode == FILTER_CONST) {
+				c = n->opcode == FILTER_ADD ? filter_op_int(FILTER_SUB, c, a->i)
+					: n->opcode == FILTER_SUB ? filter_op_int(FILTER_SUB, a->i, c)
+					: c ^ a->i;
+				side = n->b;
+			} else {
+				break;
+			}
+		}
+	}
+	if (parser->nodes[side].opcode != FILTER_X) return;
+	if (parser->is_float) {
+		double f = parser->nodes[other].f;
+		// expressions compare f32s as doubles, but data_range_from_str rounds the constant to a float
+		// (and rounds == ranges outwards), so that only gives the same result for < <= > >= with a float constant
+		if (type == TYPE_F32 && (opcode == FILTER_EQ || (double)(float)f != f)) return;
+		// 5 == x means 5 is within the tolerance of x, which isn't the same as x being within the tolerance of 5
+		if (opcode == FILTER_EQ && side == node->b && filter->tolerance.relative) return;
+	} else {
+		if (!filter_in_range(type, c)) return;
+		// (u64 x's above INT64_MAX are negative in expressions, so only == is the same)
+		if (type == TYPE_U64 && opcode != FILTER_EQ) return;
+	}
+	char const *prefix = opcode == FILTER_LT ? "<" : opcode == FILTER_LE ? "<="
+		: opcode == FILTER_GT ? ">" : opcode == FILTER_GE ? ">=" : "";
+	if (parser->is_float)
+		snprintf(filter->simple, sizeof filter->simple, "%s%.17g", prefix, parser->nodes[other].f);
+	else if (type == TYPE_U64)
+		snprintf(filter->simple, sizeof filter->simple, "%llu", (unsigned long long)c);
+	else
+		snprintf(filter->simple, sizeof filter->simple, "%s%lld", prefix, (long long)c);
+}
+
+// compile an expression for the given (numeric) type.
+// returns false and writes a message to error if it's invalid.
+static bool filter_compile(char const *str, DataType type, FloatTolerance tolerance, Filter *filter, char *error, size_t error_size) {
+	memset(filter, 0, sizeof *filter);
+	if (data_type_is_string(type)) {
+		snprintf(error, error_size, "expressions don't work with strings");
+		return false;
+	}
+	FilterParser parser = {0};
+	parser.s = str;
+	parser.is_float = data_type_is_float(type);
+	parser.error = error;
+	parser.error_size = error_size;
+	int root = filter_parse_or(&parser);
+	if (root < 0) return false;
+	filter_skip_space(&parser);
+	if (*parser.s) {
+		snprintf(error, error_size, "unexpected %.16s", parser.s);
+		return false;
+	}
+	if (!filter_uses_value(&parser, root)) {
+		snprintf(error, error_size, "it doesn't use x (the value)");
+		return false;
+	}
+	root = filter_fold(&parser, root, tolerance);
+	filter->is_float = parser.is_float;
+	filter->tolerance = tolerance;
+	if (filter_emit(&parser, filter, root) < 0) {
+		snprintf(error, error_size, "expression is too complicated");
+		return false;
+	}
+	filter_simplify(&parser, root, type, filter);
+	return true;
+}
+
+// run a filter on 64 values (and their previous values, if it uses p).
+// returns a bitmask of which ones pass.
+static uint64_t filter_eval_int(Filter const *filter, int64_t const *x, int64_t const *p) {
+	int64_t stack[FILTER_MAX_DEPTH][64];
+	unsigned sp = 0;
+	for (unsigned c = 0; c < filter->n_code; ++c) {
+		FilterOp op = filter->code[c];
+		switch ((FilterOpcode)op.opcode) {
+		case FILTER_X: memcpy(stack[sp++], x, sizeof stack[0]); continue;
+		case FILTER_P: memcpy(stack[sp++], p, sizeof stack[0]); continue;
+		case FILTER_CONST: {
+			int64_t k = filter->consts[op.constant];
+			for (unsigned i = 0; i < 64; ++i) stack[sp][i] = k;
+			++sp;
+		} continue;
+		default: break;
+		}
+		int64_t *a = stack[sp - 1], *b = stack[sp - 1];
+		if (op.opcode > FILTER_NOT) {
+			a = stack[sp - 2];
+			--sp;
+		}
+		// (these loops don't branch, so they can be vectorized)
+		#define FILTER_LOOP(expr) for (unsigned i = 0; i < 64; ++i) a[i] = (expr); break
+		switch ((FilterOpcode)op.opcode) {
+		case FILTER_NEG: FILTER_LOOP((int64_t)(0 - (uint64_t)a[i]));
+		case FILTER_COMPL: FILTER_LOOP(~a[i]);
+		case FILTER_NOT: FILTER_LOOP(a[i] == 0);
+		case FILTER_MUL: FILTER_LOOP((int64_t)((uint64_t)a[i] * (uint64_t)b[i]));
+		case FILTER_DIV:
+		case FILTER_MOD:
+			// (division can't be vectorized anyways)
+			for (unsigned i = 0; i < 64; ++i) a[i] = filter_op_int((FilterOpcode)op.opcode, a[i], b[i]);
+			break;
+		case FILTER_ADD: FILTER_LOOP((int64_t)((uint64_t)a[i] + (uint64_t)b[i]));
+		case FILTER_SUB: FILTER_LOOP((int64_t)((uint64_t)a[i] - (uint64_t)b[i]));
+		case FILTER_SHL: FILTER_LOOP((int64_t)((uint64_t)a[i] << (b[i] & 63)));
+		case FILTER_SHR: FILTER_LOOP(a[i] >> (b[i] & 63));
+		case FILTER_AND: FILTER_LOOP(a[i] & b[i]);
+		case FILTER_XOR: FILTER_LOOP(a[i] ^ b[i]);
+		case FILTER_OR: FILTER_LOOP(a[i] | b[i]);
+		case FILTER_EQ: FILTER_LOOP(a[i] == b[i]);
+		case FILTER_NE: FILTER_LOOP(a[i] != b[i]);
+		case FILTER_LT: FILTER_LOOP(a[i] < b[i]);
+		case FILTER_LE: FILTER_LOOP(a[i] <= b[i]);
+		case FILTER_GT: FILTER_LOOP(a[i] > b[i]);
+		case FILTER_GE: FILTER_LOOP(a[i] >= b[i]);
+		case FILTER_LAND: FILTER_LOOP((a[i] != 0) & (b[i] != 0));
+		case FILTER_LOR: FILTER_LOOP((a[i] != 0) | (b[i] != 0));
+		default: assert(0); break;
+		}
+		#undef FILTER_LOOP
+	}
+	uint64_t mask = 0;
+	for (unsigned i = 0; i < 64; ++i)
+		mask |= (uint64_t)(stack[0][i] != 0) << i;
+	return mask;
+}
+
+static uint64_t filter_eval_float(Filter const *filter, double const *x, double const *p) {
+	double stack[FILTER_MAX_DEPTH][64];
+	unsigned sp = 0;
+	FloatTolerance tolerance = filter->tolerance;
+	for (unsigned c = 0; c < filter->n_code; ++c) {
+		FilterOp op = filter->code[c];
+		switch ((FilterOpcode)op.opcode) {
+		case FILTER_X: memcpy(stack[sp++], x, sizeof stack[0]); continue;
+		case FILTER_P: memcpy(stack[sp++], p, sizeof stack[0]); continue;
+		case FILTER_CONST: {
+			double k;
+			memcpy(&k, &filter->consts[op.constant], sizeof k);
+			for (unsigned i = 0; i < 64; ++i) stack[sp][i] = k;
+			++sp;
+		} continue;
+		default: break;
+		}
+		double *a = stack[sp - 1], *b = stack[sp - 1];
+		if (op.opcode > FILTER_NOT) {
+			a = stack[sp - 2];
+			--sp;
+		}
+		#define FILTER_LOOP(expr) for (unsigned i = 0; i < 64; ++i) a[i] = (expr); break
+		switch ((FilterOpcode)op.opcode) {
+		case FILTER_NEG: FILTER_LOOP(-a[i]);
+		case FILTER_NOT: FILTER_LOOP(a[i] == 0);
+		case FILTER_MUL: FILTER_LOOP(a[i] * b[i]);
+		case FILTER_DIV: FILTER_LOOP(a[i] / b[i]);
+		case FILTER_MOD: FILTER_LOOP(fmod(a[i], b[i]));
+		case FILTER_ADD: FILTER_LOOP(a[i] + b[i]);
+		case FILTER_SUB: FILTER_LOOP(a[i] - b[i]);
+		case FILTER_EQ: FILTER_LOOP(float_same(b[i], a[i], tolerance));
+		case FILTER_NE: FILTER_LOOP(!float_same(b[i], a[i], tolerance));
+		case FILTER_LT: FILTER_LOOP(a[i] < b[i]);
+		case FILTER_LE: FILTER_LOOP(a[i] <= b[i]);
+		case FILTER_GT: FILTER_LOOP(a[i] > b[i]);
+		case FILTER_GE: FILTER_LOOP(a[i] >= b[i]);
+		case FILTER_LAND: FILTER_LOOP((a[i] != 0) & (b[i] != 0));
+		case FILTER_LOR: FILTER_LOOP((a[i] != 0) | (b[i] != 0));
+		default: assert(0); break;
+		}
+		#undef FILTER_LOOP
+	}
+	uint64_t mask = 0;
+	for (unsigned i = 0; i < 64; ++i)
+		mask |= (uint64_t)(stack[0][i] != 0) << i;
+	return mask;
+}
@@ -1,7 +1,14 @@
 #include "base.h"
 #include "unicode.h"
 #include "data.c"
+#include "filter.c"
+#include "search.c"
+#include "agent.c"
+#include "source.c"
 #include "memory.c"
+#include "session.c"
+#include "export.c"
+#include "profile.c"
 
 static SearchType search_type_from_str(char const *str) {
 	if (strcmp(str, "enter-value") == 0) {
@@ -13,95 +20,323 @@ static SearchType search_type_from_str(char const *str) {
 	return 0xff;
 }
 
-static void update_memory_view(State *state, bool addresses_need_updating) {
+// describe where the fields of a group search are relative to the candidate at addr in proc,
+// e.g. "f32 3.5 at +8, u16 7 at -4"
+static void group_describe(State *state, Process const *proc, int reader, Address addr, char *out, size_t out_size) {
+	Group const *group = &state->group;
+	Address window = group->window;
+	// read the memory around addr (staying inside its map)
+	Map const *map = NULL;
+	for (unsigned m = 0; m < proc->nmaps; ++m)
+		if (addr >= proc->maps[m].lo && addr - proc->maps[m].lo < proc->maps[m].size)
+			map = &proc->maps[m];
+	if (!map) {
+		snprintf(out, out_size, "N/A");
+		return;
+	}
+	Address lo = addr - map->lo < window ? map->lo : addr - window;
+	Address hi = map->lo + map->size - addr < window + 8 ? map->lo + map->size : addr + window + 8;
+	static uint8_t bytes[2 * GROUP_MAX_WINDOW + 8];
+	Address nread = memory_read_bytes(reader, lo, bytes, hi - lo);
+	*out = '\0';
+	size_t len = 0;
+	for (unsigned f = 0; f < group->n_fields; ++f) {
+		GroupField const *field = &group->fields[f];
+		size_t item_size = data_type_size(field->type);
+		size_t fstride = state->search_unaligned ? 1 : item_size;
+		// find the closest match
+		long long offset = 0;
+		for (Address d = 1; d < window && !offset; ++d) {
+			for (int sign = -1; sign <= 1; sign += 2) {
+				if (sign < 0 ? addr - lo < d : hi - addr < d) continue;
+				Address field_addr = sign < 0 ? addr - d : addr + d;
+				if (field_addr % fstride || field_addr - lo + item_size > nread) continue;
+				if (data_in_range(field->type, &bytes[field_addr - lo], &field->lo, &field->hi)) {
+					offset = sign * (long long)d;
+					break;
+				}
+			}
+		}
+		char value_str[32];
+		if (offset) {
+			data_to_str(&bytes[(Address)((long long)(addr - lo) + offset)], field->type, value_str, sizeof value_str);
+			snprintf(out + len, out_size - len, "%s%s %s at %+lld", f ? ", " : "", data_type_name(field->type), value_str, offset);
+		} else {
+			snprintf(out + len, out_size - len, "%s%s N/A", f ? ", " : "", data_type_name(field->type));
+		}
+		len += strlen(out + len);
+	}
+}
+
+// which process the value in a row of the memory view is in
+static PID memory_view_row_pid(State *state, GtkTreeModel *tree_model, GtkTreeIter *iter) {
+	gchararray pid_str = NULL;
+	gtk_tree_model_get(tree_model, iter, 4, &pid_str, -1);
+	PID pid = pid_str ? (PID)atoll(pid_str) : 0;
+	g_free(pid_str);
+	return pid ? pid : state->pid;
+}
+
+// the type of the value in a row of the memory view
+static DataType memory_view_row_type(State *state, GtkTreeModel *tree_model, GtkTreeIter *iter) {
+	gchararray type_str = NULL;
+	gtk_tree_model_get(tree_model, iter, 5, &type_str, -1);
+	DataType type = type_str && *type_str ? data_type_from_name(type_str) : state->data_type;
+	g_free(type_str);
+	return type;
+}
+
+// is the memory view showing the fields of structs (see Layout)?
+static bool memory_view_showing_layout(State *state) {
+	return state->layout.n_fields && state->memory_view_address;
+}
+
+// are the fields of a group search being shown in the memory view?
+static bool memory_view_showing_group(State *state) {
+	return state->group.n_fields && searching_for(state, state->data_type) && !state->memory_view_address;
+}
+
+// the most bytes read at once by memory_view_refresh
+#define MEMORY_VIEW_BATCH 4096
+
+// read the values of all the rows in the memory view, and update the ones which have changed.
+// nearby rows are read together, so e.g. consecutive addresses only need one read.
+// the readers are left open for next time if keep_open is true.
+// returns the number of rows which changed.
+static unsigned memory_view_refresh(State *state, bool keep_open) {
 	GtkBuilder *builder = state->builder;
 	GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "memory"));
 	GtkTreeModel *tree_model = GTK_TREE_MODEL(store);
 	DataType data_type = state->data_type;
+	bool show_group = memory_view_showing_group(state);
+	bool show_layout = memory_view_showing_layout(state);
+	unsigned n_fields = state->layout.n_fields;
+	Address batch_max = MEMORY_VIEW_BATCH; // most bytes to read at once
+	if (show_layout && state->layout.size > batch_max)
+		batch_max = state->layout.size;
+	unsigned changed = 0;
+	
+	if (!state->view_rows || state->view_rows_type != data_type) {
+		// find out what's in each row
+		free(state->view_rows); state->view_rows = NULL;
+		state->n_view_rows = 0;
+		unsigned n_rows = (unsigned)gtk_tree_model_iter_n_children(tree_model, NULL);
+		MemoryViewRow *rows = calloc(n_rows + 1, sizeof *rows);
+		if (!rows) return 0;
+		GtkTreeIter iter;
+		unsigned i = 0;
+		if (gtk_tree_model_get_iter_first(tree_model, &iter)) {
+			do {
+				MemoryViewRow *row = &rows[i++];
+				gchararray addr_str = NULL;
+				gtk_tree_model_get(tree_model, &iter, 1, &addr_str, -1);
+				sscanf(addr_str, "%" SCNxADDR, &row->addr);
+				g_free(addr_str);
+				row->pid = memory_view_row_pid(state, tree_model, &iter);
+				row->type = memory_view_row_type(state, tree_model, &iter);
+			} while (i < n_rows && gtk_tree_model_iter_next(tree_model, &iter));
+		}
+		state->view_rows = rows;
+		state->n_view_rows = i;
+		state->view_rows_type = data_type;
+	}
+	MemoryViewRow *rows = state->view_rows;
+	unsigned n_rows = state->n_view_rows;
+	
+	GtkTreeIter iter;
+	if (!gtk_tree_model_get_iter_first(tree_model, &iter)) n_rows = 0;
+	// the rows for each process are together, so we only need to stop one process at a time
+	PID stopped_pid = 0;
+	int reader = 0;
+	static uint8_t batch[LAYOUT_MAX_SIZE > MEMORY_VIEW_BATCH ? LAYOUT_MAX_SIZE : MEMORY_VIEW_BATCH];
+	Address batch_lo = 0, batch_read = 0; // batch holds batch_read bytes starting from batch_lo
+	PID batch_pid = 0;
+	for (unsigned i = 0; i < n_rows; ++i) {
+		MemoryViewRow *row = &rows[i];
+		if (row->pid != stopped_pid) {
+			if (stopped_pid) memory_view_reader_continue(state, stopped_pid);
+			stopped_pid = 0;
+			reader = 0;
+			for (unsigned p = 0; p < state->n_pids; ++p)
+				if (state->pids[p] == row->pid)
+					reader = memory_view_reader(state, p);
+			if (!state->view_rows) return changed; // the process was closed
+			if (!reader) break;
+			memory_view_reader_stop(state, row->pid);
+			stopped_pid = row->pid;
+		}
+		if (i != state->editing_memory) {
+			size_t item_size = data_type_size(row->type);
+			if (row->pid != batch_pid || row->addr < batch_lo || row->addr + item_size > batch_lo + batch_read) {
+				// read this row and the ones after it which are close enough.
+				// with a layout, only whole structs are read, so each struct takes (at most) one read.
+				Address hi = row->addr + item_size, read_hi = hi;
+				for (unsigned j = i + 1; j < n_rows && rows[j].pid == row->pid && rows[j].addr >= row->addr; ++j) {
+					Address row_hi = rows[j].addr + data_type_size(rows[j].type);
+					if (row_hi - row->addr > batch_max) break;
+					if (row_hi > hi) hi = row_hi;
+					if (!show_layout || (j + 1) % n_fields == 0) read_hi = hi;
+				}
+				batch_pid = row->pid;
+				batch_lo = row->addr;
+				batch_read = memory_read_bytes(reader, batch_lo, batch, read_hi - batch_lo);
+			}
+			uint64_t value = 0;
+			bool valid;
+			if (row->addr + item_size <= batch_lo + batch_read) {
+				memcpy(&value, &batch[row->addr - batch_lo], item_size);
+				valid = true;
+			} else {
+				// (the batch might have run into memory which can't be read)
+				valid = memory_read_bytes(reader, row->addr, (uint8_t *)&value, item_size) == item_size;
+			}
+			if (!row->shown || row->valid != valid || (valid && row->value != value)) {
+				char value_str[32];
+				if (valid)
+					data_to_str(&value, row->type, value_str, sizeof value_str);
+				else
+					strcpy(value_str, "N/A");
+				gtk_list_store_set(store, &iter, 2, value_str, -1);
+				row->value = value;
+				row->valid = valid;
+				row->shown = true;
+				++changed;
+			}
+			Process const *proc = process_find(state, row->pid);
+			if (show_group && proc) {
+				char fields_str[512];
+				group_describe(state, proc, reader, row->addr, fields_str, sizeof fields_str);
+				gchararray prev_fields_str = NULL;
+				gtk_tree_model_get(tree_model, &iter, 3, &prev_fields_str, -1);
+				if (!prev_fields_str || strcmp(prev_fields_str, fields_str) != 0) {
+					gtk_list_store_set(store, &iter, 3, fields_str, -1);
+					++changed;
+				}
+				g_free(prev_fields_str);
+			}
+		}
+		if (!gtk_tree_model_iter_next(tree_model, &iter)) break;
+	}
+	if (stopped_pid) memory_view_reader_continue(state, stopped_pid);
+	if (!keep_open) memory_view_readers_close(state);
+	return changed;
+}
+
+static void update_memory_view(State *state, bool addresses_need_updating) {
+	GtkBuilder *builder = state->builder;
+	GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "memory"));
+	DataType data_type = state->data_type;
 	size_t item_size = data_type_size(data_type);
 	
 	if (!state->pid) {
 		gtk_list_store_clear(store);
+		free(state->view_rows); state->view_rows = NULL;
 		return;
 	}
 	
 	if (addresses_need_updating) {
 		gtk_list_store_clear(store);
+		free(state->view_rows); state->view_rows = NULL;
 		if (state->pid) {
-			uint64_t *search_candidates = state->search_candidates;
 			Address address = state->memory_view_address;
-			bool show_candidates = search_candidates && !address;
+			bool show_candidates = searching_for(state, data_type) && !address;
 			unsigned n_items = state->memory_view_n_items;
-			if (show_candidates) {
-				// show the search candidates
+			if (show_candidates && state->search_pass) {
+				// a step is running, so show the candidates it's checked so far
+				SearchPass *pass = state->search_pass;
 				uint32_t candidate_idx = 0;
-				uint64_t *candidates = state->search_candidates;
-				Address bitset_index = 0;
-				for (unsigned m = 0; m < state->nmaps; ++m) {
-					Map *map = &state->maps[m];
-					for (Address i = 0; i < map->size / item_size; ) {
-						if (i % 64 == 0 && candidates[bitset_index / 64] == 0) {
-							// this stretch of 64 has no candidates.
-							i += 64;
-							bitset_index += 64;
-						} else {
-							if (candidates[bitset_index / 64] & MASK64(bitset_index % 64)) {
-								// a candidate!
-								Address addr = map->lo + i * item_size;
-								char idx_str[32], addr_str[32];
-								sprintf(idx_str, "%u", candidate_idx);
-								sprintf(addr_str, "%" PRIxADDR, addr);
-								gtk_list_store_insert_with_values(store, NULL, -1, 0, idx_str, 1, addr_str, 2, "", -1);
-								++candidate_idx;
-								if (candidate_idx >= n_items) goto done;
-							}
-							++i;
-							++bitset_index;
+				g_mutex_lock(&pass->mutex);
+				for (unsigned p = 0; p < pass->n_jobs; ++p) {
+					SearchJob const *job = &pass->jobs[p];
+					char pid_str[32];
+					sprintf(pid_str, "%lld", (long long)job->proc->pid);
+					for (unsigned i = 0; i < job->n_found && candidate_idx < n_items; ++i) {
+						char idx_str[32], addr_str[32];
+						sprintf(idx_str, "%u", candidate_idx);
+						sprintf(addr_str, "%" PRIxADDR, job->found[i]);
+						gtk_list_store_insert_with_values(store, NULL, -1, 0, idx_str, 1, addr_str, 2, "", 4, pid_str, -1);
+						++candidate_idx;
+					}
+				}
+				g_mutex_unlock(&pass->mutex);
+			} else if (show_candidates) {
+				// show the search candidates, one process after another
+				uint32_t candidate_idx = 0;
+				size_t stride = search_stride(state, data_type);
+				for (unsigned p = 0; p < state->n_processes && candidate_idx < n_items; ++p) {
+					Process const *proc = &state->processes[p];
+					Bitset const *search_candidates = proc->search_candidates[data_type];
+					char pid_str[32];
+					sprintf(pid_str, "%lld", (long long)proc->pid);
+					Address map_base = 0; // bitset index of the start of map #m
+					unsigned m = 0;
+					Address end = search_candidates->n_words * 64;
+					if (state->region_focus_pid) {
+						// only show the candidates in one map (see regions_do_focus)
+						if (proc->pid != state->region_focus_pid) continue;
+						m = process_find_map(proc, state->region_focus_lo);
+						if (m >= proc->nmaps) continue;
+						map_base = process_map_index(proc, m, stride);
+						end = map_base + proc->maps[m].size / stride;
+					}
+					for (Address bitset_index = bitset_next(search_candidates, map_base);
+						bitset_index < end && candidate_idx < n_items;
+						bitset_index = bitset_next(search_candidates, bitset_index + 1)) {
+						// a candidate! find the map it's in
+						while (m < proc->nmaps && bitset_index >= map_base + proc->maps[m].size / stride) {
+							map_base += proc->maps[m].size / stride;
+							++m;
 						}
+						if (m >= proc->nmaps) break;
+						Address addr = proc->maps[m].lo + (bitset_index - map_base) * stride;
+						char idx_str[32], addr_str[32];
+						sprintf(idx_str, "%u", candidate_idx);
+						sprintf(addr_str, "%" PRIxADDR, addr);
+						gtk_list_store_insert_with_values(store, NULL, -1, 0, idx_str, 1, addr_str, 2, "", 4, pid_str, -1);
+						++candidate_idx;
 					}
 				}
-				done:;
 			} else {
-				if (address) {
+				Layout const *layout = &state->layout;
+				if (address && layout->n_fields) {
+					// show the fields of an array of `n_items` structs starting from `address`
+					char pid_str[32];
+					sprintf(pid_str, "%lld", (long long)state->pid);
+					for (unsigned i = 0; i < n_items; ++i) {
+						for (unsigned f = 0; f < layout->n_fields; ++f) {
+							LayoutField const *field = &layout->fields[f];
+							char idx_str[64], addr_str[32];
+							Address addr = address + i * layout->stride + field->offset;
+							snprintf(idx_str, sizeof idx_str, "%u.%s", i, field->name);
+							sprintf(addr_str, "%" PRIxADDR, addr);
+							gtk_list_store_insert_with_values(store, NULL, -1, 0, idx_str, 1, addr_str, 2, "",
+								4, pid_str, 5, data_type_name(field->type), -1);
+						}
+					}
+				} else if (address) {
 					// show `n_items` items starting from `address`
+					char pid_str[32];
+					sprintf(pid_str, "%lld", (long long)state->pid);
 					for (unsigned i = 0; i < n_items; ++i) {
 						char idx_str[32], addr_str[32];
 						Address addr = address + i * item_size;
 						sprintf(idx_str, "%u", i);
 						sprintf(addr_str, "%" PRIxADDR, addr);
-						gtk_list_store_insert_with_values(store, NULL, -1, 0, idx_str, 1, addr_str, 2, "", -1);
+						gtk_list_store_insert_with_values(store, NULL, -1, 0, idx_str, 1, addr_str, 2, "", 4, pid_str, -1);
 					}
 				}
 			}
 		}
 	}
 	
-	GtkTreeIter iter;
-	if (gtk_tree_model_get_iter_first(tree_model, &iter)) {
-		int reader = memory_reader_open(state);
-		if (reader) {
-			int i = 0;
-			do {
-				if (i != state->editing_memory) {
-					gchararray addr_str = NULL;
-					gtk_tree_model_get(tree_model, &iter, 1, &addr_str, -1);
-					Address addr = 0;
-					sscanf(addr_str, "%" SCNxADDR, &addr);
-					g_free(addr_str);
-					uint64_t value = 0;
-					size_t nread = memory_read_bytes(reader, addr, (uint8_t *)&value, item_size);
-					char value_str[32];
-					if (nread == item_size)
-						data_to_str(&value, data_type, value_str, sizeof value_str);
-					else
-						strcpy(value_str, "N/A");
-					gtk_list_store_set(store, &iter, 2, value_str, -1);
-				}
-				++i;
-			} while (gtk_tree_model_iter_next(tree_model, &iter));
-		}
-		memory_reader_close(state, reader);
-	}
+	// show the fields of a group search
+	gtk_tree_view_column_set_visible(GTK_TREE_VIEW_COLUMN(gtk_builder_get_object(builder, "header_fields")), memory_view_showing_group(state));
+	// show which process each value is in if there's more than one
+	gtk_tree_view_column_set_visible(GTK_TREE_VIEW_COLUMN(gtk_builder_get_object(builder, "header_pid")), state->n_pids > 1);
+	gtk_tree_view_column_set_visible(GTK_TREE_VIEW_COLUMN(gtk_builder_get_object(builder, "header_type")), memory_view_showing_layout(state));
+	
+	bool auto_refresh = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "auto-refresh")));
+	memory_view_refresh(state, auto_refresh);
 }
 
 static void bytes_to_text(uint64_t nbytes, char *out, size_t out_size) {
@@ -131,57 +366,325 @@ static char const *radio_group_get_selected(State *state, char const *group_name
 	return NULL;
 }
 
-// update the memory maps for the current process (state->maps)
+// get the memory maps of a process with the protection in the "protection" entry,
+// which aren't filtered out by state->region_filter
 // returns true on success
-static bool update_maps(State *state) {
+static bool read_maps(State *state, PID pid, Map **out_maps, unsigned *out_nmaps, Address *out_total_memory) {
 	GtkBuilder *builder = state->builder;
 	char const *desired_protection = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "protection")));
-	free(state->maps); state->maps = NULL;
+	*out_maps = NULL;
+	*out_nmaps = 0;
+	*out_total_memory = 0;
 	
 	char maps_name[64];
-	sprintf(maps_name, "/proc/%lld/maps", (long long)state->pid);
-	FILE *maps_file = fopen(maps_name, "rb");
+	sprintf(maps_name, "/proc/%lld/maps", (long long)pid);
+	FILE *maps_file = source_open_maps(state, pid);
 	if (maps_file) {
-		char line[256];
+		char line[4096 + 256]; // (long enough for any pathname)
 		size_t capacity = 0;
 		while (fgets(line, sizeof line, maps_file))
 			++capacity;
 		rewind(maps_file);
-		Map *maps = state->maps = calloc(capacity, sizeof *maps);
+		Map *maps = *out_maps = calloc(capacity + 1, sizeof *maps);
 		unsigned nmaps = 0;
-		state->total_memory = 0;
+		bool success = false;
 		if (maps) {
 			while (fgets(line, sizeof line, maps_file)) {
 				Address addr_lo, addr_hi;
 				char protections[8];
-				if (sscanf(line, "%" SCNxADDR "-%" SCNxADDR " %8s", &addr_lo, &addr_hi, protections) == 3 && nmaps < capacity) {
-					if (strcmp(protections, desired_protection) == 0) {
+				int pathname_start = 0;
+				// lines look like: lo-hi protection offset device inode pathname
+				if (sscanf(line, "%" SCNxADDR "-%" SCNxADDR " %7s %*s %*s %*s %n", &addr_lo, &addr_hi, protections, &pathname_start) == 3 && nmaps < capacity) {
+					char *pathname = line + pathname_start;
+					pathname[strcspn(pathname, "\n")] = '\0';
+					if (strcmp(protections, desired_protection) == 0
+						&& region_filter_match(&state->region_filter, pathname, addr_hi - addr_lo)) {
 						Map *map = &maps[nmaps++];
 						map->lo = addr_lo;
 						map->size = addr_hi - addr_lo;
-						state->total_memory += map->size;
+						if (strcmp(pathname, "[heap]") == 0)
+							map->kind = MAP_KIND_HEAP;
+						else if (!*pathname)
+							map->kind = MAP_KIND_ANON;
+						else if (strncmp(pathname, "[stack", 6) == 0)
+							map->kind = MAP_KIND_STACK;
+						else if (*pathname == '[')
+							map->kind = MAP_KIND_SPECIAL;
+						else
+							map->kind = MAP_KIND_FILE;
+						*out_total_memory += map->size;
 					}
 				}
 			}
-			state->nmaps = nmaps;
-			return true;
+			*out_nmaps = nmaps;
+			success = true;
 		} else {
 			display_error(state, "Not enough memory to hold map metadata (%zu items)", capacity);
 		}
+		fclose(maps_file);
+		return success;
 	} else {
 		display_error(state, "Couldn't open %s: %s", maps_name, strerror(errno));
 	}
 	return false;
 }
 
+// find the pathnames of proc's maps (see Process.map_names).
+// maps which aren't there anymore (e.g. the session is from an earlier run of the process) don't get names.
+static void process_read_map_names(State *state, Process *proc) {
+	FILE *maps_file = source_open_maps(state, proc->pid);
+	if (!maps_file) return;
+	char **names = calloc(proc->nmaps + 1, sizeof *names);
+	if (names) {
+		char line[4096 + 256];
+		unsigned m = 0;
+		while (fgets(line, sizeof line, maps_file)) {
+			Address addr_lo, addr_hi;
+			int pathname_start = 0;
+			if (sscanf(line, "%" SCNxADDR "-%" SCNxADDR " %*s %*s %*s %*s %n", &addr_lo, &addr_hi, &pathname_start) != 2)
+				continue;
+			// (the lines and proc->maps are both in order of address)
+			while (m < proc->nmaps && proc->maps[m].lo < addr_lo)
+				++m;
+			if (m < proc->nmaps && proc->maps[m].lo == addr_lo && proc->maps[m].size == addr_hi - addr_lo) {
+				char *pathname = line + pathname_start;
+				pathname[strcspn(pathname, "\n")] = '\0';
+				names[m] = strdup(pathname);
+			}
+		}
+		proc->map_names = names;
+	}
+	fclose(maps_file);
+}
+
+// update the memory maps for the current process (state->maps), and state->all_total_memory
+// returns true on success
+static bool update_maps(State *state) {
+	free(state->maps); state->maps = NULL;
+	if (!read_maps(state, state->pid, &state->maps, &state->nmaps, &state->total_memory))
+		return false;
+	state->all_total_memory = state->total_memory;
+	for (unsigned i = 1; i < state->n_pids; ++i) {
+		Map *maps = NULL;
+		unsigned nmaps = 0;
+		Address total_memory = 0;
+		if (read_maps(state, state->pids[i], &maps, &nmaps, &total_memory))
+			state->all_total_memory += total_memory;
+		free(maps);
+	}
+	return true;
+}
+
+// the search process and map shown in a row of the regions view.
+// returns false if the process isn't being searched anymore.
+static bool regions_row_map(State *state, GtkTreeModel *tree_model, GtkTreeIter *iter, Process **out_proc, unsigned *out_m) {
+	gchararray pid_str = NULL, addr_str = NULL;
+	gtk_tree_model_get(tree_model, iter, 0, &pid_str, 1, &addr_str, -1);
+	Process *proc = process_find(state, pid_str ? (PID)atoll(pid_str) : 0);
+	Address lo = addr_str ? (Address)strtoull(addr_str, NULL, 16) : 0;
+	g_free(pid_str);
+	g_free(addr_str);
+	if (!proc) return false;
+	unsigned m = process_find_map(proc, lo);
+	if (m >= proc->nmaps) return false;
+	*out_proc = proc;
+	*out_m = m;
+	return true;
+}
+
+// the text for the candidates and density columns of the regions view, and the color of the density
+// (redder for denser maps, with the densest one being the reddest). color is empty if there are no candidates.
+static void region_describe(Address count, Address positions, double max_density,
+	char *count_text, char *density_text, char *color) {
+	double density = positions ? (double)count / (double)positions : 0;
+	sprintf(count_text, "%llu", (unsigned long long)count);
+	sprintf(density_text, "%.3g%%", density * 100);
+	*color = '\0';
+	if (count && max_density > 0) {
+		int other = 255 - (int)(density / max_density * 160);
+		if (other < 95) other = 95;
+		sprintf(color, "#ff%02x%02x", other, other);
+	}
+}
+
+// show how many candidates (of the type being shown) there are in each map, to see where they are.
+// while a step is running, the rows stay the same, and just their counts are updated.
+static void update_regions(State *state) {
+	GtkBuilder *builder = state->builder;
+	GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "regions"));
+	GtkTreeModel *tree_model = GTK_TREE_MODEL(store);
+	DataType type = state->data_type;
+	SearchPass *pass = state->search_pass;
+	if (!pass)
+		gtk_list_store_clear(store);
+	if (!state->searching || !searching_for(state, type)) return;
+	size_t stride = search_stride(state, type);
+	char const *protection = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "protection")));
+	// (the counts are being changed by the step's threads)
+	if (pass) g_mutex_lock(&pass->mutex);
+	// the densest map gets the reddest color
+	double max_density = 0;
+	for (unsigned p = 0; p < state->n_processes; ++p) {
+		Process const *proc = &state->processes[p];
+		Address const *counts = proc->map_candidates[type];
+		for (unsigned m = 0; counts && m < proc->nmaps; ++m) {
+			double density = (double)counts[m] / (double)(proc->maps[m].size / stride);
+			if (density > max_density) max_density = density;
+		}
+	}
+	char count_text[32], density_text[32], color[16];
+	if (pass) {
+		GtkTreeIter iter;
+		if (gtk_tree_model_get_iter_first(tree_model, &iter)) {
+			do {
+				Process *proc;
+				unsigned m;
+				if (regions_row_map(state, tree_model, &iter, &proc, &m) && proc->map_candidates[type]) {
+					region_describe(proc->map_candidates[type][m], proc->maps[m].size / stride, max_density,
+						count_text, density_text, color);
+					gtk_list_store_set(store, &iter, 5, count_text, 6, density_text, 7, *color ? color : NULL, -1);
+				}
+			} while (gtk_tree_model_iter_next(tree_model, &iter));
+		}
+	} else {
+		for (unsigned p = 0; p < state->n_processes; ++p) {
+			Process const *proc = &state->processes[p];
+			Address const *counts = proc->map_candidates[type];
+			if (!counts) continue;
+			char pid_str[32];
+			sprintf(pid_str, "%lld", (long long)proc->pid);
+			for (unsigned m = 0; m < proc->nmaps; ++m) {
+				if (!counts[m]) continue;
+				Map const *map = &proc->maps[m];
+				char addr_str[32], size_text[32];
+				sprintf(addr_str, "%" PRIxADDR, map->lo);
+				bytes_to_text(map->size, size_text, sizeof size_text);
+				char const *pathname = proc->map_names && proc->map_names[m] ? proc->map_names[m] : "";
+				region_describe(counts[m], map->size / stride, max_density, count_text, density_text, color);
+				gtk_list_store_insert_with_values(store, NULL, -1, 0, pid_str, 1, addr_str, 2, size_text,
+					3, protection, 4, pathname, 5, count_text, 6, density_text, 7, color, -1);
+			}
+		}
+	}
+	if (pass) g_mutex_unlock(&pass->mutex);
+}
+
+// show how the memory activity profile is going, and the regions which have changed the most
+static void update_profile(State *state) {
+	GtkBuilder *builder = state->builder;
+	GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "profile-regions"));
+	GtkLabel *status = GTK_LABEL(gtk_builder_get_object(builder, "profile-status"));
+	GtkLabel *histogram_label = GTK_LABEL(gtk_builder_get_object(builder, "profile-histogram"));
+	gtk_list_store_clear(store);
+	Profile *profile = state->profile;
+	if (!profile) {
+		gtk_label_set_text(status, "");
+		gtk_label_set_text(histogram_label, "");
+		return;
+	}
+	Address histogram[PROFILE_BUCKETS + 1];
+	ProfileRegion *regions = NULL;
+	unsigned n_regions = profile_summarize(profile, histogram, &regions);
+	char text[512];
+	profile_status(profile, histogram, text, sizeof text);
+	gtk_label_set_text(status, text);
+	snprintf(text, sizeof text, "Pages which never changed: %" PRIdADDR "\n"
+		"Changed in up to 10%% of samples: %" PRIdADDR "\n"
+		"Changed in up to half of them: %" PRIdADDR "\n"
+		"Changed in more than half: %" PRIdADDR,
+		histogram[0], histogram[1], histogram[2], histogram[3]);
+	gtk_label_set_text(histogram_label, text);
+	Process const *proc = &profile->proc;
+	// the most active region gets the reddest color (see region_describe)
+	double max_activity = n_regions ? regions[0].activity : 0;
+	for (unsigned i = 0; i < n_regions && i < PROFILE_MAX_ROWS; ++i) {
+		ProfileRegion const *region = &regions[i];
+		Map const *map = &proc->maps[region->map];
+		char addr_str[32], size_text[32], pages_text[64], activity_text[32], color[16] = {0};
+		sprintf(addr_str, "%" PRIxADDR, map->lo);
+		bytes_to_text(map->size, size_text, sizeof size_text);
+		sprintf(pages_text, "%" PRIdADDR " of %" PRIdADDR, region->pages_changed, map->size / 4096);
+		sprintf(activity_text, "%.3g", region->activity);
+		if (max_activity > 0) {
+			int other = 255 - (int)(region->activity / max_activity * 160);
+			if (other < 95) other = 95;
+			sprintf(color, "#ff%02x%02x", other, other);
+		}
+		char const *pathname = proc->map_names && proc->map_names[region->map] ? proc->map_names[region->map] : "";
+		gtk_list_store_insert_with_values(store, NULL, -1, 0, addr_str, 1, size_text, 2, pathname,
+			3, pages_text, 4, activity_text, 5, color, -1);
+	}
+	free(regions);
+}
+
+// set the text of the candidates-left label, etc.
+static void show_candidates_left(State *state) {
+	GtkBuilder *builder = state->builder;
+	{
+		GtkLabel *ncandidates_label = GTK_LABEL(gtk_builder_get_object(builder, "candidates-left"));
+		char text[32];
+		sprintf(text, "%llu", (unsigned long long)state->n_candidates[state->data_type]);
+		gtk_label_set_text(ncandidates_label, text);
+	}
+	// show the number of candidates for each type next to its button
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+		DataType type = (DataType)t;
+		char id[32];
+		sprintf(id, "type-%s", data_type_name(type));
+		GtkButton *button = GTK_BUTTON(gtk_builder_get_object(builder, id));
+		char label[128];
+		snprintf(label, sizeof label, "%s", gtk_button_get_label(button));
+		char *count = strstr(label, " (");
+		if (count) *count = '\0';
+		if (state->searching && searching_for(state, type)) {
+			size_t len = strlen(label);
+			snprintf(label + len, sizeof label - len, " (%llu)", (unsigned long long)state->n_candidates[type]);
+		}
+		gtk_button_set_label(button, label);
+		// you can switch between the types being searched for
+		gtk_widget_set_sensitive(GTK_WIDGET(button), !state->searching || searching_for(state, type));
+	}
+	update_regions(state);
+}
+
+static void update_candidates(State *state) {
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+		DataType type = (DataType)t;
+		Address total = 0;
+		for (unsigned p = 0; p < state->n_processes; ++p) {
+			Process *proc = &state->processes[p];
+			proc->n_candidates[type] = process_count_candidates(state, proc, type);
+			total += proc->n_candidates[type];
+		}
+		state->n_candidates[type] = total;
+	}
+	show_candidates_left(state);
+}
+
+
 G_MODULE_EXPORT void update_configuration(GtkWidget *_widget, gpointer user_data) {
 	State *state = user_data;
 	GtkBuilder *builder = state->builder;
 	
 	static char prev_protection[5] = "rw-p";
 	char const *protection = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "protection")));
+	static char prev_region_filter[256];
+	char const *region_filter = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "region-filter")));
+	bool maps_changed = false;
 	if (strcmp(protection, prev_protection) != 0) {
 		strcpy(prev_protection, protection);
+		maps_changed = true;
+	}
+	if (strcmp(region_filter, prev_region_filter) != 0) {
+		snprintf(prev_region_filter, sizeof prev_region_filter, "%s", region_filter);
+		// (this is updated as it's typed, so just keep the last valid filter until it's valid again)
+		RegionFilter filter;
+		if (region_filter_parse(region_filter, &filter)) {
+			state->region_filter = filter;
+			maps_changed = true;
+		}
+	}
+	if (maps_changed && state->pid && !state->searching) {
 		if (update_maps(state)) {
 			if (state->nmaps) {
 				GtkEntry *address_entry = GTK_ENTRY(gtk_builder_get_object(builder, "address"));
@@ -195,6 +698,12 @@ G_MODULE_EXPORT void update_configuration(GtkWidget *_widget, gpointer user_data
 	
 	state->stop_while_accessing_memory = gtk_toggle_button_get_active(
 		GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "stop-while-accessing-memory")));
+	state->snapshot_memory = gtk_toggle_button_get_active(
+		GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "snapshot-memory")));
+	state->skip_unchanged_pages = gtk_toggle_button_get_active(
+		GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "skip-unchanged-pages")));
+	// (this only makes a difference if the process is being stopped)
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "snapshot-memory")), state->stop_while_accessing_memory);
 	char const *n_items_text = gtk_entry_get_text(
 		GTK_ENTRY(gtk_builder_get_object(builder, "memory-n-items")));
 	char *endp;
@@ -209,6 +718,17 @@ G_MODULE_EXPORT void update_configuration(GtkWidget *_widget, gpointer user_data
 	char const *data_type_str = radio_group_get_selected(state, "type-u8");
 	DataType data_type = data_type_from_name(data_type_str);
 	
+	// (like the region filter, the last valid layout is kept while a new one is being typed)
+	bool layout_changed = false;
+	{
+		Layout layout;
+		if (layout_parse(gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "layout"))), &layout)
+			&& memcmp(&layout, &state->layout, sizeof layout) != 0) {
+			state->layout = layout;
+			layout_changed = true;
+		}
+	}
+	
 	// update memory/disk estimates for search
 	GtkLabel *memory_label = GTK_LABEL(gtk_builder_get_object(builder, "required-memory"));
 	GtkLabel *disk_label   = GTK_LABEL(gtk_builder_get_object(builder, "required-disk"));
@@ -216,10 +736,22 @@ G_MODULE_EXPORT void update_configuration(GtkWidget *_widget, gpointer user_data
 	SearchType search_type = search_type_from_str(search_type_str);
 	state->search_type = search_type;
 	if (state->pid) {
-		size_t item_size = data_type_size(data_type);
-		Address total_memory = state->total_memory;
-		Address total_items = total_memory / item_size;
-		Address memory_usage = total_items / 8; // 1 bit per item
+		bool unaligned = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "unaligned")));
+		bool all_types = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "all-types")));
+		Address total_memory = state->all_total_memory;
+		Address memory_usage = 0;
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+			DataType type = (DataType)t;
+			if (all_types ? !data_type_is_string(type) : type == data_type) {
+				size_t stride = unaligned ? 1 : data_type_size(type);
+				Address total_positions = total_memory / stride;
+				memory_usage += total_positions / 8; // up to 1 bit per position (see Bitset)
+			}
+		}
+		if (state->stop_while_accessing_memory && state->snapshot_memory) {
+			// at worst, we need a copy of all of memory
+			memory_usage += total_memory;
+		}
 		{
 			char text[32];
 			bytes_to_text(memory_usage, text, sizeof text);
@@ -246,18 +778,19 @@ G_MODULE_EXPORT void update_configuration(GtkWidget *_widget, gpointer user_data
 		gtk_label_set_text(disk_label,   "N/A");
 	}
 	
-	static bool prev_candidates;
+	static bool prev_searching;
 	static PID prev_pid;
 	
-	uint64_t *search_candidates = state->search_candidates;
-	if (n_items != state->memory_view_n_items || (!!search_candidates) != prev_candidates || address != state->memory_view_address || data_type != state->data_type || state->pid != prev_pid) {
+	if (n_items != state->memory_view_n_items || state->searching != prev_searching || address != state->memory_view_address || data_type != state->data_type || state->pid != prev_pid || layout_changed) {
 		// we need to update the addresses in the memory view.
-		prev_candidates = !!search_candidates;
+		prev_searching = state->searching;
 		state->memory_view_n_items = n_items;
 		state->memory_view_address = address;
 		state->data_type = data_type;
 		prev_pid = state->pid;
 		
+		if (state->searching)
+			show_candidates_left(state);
 		update_memory_view(state, true);
 	}
 	
@@ -267,63 +800,174 @@ G_MODULE_EXPORT void set_all(GtkWidget *_widget, gpointer user_data) {
 	State *state = user_data;
 	GtkBuilder *builder = state->builder;
 	GtkEntry *value_entry = GTK_ENTRY(gtk_builder_get_object(builder, "set-all-value"));
-	uint64_t value = 0;
-	DataType data_type = state->data_type;
-	size_t item_size = data_type_size(data_type);
-	// parse the value
-	if (data_from_str(gtk_entry_get_text(value_entry), data_type, &value)) {
+	char const *value_text = gtk_entry_get_text(value_entry);
+	// parse the value (with a layout, the rows have different types -- rows whose type the value isn't valid for are skipped)
+	uint64_t values[DATA_TYPE_COUNT] = {0};
+	bool valid[DATA_TYPE_COUNT] = {0};
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+		valid[t] = data_from_str(value_text, (DataType)t, &values[t]);
+	if (valid[state->data_type] || memory_view_showing_layout(state)) {
 		GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "memory"));
 		GtkTreeModel *tree_model = GTK_TREE_MODEL(store);
 		GtkTreeIter iter;
-		if (gtk_tree_model_get_iter_first(tree_model, &iter)) {
-			int writer = memory_writer_open(state);
-			if (writer) {
-				do { // for each row in the memory view,
-					// extract address
-					gchararray addr_str;
-					gtk_tree_model_get(GTK_TREE_MODEL(store), &iter, 1, &addr_str, -1);
-					Address addr = (Address)strtoull(addr_str, NULL, 16);
-					g_free(addr_str);
-					// set memory to value
-					memory_write_bytes(writer, addr, (uint8_t const *)&value, item_size);
-				} while (gtk_tree_model_iter_next(tree_model, &iter));
-				memory_writer_close(state, writer);
-			}
+		JournalBatch batch;
+		if (gtk_tree_model_get_iter_first(tree_model, &iter) && journal_begin(state, &batch, "set all")) {
+			do { // for each row in the memory view,
+				PID pid = memory_view_row_pid(state, tree_model, &iter);
+				DataType type = memory_view_row_type(state, tree_model, &iter);
+				if (!valid[type]) continue;
+				// extract address
+				gchararray addr_str;
+				gtk_tree_model_get(GTK_TREE_MODEL(store), &iter, 1, &addr_str, -1);
+				Address addr = (Address)strtoull(addr_str, NULL, 16);
+				g_free(addr_str);
+				// set memory to value
+				journal_add(state, &batch, pid, addr, &values[type], data_type_size(type));
+			} while (gtk_tree_model_iter_next(tree_model, &iter));
+			journal_end(state, &batch);
 		}
 	}
 }
 
 
 // the user entered a PID.
+// get argv[0] for a process, which should be its name. returns false if the process doesn't exist.
+static bool process_name(PID pid, char *out, size_t out_size) {
+	if (pid < 0) return source_name(pid, out, out_size);
+	char dirname[64];
+	sprintf(dirname, "/proc/%lld", (long long)pid);
+	memset(out, 0, out_size);
+	int dir = open(dirname, O_DIRECTORY|O_RDONLY);
+	if (dir == -1) return false;
+	int cmdline = openat(dir, "cmdline", O_RDONLY);
+	if (cmdline != -1) {
+		// the contents of cmdline, up to the first null byte is argv[0],
+		// which should be the name of the process
+		read(cmdline, out, out_size - 1);
+		close(cmdline);
+	}
+	close(dir);
+	return true;
+}
+
+// find every process whose name (or argv[0] without the directory) is name, like pidof.
+// returns the number of processes found; *pids should be freed.
+static unsigned find_processes_named(char const *name, PID **pids) {
+	*pids = NULL;
+	unsigned n = 0, capacity = 0;
+	DIR *proc = opendir("/proc");
+	if (!proc) return 0;
+	struct dirent *entry;
+	while ((entry = readdir(proc))) {
+		char *end;
+		long long pid = strtoll(entry->d_name, &end, 10);
+		if (*end || pid <= 0) continue;
+		char argv0[256], comm[64] = {0};
+		if (!process_name((PID)pid, argv0, sizeof argv0)) continue;
+		char const *base = strrchr(argv0, '/');
+		base = base ? base + 1 : argv0;
+		char comm_name[64];
+		sprintf(comm_name, "/proc/%lld/comm", pid);
+		FILE *comm_file = fopen(comm_name, "rb");
+		if (comm_file) {
+			if (fgets(comm, sizeof comm, comm_file))
+				comm[strcspn(comm, "\n")] = '\0';
+			fclose(comm_file);
+		}
+		if (strcmp(argv0, name) == 0 || strcmp(base, name) == 0 || strcmp(comm, name) == 0) {
+			if (n >= capacity) {
+				capacity = capacity * 2 + 16;
+				PID *new_pids = realloc(*pids, capacity * sizeof *new_pids);
+				if (!new_pids) break;
+				*pids = new_pids;
+			}
+			(*pids)[n++] = (PID)pid;
+		}
+	}
+	closedir(proc);
+	return n;
+}
+
+static int pid_cmp(void const *av, void const *bv) {
+	PID a = *(PID const *)av, b = *(PID const *)bv;
+	return a < b ? -1 : a > b;
+}
+
+// the user entered a PID, a list of PIDs (e.g. "1234, 1240"), or the name of a process
+// (in which case all processes with that name are selected), or the path to a memory file or core dump.
 G_MODULE_EXPORT void select_pid(GtkButton *_button, gpointer user_data) {
 	State *state = user_data;
 	GtkBuilder *builder = state->builder;
 	GtkEntry *pid = GTK_ENTRY(gtk_builder_get_object(builder, "pid"));
 	char const *pid_text = gtk_entry_get_text(pid);
-	char *end;
-	long long pid_number = strtoll(pid_text, &end, 10);
-	if (*pid_text != '\0' && *end == '\0') {
-		char dirname[64];
-		sprintf(dirname, "/proc/%lld", pid_number);
-		int dir = open(dirname, O_DIRECTORY|O_RDONLY);
-		if (dir == -1) {
-			display_error(state, "Error opening %s: %s", dirname, strerror(errno));
-		} else {
-			int cmdline = openat(dir, "cmdline", O_RDONLY);
-			char process_name[64] = {0};
-			if (cmdline != -1) {
-				// the contents of cmdline, up to the first null byte is argv[0],
-				// which should be the name of the process
-				read(cmdline, process_name, sizeof process_name - 1);	
-				close(cmdline);
+	PID *pids = calloc(strlen(pid_text) / 2 + 1, sizeof *pids);
+	unsigned n_pids = 0;
+	if (!pids) return;
+	bool numbers = true;
+	for (char const *p = pid_text; *p; ) {
+		if (*p == ',' || isspace((unsigned char)*p)) {
+			++p;
+			continue;
+		}
+		char *end;
+		long long pid_number = strtoll(p, &end, 10);
+		if (end == p || (*end && *end != ',' && !isspace((unsigned char)*end))) {
+			numbers = false;
+			break;
+		}
+		pids[n_pids++] = (PID)pid_number;
+		p = end;
+	}
+	if (!numbers && strchr(pid_text, '/')) {
+		// search a memory file or core dump instead of a running process
+		PID source = source_open(state, pid_text);
+		if (!source) {
+			free(pids);
+			return;
+		}
+		pids[0] = source;
+		n_pids = 1;
+	} else if (!numbers) {
+		free(pids);
+		n_pids = find_processes_named(pid_text, &pids);
+		if (!n_pids) {
+			display_error(state, "No processes named %s were found.", pid_text);
+			free(pids);
+			return;
+		}
+		qsort(pids, n_pids, sizeof *pids, pid_cmp);
+	}
+	if (n_pids) {
+		char process_name_text[64] = {0};
+		for (unsigned i = 0; i < n_pids; ++i) {
+			char name[64];
+			if (!process_name(pids[i], name, sizeof name)) {
+				display_error(state, "Error opening /proc/%lld: %s", (long long)pids[i], strerror(errno));
+				free(pids);
+				return;
 			}
-			if (*process_name == '\0') { // handles unable to open/unable to read/empty cmdline
-				strcpy(process_name, "Unknown process.");
+			if (i == 0) strcpy(process_name_text, name);
+		}
+		{
+			if (*process_name_text == '\0') { // handles unable to open/unable to read/empty cmdline
+				strcpy(process_name_text, "Unknown process.");
 			}
+			char label[128];
+			if (n_pids > 1)
+				snprintf(label, sizeof label, "%s (and %u other processes)", process_name_text, n_pids - 1);
+			else
+				snprintf(label, sizeof label, "%s", process_name_text);
 			GtkLabel *process_name_label = GTK_LABEL(gtk_builder_get_object(builder, "process-name"));
-			gtk_label_set_text(process_name_label, process_name);
-			state->pid = (PID)pid_number;
-			close(dir);
+			gtk_label_set_text(process_name_label, label);
+			memory_view_readers_close(state);
+			journal_clear(state); // (the writes were to the old processes)
+			profile_stop(state);
+			update_profile(state);
+			free(state->pids);
+			state->pids = pids;
+			state->n_pids = n_pids;
+			state->pid = pids[0];
+			source_close_unused(state);
 			if (update_maps(state)) {
 				if (state->nmaps) {
 					GtkEntry *address_entry = GTK_ENTRY(gtk_builder_get_object(builder, "address"));
@@ -338,6 +982,8 @@ G_MODULE_EXPORT void select_pid(GtkButton *_button, gpointer user_data) {
 				gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-box")));
 			}
 		}
+	} else {
+		free(pids);
 	}
 }
 
@@ -345,36 +991,38 @@ G_MODULE_EXPORT void select_pid(GtkButton *_button, gpointer user_data) {
 G_MODULE_EXPORT void memory_edited(GtkCellRendererText *_renderer, char *path, char *new_text, gpointer user_data) {
 	State *state = user_data;
 	GtkBuilder *builder = state->builder;
-	DataType data_type = state->data_type;
-	size_t item_size = data_type_size(data_type);
 	GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "memory"));
 	GtkTreeIter iter;
 	gtk_tree_model_get_iter_from_string(GTK_TREE_MODEL(store), &iter, path);
+	DataType data_type = memory_view_row_type(state, GTK_TREE_MODEL(store), &iter);
+	size_t item_size = data_type_size(data_type);
 	gchararray addr_str;
 	// get address from store
 	gtk_tree_model_get(GTK_TREE_MODEL(store), &iter, 1, &addr_str, -1);
 	Address addr = strtoull(addr_str, NULL, 16);
 	g_free(addr_str);
+	PID pid = memory_view_row_pid(state, GTK_TREE_MODEL(store), &iter);
 	state->editing_memory = -1;
 	uint64_t value = 0;
-	if (data_from_str(new_text, data_type, &value)) {
-		int writer = memory_writer_open(state);
-		if (writer) {
-			// write the value
-			bool success = memory_write_bytes(writer, addr, (uint8_t const *)&value, item_size) == item_size;
-			memory_writer_close(state, writer);
-			if (success) {
-				char value_str[32];
-				// convert back to a string (so new_text = "0.10" becomes value_str = "0.1", etc.)
-				data_to_str(&value, data_type, value_str, sizeof value_str);
-				gtk_list_store_set(store, &iter, 2, value_str, -1);
-				
-			}
-			
+	JournalBatch batch;
+	if (data_from_str(new_text, data_type, &value) && journal_begin(state, &batch, "editing a value")) {
+		// write the value
+		journal_add(state, &batch, pid, addr, &value, item_size);
+		if (journal_end(state, &batch)) {
+			char value_str[32];
+			// convert back to a string (so new_text = "0.10" becomes value_str = "0.1", etc.)
+			data_to_str(&value, data_type, value_str, sizeof value_str);
+			gtk_list_store_set(store, &iter, 2, value_str, -1);
 		}
 	}
 }
 
+G_MODULE_EXPORT void memory_undo(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	journal_undo(state);
+	memory_view_refresh(state, false);
+}
+
 G_MODULE_EXPORT void refresh_memory(GtkWidget *_widget, gpointer user_data) {
 	State *state = user_data;
 	update_configuration(NULL, state); // just in case they changed the number of items or something
@@ -391,31 +1039,20 @@ G_MODULE_EXPORT void memory_editing_canceled(GtkCellRenderer *_renderer, gpointe
 	state->editing_memory = -1;
 }
 
-static void update_candidates(State *state) {
-	GtkBuilder *builder = state->builder;
-	uint64_t *candidates = state->search_candidates;
-	size_t item_size = data_type_size(state->data_type);
-	Address entries = state->total_memory / (64 * item_size);
-	Address ncandidates = 0;
-	for (Address i = 0; i < entries; ++i) {
-		ncandidates += (unsigned)__builtin_popcountll(candidates[i]);
-	}
-	{
-		GtkLabel *ncandidates_label = GTK_LABEL(gtk_builder_get_object(builder, "candidates-left"));
-		char text[32];
-		sprintf(text, "%llu", (unsigned long long)ncandidates);
-		gtk_label_set_text(ncandidates_label, text);
-	}
-}
-
-
 G_MODULE_EXPORT void memory_view_key_press(GtkWidget *widget, GdkEvent *event, gpointer user_data) {
 	State *state = user_data;
 	GtkBuilder *builder = state->builder;
 	GdkEventKey *key_event = (GdkEventKey *)event;
-	if (key_event->keyval == GDK_KEY_Delete) {
-		uint64_t *search_candidates = state->search_candidates;
-		if (search_candidates && !state->memory_view_address) {
+	if (state->search_pass) return; // the candidates are being changed on other threads
+	if (key_event->keyval == GDK_KEY_z && (key_event->state & GDK_CONTROL_MASK)) {
+		memory_undo(NULL, state);
+	} else if (key_event->keyval == GDK_KEY_Delete) {
+		if (searching_for(state, state->data_type) && !state->memory_view_address) {
+			if (state->export) {
+				// (the export thread is reading the candidates)
+				display_error_nofmt(state, "Wait for the export to finish first.");
+				return;
+			}
 			// allow deleting candidates with the delete key
 			GtkTreeView *tree_view = GTK_TREE_VIEW(widget);
 			GtkTreeModel *tree_model = GTK_TREE_MODEL(gtk_builder_get_object(builder, "memory"));
@@ -430,89 +1067,486 @@ G_MODULE_EXPORT void memory_view_key_press(GtkWidget *widget, GdkEvent *event, g
 					gtk_tree_model_get(tree_model, &iter, 1, &addr_str, -1);
 					Address addr = (Address)strtoull(addr_str, NULL, 16);
 					g_free(addr_str);
+					Process *proc = process_find(state, memory_view_row_pid(state, tree_model, &iter));
 					gtk_list_store_remove(list_store, &iter);
+					if (!proc) continue;
 					Address bitset_idx = 0;
-					size_t item_size = data_type_size(state->data_type);
+					size_t stride = search_stride(state, state->data_type);
 					bool removed = false;
-					for (unsigned m = 0; m < state->nmaps; ++m) {
-						Map *map = &state->maps[m];
+					for (unsigned m = 0; m < proc->nmaps; ++m) {
+						Map *map = &proc->maps[m];
 						if (addr >= map->lo && addr < map->lo + map->size) {
-							bitset_idx += (addr - map->lo) / item_size;
+							bitset_idx += (addr - map->lo) / stride;
 							// remove this candidate
-							search_candidates[bitset_idx / 64] &= ~MASK64(bitset_idx % 64);
+							Bitset *candidates = proc->search_candidates[state->data_type];
+							Address *counts = proc->map_candidates[state->data_type];
+							if (bitset_get(candidates, bitset_idx)) {
+								bitset_clear(candidates, bitset_idx);
+								if (counts && !bitset_get(candidates, bitset_idx))
+									--counts[m];
+							}
 							removed = true;
 							break;
 						} else {
-							bitset_idx += map->size / item_size;
+							bitset_idx += map->size / stride;
 						}
 					}
 					(void)removed; assert(removed);
 				}
 			}
 			g_list_free_full(selected_rows, (GDestroyNotify)gtk_tree_path_free);
+			free(state->view_rows); state->view_rows = NULL;
 			update_candidates(state);
 		}
 	}
 }
 
 
+G_MODULE_EXPORT void search_stop(GtkWidget *_widget, gpointer user_data);
+
+// switch the UI over to searching (state->search_type, etc. should already be set)
+static void search_show(State *state, bool multiple_types, long steps_completed) {
+	GtkBuilder *builder = state->builder;
+	state->searching = true;
+	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "pre-search")));
+	// when searching for multiple types, you can switch between them.
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "data-type-box")), multiple_types);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "protection")), 0);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "region-filter")), 0);
+	gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-common")));
+	gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "save-search-candidates")));
+	gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "save-session")));
+	gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "export-buttons")));
+	gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "regions-box")));
+	{
+		char text[32];
+		sprintf(text, "%ld", steps_completed);
+		gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(builder, "steps-completed")), text);
+	}
+	gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(builder, "address")), "");
+	switch (state->search_type) {
+	case SEARCH_ENTER_VALUE:
+		gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-enter-value")));
+		break;
+	case SEARCH_SAME_DIFFERENT:
+		gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-same-different")));
+		break;
+	}
+}
+
+// figure out how much of the processes' memory to read at once (see read_tuning_calibrate)
+static void search_calibrate(State *state) {
+	Process const *proc = &state->processes[0];
+	int reader = memory_reader_open(state, proc->pid);
+	if (reader) {
+		read_tuning_calibrate(state, reader, proc->maps, proc->nmaps);
+		memory_reader_close(state, proc->pid, reader);
+	}
+}
+
 G_MODULE_EXPORT void search_start(GtkWidget *_widget, gpointer user_data) {
 	State *state = user_data;
+	char const *region_filter = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(state->builder, "region-filter")));
+	if (!region_filter_parse(region_filter, &state->region_filter)) {
+		display_error(state, "Bad region filter: %s (it should look like anon -*libc* >=64K).", region_filter);
+		return;
+	}
 	if (update_maps(state)) {
 		GtkBuilder *builder = state->builder;
 		SearchType search_type = state->search_type;
 		DataType data_type = state->data_type;
-		size_t item_size = data_type_size(data_type);
-		// state->total_memory should always be a multiple of the page size, which is definitely a multiple of 64 * 8 = 512.
-		assert(state->total_memory % 512 == 0);
-		uint64_t *candidates = state->search_candidates = malloc(state->total_memory / (8 * item_size));
-		if (candidates) {
-			gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "pre-search")));
-			gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "data-type-box")), 0);
-			gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "protection")), 0);
-			gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-common")));
-			gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "save-search-candidates")));
-			gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(builder, "steps-completed")), "0");
-			gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(builder, "address")), "");
-			memset(candidates, 0xff, state->total_memory / (8 * item_size));
+		state->search_unaligned = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "unaligned")));
+		// search for every numeric type at once?
+		bool all_types = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "all-types")));
+		bool success = true, out_of_memory = false;
+		state->processes = calloc(state->n_pids, sizeof *state->processes);
+		if (state->processes) {
+			state->n_processes = state->n_pids;
+		} else {
+			success = false;
+			out_of_memory = true;
+		}
+		for (unsigned p = 0; success && p < state->n_processes; ++p) {
+			Process *proc = &state->processes[p];
+			proc->pid = state->pids[p];
+			if (!read_maps(state, proc->pid, &proc->maps, &proc->nmaps, &proc->total_memory)) {
+				success = false;
+				break;
+			}
+			// proc->total_memory should always be a multiple of the page size, which is definitely a multiple of 64 * 8 = 512.
+			assert(proc->total_memory % 512 == 0);
+			process_read_map_names(state, proc);
+			for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+				DataType type = (DataType)t;
+				if (all_types ? !data_type_is_string(type) : type == data_type) {
+					// everything starts out as a candidate
+					proc->search_candidates[type] = bitset_new(proc->total_memory / search_stride(state, type), true);
+					if (!proc->search_candidates[type]) {
+						success = false;
+						out_of_memory = true;
+					}
+				}
+			}
+		}
+		
+		if (success) {
+			search_calibrate(state);
+			search_show(state, all_types, 0);
 			switch (search_type) {
 			case SEARCH_ENTER_VALUE:
-				gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-enter-value")));
 				break;
 			case SEARCH_SAME_DIFFERENT: {
-				gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-same-different")));
-				FILE *prev_mem = tmpfile();
-				if (prev_mem) {
-					state->prev_memory = prev_mem;
-					// write memory to file
-					int reader = memory_reader_open(state);
-					if (reader) {
-						for (unsigned m = 0; m < state->nmaps; ++m) {
-							Map *map = &state->maps[m];
-							Address map_size = map->size;
-							uint8_t block[4096] = {0};
-							Address bytes_left = map_size;
-							while (bytes_left > 0) {
-								Address bytes_read = memory_read_bytes(reader, map->lo + (map_size - bytes_left), block, sizeof block);
-								if (bytes_read < sizeof block) break;
-								fwrite(block, 1, (size_t)bytes_read, prev_mem);
-								bytes_left -= bytes_read;
+				size_t block_size = read_tuning(state).run_max;
+				uint8_t *block = malloc(block_size);
+				if (!block) {
+					display_error_nofmt(state, "Not enough memory available for search.");
+					break;
+				}
+				for (unsigned p = 0; p < state->n_processes; ++p) {
+					Process *proc = &state->processes[p];
+					FILE *prev_mem = tmpfile();
+					if (prev_mem) {
+						proc->prev_memory = prev_mem;
+						// write memory to file
+						int reader = memory_reader_open(state, proc->pid);
+						if (reader) {
+							for (unsigned m = 0; m < proc->nmaps; ++m) {
+								Map *map = &proc->maps[m];
+								Address map_size = map->size;
+								for (Address offset = 0; offset < map_size; offset += block_size) {
+									size_t nbytes = block_size;
+									if (nbytes > map_size - offset) nbytes = (size_t)(map_size - offset);
+									// (if we can't read the memory, it's treated as 0)
+									memory_read_zeroed(reader, map->lo + offset, block, nbytes);
+									fwrite(block, 1, nbytes, prev_mem);
+								}
 							}
+							memory_reader_close(state, proc->pid, reader);
 						}
-						memory_reader_close(state, reader);
+					} else {
+						display_error_nofmt(state, "Couldn't create temporary file.");
+						break;
 					}
-				} else {
-					display_error_nofmt(state, "Couldn't create temporary file.");
 				}
+				free(block);
 			} break;
 			}
+			if (all_types && data_type_is_string(data_type)) {
+				// view the candidates for one of the types we're actually searching for
+				gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "type-s32")), 1);
+			}
 			update_configuration(NULL, state);
 			update_candidates(state);
 		} else {
-			display_error_nofmt(state, "Not enough memory available for search.");
+			if (out_of_memory)
+				display_error_nofmt(state, "Not enough memory available for search.");
+			search_stop(NULL, state);
+		}
+	}
+	
+}
+
+static void search_process(SearchJob *job) {
+	SearchPass *pass = job->pass;
+	State const *state = pass->state;
+	Process *proc = job->proc;
+	Bitset **candidates = proc->search_candidates;
+	size_t const *stride = pass->stride;
+	Group const *group = pass->group;
+	// (prev_bytes is different for each chunk)
+	ScanParams params[DATA_TYPE_COUNT];
+	memcpy(params, pass->params, sizeof params);
+	// previous memory, for same/different searches (uint64_t to be as aligned as possible).
+	// values/strings starting in a run can go past the end of it, so there's some extra space at the end.
+	uint64_t *prevbuf = NULL;
+	// offset of the start of each map from the start of the first one
+	// (which is also where it is in prev_memory, and its bitset index times the stride)
+	Address *map_offset = calloc(proc->nmaps + 1, sizeof *map_offset);
+	bool success = map_offset != NULL;
+	if (success && pass->search_type == SEARCH_SAME_DIFFERENT) {
+		prevbuf = malloc(pass->tuning.run_max + GROUP_MAX_WINDOW + 8);
+		if (!prevbuf) success = false;
+	}
+	for (unsigned m = 0; success && m < proc->nmaps; ++m)
+		map_offset[m + 1] = map_offset[m] + proc->maps[m].size;
+	uint64_t *page_hashes = NULL; // (see Process.page_hashes)
+	if (success && pass->signature) {
+		if (!proc->page_hashes)
+			proc->page_hashes = calloc(proc->total_memory / 4096 + 1, sizeof *proc->page_hashes);
+		page_hashes = proc->page_hashes;
+		if (page_hashes && proc->page_hashes_signature != pass->signature) {
+			// the hashes are from steps looking for something else
+			memset(page_hashes, 0, (proc->total_memory / 4096) * sizeof *page_hashes);
+			proc->page_hashes_signature = pass->signature;
+		}
+	}
+	
+	// find the stretches of memory with candidates in them, each of which is read all at once
+	SearchRun *runs = NULL;
+	size_t n_runs = 0;
+	if (success)
+		success = search_runs_find(proc, candidates, stride, map_offset, pass->tuning, &runs, &n_runs);
+	// search the memory most likely to have what we're looking for first, so it shows up sooner
+	if (n_runs)
+		qsort(runs, n_runs, sizeof *runs, search_run_cmp);
+	
+	// what to read for each run. the memory for run #i goes at buffer + GROUP_MAX_WINDOW;
+	// group searches also look at the memory before the run, and values/strings starting in it
+	// can go past the end of it.
+	ReadRequest *requests = NULL;
+	if (success && n_runs) {
+		requests = calloc(n_runs, sizeof *requests);
+		if (!requests)
+			success = false;
+	}
+	Address bytes_total = 0;
+	for (size_t r = 0; success && r < n_runs; ++r) {
+		SearchRun const *run = &runs[r];
+		Map const *map = &proc->maps[run->map];
+		size_t before = 0;
+		if (group) {
+			before = group->window;
+			if (before > run->offset) before = (size_t)run->offset;
 		}
+		size_t after = pass->overlap;
+		if (after > map->size - run->offset - run->size)
+			after = (size_t)(map->size - run->offset - run->size);
+		ReadRequest *request = &requests[r];
+		request->addr = map->lo + run->offset - before;
+		request->size = before + run->size + after;
+		request->buffer_size = GROUP_MAX_WINDOW + run->size + GROUP_MAX_WINDOW + 8;
+		request->buffer_offset = GROUP_MAX_WINDOW - before;
+		bytes_total += run->size;
 	}
+	g_mutex_lock(&pass->mutex);
+	job->bytes_total = bytes_total;
+	g_mutex_unlock(&pass->mutex);
 	
+	ReadAhead read_ahead;
+	if (success && !read_ahead_start(&read_ahead, job->reader, requests, n_runs,
+		state->stop_while_accessing_memory && state->snapshot_memory)) {
+		success = false;
+	}
+	if (success && read_ahead.snapshot) {
+		// we've got all the memory we need, so the process can continue
+		memory_reader_resume(state, proc->pid);
+		job->pause_end = g_get_monotonic_time();
+	}
+	if (success) {
+		FILE *prev_mem = proc->prev_memory;
+		DataType view_type = pass->view_type;
+		for (size_t r = 0; r < n_runs; ++r) {
+			SearchRun const *run = &runs[r];
+			Map const *map = &proc->maps[run->map];
+			Address run_start = map_offset[run->map] + run->offset;
+			g_mutex_lock(&pass->mutex);
+			bool cancel = pass->cancel;
+			g_mutex_unlock(&pass->mutex);
+			// (if we stop early, the rest of the candidates are just left as they are)
+			if (cancel) break;
+			// this waits for the memory to be read (if it hasn't been already)
+			uint8_t const *run_bytes = read_ahead_get(&read_ahead, r) + GROUP_MAX_WINDOW;
+			// number of bytes read from run_bytes onwards
+			size_t run_avail = requests[r].size - (GROUP_MAX_WINDOW - requests[r].buffer_offset);
+			
+			if (pass->search_type == SEARCH_SAME_DIFFERENT) {
+				// read the previous memory
+				memset(prevbuf, 0, run_avail);
+				fseek(prev_mem, (long)run_start, SEEK_SET);
+				fread(prevbuf, 1, run_avail, prev_mem);
+			}
+			
+			Address n_removed[DATA_TYPE_COUNT] = {0};
+			// go through the run in chunks, checking each one for all of the types while it's in the cache.
+			for (size_t c = 0; c < run->size; c += 4096) {
+				Address chunk_offset = run->offset + c;
+				size_t this_chunk_bytes = 4096;
+				if (this_chunk_bytes > run->size - c)
+					this_chunk_bytes = run->size - c;
+				uint8_t const *memchunk = run_bytes + c;
+				size_t avail_bytes = run_avail - c;
+				size_t before = 0;
+				if (group) {
+					before = group->window;
+					if (before > chunk_offset) before = (size_t)chunk_offset;
+				}
+				
+				uint64_t hash = 0; // hash of the memory the chunk's scan looks at (0 if it hasn't been found yet)
+				bool chunk_updated = true; // were all the changes to the candidates made?
+				for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+					DataType type = (DataType)t;
+					if (!candidates[type]) continue;
+					size_t n_positions = this_chunk_bytes / stride[type];
+					size_t n_words = n_positions / 64;
+					// chunks are 4096 bytes, so they never go past the end of a bitset block
+					Address w = (run_start + c) / stride[type] / 64;
+					if (!bitset_any_words(candidates[type], w, n_words)) continue;
+					if (page_hashes && !hash) {
+						// hash the chunk now, while it's going into the cache for the scan anyway
+						size_t after = avail_bytes - this_chunk_bytes;
+						if (after > pass->overlap) after = pass->overlap;
+						hash = page_hash(memchunk - before, before + this_chunk_bytes + after, 0);
+						if (!hash) hash = 1;
+						if (page_hashes[(run_start + c) / 4096] == hash) {
+							// it hasn't changed since it was last checked for the same thing
+							hash = 0;
+							break;
+						}
+					}
+					uint64_t scratch[BITSET_BLOCK_WORDS];
+					uint64_t *chunk_candidates = bitset_update_begin(candidates[type], w, n_words, scratch);
+					Address n_before = 0, n_after = 0;
+					for (size_t i = 0; i < n_words; ++i)
+						n_before += (Address)__builtin_popcountll(chunk_candidates[i]);
+					params[type].prev_bytes = prevbuf ? (uint8_t const *)prevbuf + c : NULL;
+					pass->scan[type](&params[type], memchunk, n_positions, avail_bytes, chunk_candidates);
+					if (group)
+						group_search_chunk(group, state->search_unaligned, memchunk, before,
+							stride[type], n_positions, avail_bytes, chunk_candidates);
+					for (size_t i = 0; i < n_words; ++i)
+						n_after += (Address)__builtin_popcountll(chunk_candidates[i]);
+					// (if there isn't enough memory for the new words, this leaves the old candidates there,
+					// which is harmless)
+					if (bitset_update_end(candidates[type], w, n_words, chunk_candidates))
+						n_removed[type] += n_before - n_after;
+					else
+						chunk_updated = false;
+				}
+				if (hash)
+					page_hashes[(run_start + c) / 4096] = chunk_updated ? hash : 0;
+			}
+			
+			if (pass->search_type == SEARCH_SAME_DIFFERENT) {
+				// overwrite the previous memory with the current memory
+				fseek(prev_mem, (long)run_start, SEEK_SET);
+				fwrite(run_bytes, 1, run->size, prev_mem);
+			}
+			read_ahead_release(&read_ahead, r);
+			
+			// let the memory view know how it's going
+			Address found[64];
+			unsigned n_found = 0;
+			Bitset const *view_candidates = candidates[view_type];
+			if (view_candidates && job->n_found < pass->max_found) {
+				size_t view_stride = stride[view_type];
+				Address first = run_start / view_stride, end = first + run->size / view_stride;
+				for (Address index = bitset_next(view_candidates, first);
+					index < end && n_found < sizeof found / sizeof *found && job->n_found + n_found < pass->max_found;
+					index = bitset_next(view_candidates, index + 1)) {
+					found[n_found++] = map->lo + run->offset + (index - first) * view_stride;
+				}
+			}
+			g_mutex_lock(&pass->mutex);
+			memcpy(&job->found[job->n_found], found, n_found * sizeof *found);
+			job->n_found += n_found;
+			job->bytes_done += run->size;
+			for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+				job->n_removed[t] += n_removed[t];
+				if (proc->map_candidates[t])
+					proc->map_candidates[t][run->map] -= n_removed[t];
+			}
+			g_mutex_unlock(&pass->mutex);
+		}
+		read_ahead_stop(&read_ahead);
+	}
+	if (!success)
+		job->out_of_memory = true;
+	free(requests);
+	free(runs);
+	free(prevbuf);
+	free(map_offset);
+}
+
+static void search_job_run(gpointer data, gpointer user_data) {
+	SearchJob *job = data;
+	search_process(job);
+	g_mutex_lock(&job->pass->mutex);
+	--job->pass->jobs_left;
+	g_mutex_unlock(&job->pass->mutex);
+}
+
+// sensitivity of everything which can't be used while a step is running
+static void search_pass_set_sensitive(State *state, bool sensitive) {
+	GtkBuilder *builder = state->builder;
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "pid-box")), sensitive);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "configuration")), sensitive);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "set-all-box")), sensitive);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "regions-actions")), sensitive);
+	if (sensitive) {
+		gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "search-progress-box")));
+	} else {
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(gtk_builder_get_object(builder, "search-progress")), 0);
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(gtk_builder_get_object(builder, "search-progress")), NULL);
+		gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "search-progress-box")));
+	}
+}
+
+// wait for the running step to finish, close its readers, and free it.
+// returns false if there wasn't enough memory for it.
+static bool search_pass_end(State *state) {
+	SearchPass *pass = state->search_pass;
+	GtkBuilder *builder = state->builder;
+	g_thread_pool_free(pass->pool, false, true); // (this waits for all the jobs to finish)
+	// (do this first, so that closing the readers lets the processes continue)
+	state->search_pass = NULL;
+	gint64 pause_end = pass->pause_start;
+	bool out_of_memory = false;
+	for (unsigned p = 0; p < pass->n_jobs; ++p) {
+		SearchJob *job = &pass->jobs[p];
+		if (job->reader) {
+			memory_reader_close(state, job->proc->pid, job->reader);
+			gint64 job_pause_end = job->pause_end ? job->pause_end : g_get_monotonic_time();
+			if (job_pause_end > pause_end) pause_end = job_pause_end;
+		}
+		out_of_memory |= job->out_of_memory;
+	}
+	// stop searching processes we couldn't read from (they've probably exited)
+	unsigned n_processes = 0;
+	for (unsigned p = 0; p < state->n_processes; ++p) {
+		if (pass->jobs[p].reader)
+			state->processes[n_processes++] = state->processes[p];
+		else
+			process_free(&state->processes[p]);
+	}
+	state->n_processes = n_processes;
+	{
+		GtkLabel *pause_label = GTK_LABEL(gtk_builder_get_object(builder, "pause-time"));
+		char text[64] = "";
+		if (state->stop_while_accessing_memory)
+			snprintf(text, sizeof text, "Process stopped for %.1fms", (double)(pause_end - pass->pause_start) / 1000);
+		gtk_label_set_text(pause_label, text);
+	}
+	search_pass_set_sensitive(state, true);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "data-type-box")), pass->data_types_sensitive);
+	g_mutex_clear(&pass->mutex);
+	free(pass->jobs);
+	free(pass);
+	if (out_of_memory)
+		display_error_nofmt(state, "Not enough memory available for search.");
+	return !out_of_memory;
+}
+
+// set up an expression search for one type (see filter_compile). p can only be used if allow_prev is true.
+// returns false and writes a message to error if the expression doesn't work for this type.
+static bool search_filter_init(State *state, SearchPass *pass, DataType type, char const *text, bool allow_prev,
+	Predicate *predicate, char *error, size_t error_size) {
+	Filter *filter = &pass->filters[type];
+	ScanParams *params = &pass->params[type];
+	if (!filter_compile(text, type, state->float_tolerance, filter, error, error_size))
+		return false;
+	if (filter->uses_prev && !allow_prev) {
+		snprintf(error, error_size, "p (the previous value) only works in same/different searches");
+		return false;
+	}
+	if (filter->simple[0] && data_range_from_str(filter->simple, type, state->float_tolerance, &params->lo, &params->hi)) {
+		// e.g. x + 5 == 10 -- this can be done with the usual scan functions
+		bool exact = !data_type_is_float(type) && params->lo == params->hi;
+		*predicate = exact ? PREDICATE_EQUAL : PREDICATE_RANGE;
+	} else {
+		*predicate = PREDICATE_EXPRESSION;
+		params->filter = filter;
+	}
+	return true;
 }
 
 G_MODULE_EXPORT void search_update(GtkWidget *_widget, gpointer user_data) {
@@ -521,166 +1555,350 @@ G_MODULE_EXPORT void search_update(GtkWidget *_widget, gpointer user_data) {
 	GtkWindow *window = state->window;
 	GtkWidget *search_box = GTK_WIDGET(gtk_builder_get_object(builder, "search-box"));
 	
+	// (the candidates can't change while they're being exported)
+	if (state->export) {
+		display_error_nofmt(state, "Wait for the export to finish first.");
+		return;
+	}
 	// disabling search-box can mess up the focus, it turns out
 	state->prev_focus = gtk_window_get_focus(window);
-	gtk_widget_set_sensitive(search_box, 0); // temporarily disable everything search-related so that you don't accidentally queue up a bunch of updates while it's loading. it will be reset on the next frame_callback.
+	gtk_widget_set_sensitive(search_box, 0); // disable everything search-related so that you don't accidentally queue up a bunch of updates while it's running. it will be reset on the first frame_callback after the step is done.
 	
-	DataType data_type = state->data_type;
-	size_t item_size = data_type_size(data_type);
+	if (state->search_pass || !state->n_processes) return;
 	SearchType search_type = state->search_type;
-	uint64_t *candidates = state->search_candidates;
-	int memory_reader = memory_reader_open(state);
-	bool success = true;
+	SearchPass *pass = calloc(1, sizeof *pass);
+	bool success = pass != NULL;
+	if (!success) {
+		display_error_nofmt(state, "Not enough memory available for search.");
+		return;
+	}
+	pass->state = state;
+	pass->search_type = search_type;
+	pass->tuning = read_tuning(state);
+	g_mutex_init(&pass->mutex);
+	// what to check for each type on this pass
+	Predicate predicate[DATA_TYPE_COUNT] = {0};
+	ScanParams *params = pass->params;
 	
-	if (memory_reader) {
-		uint64_t value = 0;
-		bool same = false, not_sure = false;
-		switch (search_type) {
-		case SEARCH_ENTER_VALUE: {
-			GtkEntry *value_entry = GTK_ENTRY(gtk_builder_get_object(builder, "current-value"));
-			success = data_from_str(gtk_entry_get_text(value_entry), data_type, &value);
-		} break;
-		case SEARCH_SAME_DIFFERENT: {
-			GtkToggleButton *same_button = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "same"));
-			same = gtk_toggle_button_get_active(same_button);
-			GtkToggleButton *not_sure_button = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "not-sure"));
-			not_sure = gtk_toggle_button_get_active(not_sure_button);
-		} break;
+	GtkEntry *tolerance_entry = GTK_ENTRY(gtk_builder_get_object(builder, "float-tolerance"));
+	if (!float_tolerance_from_str(gtk_entry_get_text(tolerance_entry), &state->float_tolerance)) {
+		display_error(state, "Bad floating-point tolerance: %s (it should look like 0.5 or 10%%).", gtk_entry_get_text(tolerance_entry));
+		success = false;
+	}
+	
+	if (success) switch (search_type) {
+	case SEARCH_ENTER_VALUE: {
+		GtkEntry *value_entry = GTK_ENTRY(gtk_builder_get_object(builder, "current-value"));
+		char const *value_text = gtk_entry_get_text(value_entry);
+		bool case_insensitive = gtk_toggle_button_get_active(
+			GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "case-insensitive")));
+		char anchor_text[128];
+		snprintf(anchor_text, sizeof anchor_text, "%s", value_text);
+		state->group.n_fields = 0;
+		char *comma = strchr(anchor_text, ',');
+		if (comma && !data_type_is_string(state->data_type)) {
+			// group search, e.g. "100, f32 3.5, u16 7" -- the first value is the one at the candidate,
+			// and the rest have to be nearby.
+			*comma = '\0';
+			char const *window_text = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "group-window")));
+			char *endp;
+			unsigned long group_window = strtoul(window_text, &endp, 10);
+			if (*endp || !*window_text || group_window < 2 || group_window > GROUP_MAX_WINDOW) {
+				display_error(state, "Bad group window: %s (it should be a number of bytes from 2 to %d).", window_text, GROUP_MAX_WINDOW);
+				success = false;
+				break;
+			}
+			state->group.window = group_window;
+			if (!group_parse(value_text + (comma - anchor_text) + 1, state->float_tolerance, &state->group)) {
+				state->group.n_fields = 0;
+				success = false;
+				break;
+			}
+			value_text = anchor_text;
 		}
-		if (success) {
-			Address bitset_index = 0;
-			FILE *prev_mem = state->prev_memory;
-			if (prev_mem) rewind(prev_mem);
-			for (unsigned m = 0; m < state->nmaps; ++m) {
-				// there is some kinda complicated code here to skip over large regions of
-				// eliminated addresses. specifically, we can skip 64 bytes at a time, because
-				// of our bitset.
-				Map const *map = &state->maps[m];
-				Address addr_lo = map->lo;
-				Address n_items = map->size / item_size;
-				Address start = 0;
-				
-				fpos_t map_base_pos;
-				if (prev_mem)
-					fgetpos(prev_mem, &map_base_pos);
-				while (start < n_items) {
-					while (start < n_items) {
-						if (candidates[bitset_index/64])
-							break;
-						start += 64;
-						bitset_index += 64;
-					}
-					Address end = start, bitset_index_end = bitset_index;
-					
-					while (end < n_items) {
-						if (candidates[bitset_index_end/64] == 0)
-							break;
-						end += 64;
-						bitset_index_end += 64;
-					}
-					
-					Address run_offset = start * item_size;
-					// we have a "run" of possible candidates from `start` to `end`.
-					Address run_size = end - start;
-					Address bytes_left = run_size * item_size;
-					// this "run" could be pretty long, so let's do it in chunks.
-					uint64_t memchunk[512]; // current memory (uint64_t to be as aligned as possible)
-					uint64_t savchunk[512]; // previous memory (SEARCH_SAME_DIFFERENT only)
-					if (search_type == SEARCH_SAME_DIFFERENT)
-						rewind(prev_mem);
-					while (bytes_left > 0) {
-						size_t this_chunk_bytes = sizeof memchunk;
-						if (this_chunk_bytes > bytes_left)
-							this_chunk_bytes = bytes_left;
-						
-						// chunk offset within map
-						Address chunk_offset = run_offset + run_size * item_size - bytes_left;
-						Address chunk_addr = addr_lo + chunk_offset;
-						memset(memchunk, 0, sizeof memchunk); // if we can't read the memory, treat it as 0
-						memory_read_bytes(memory_reader, chunk_addr, (uint8_t *)memchunk, this_chunk_bytes);
-						
-						if (search_type == SEARCH_SAME_DIFFERENT) {
-							memset(savchunk, 0, sizeof savchunk);
-							fsetpos(prev_mem, &map_base_pos);
-							fseek(prev_mem, (long)chunk_offset, SEEK_CUR);
-							// read the previous memory,
-							fread(savchunk, 1, this_chunk_bytes, prev_mem);
-							fsetpos(prev_mem, &map_base_pos);
-							fseek(prev_mem, (long)chunk_offset, SEEK_CUR);
-							// then overwrite it with the current memory
-							fwrite(memchunk, 1, this_chunk_bytes, prev_mem);
-						}
-						
-						size_t this_chunk_items = this_chunk_bytes / item_size;
-						for (size_t i = 0; i < this_chunk_items; ++i) {
-							void const *value_here = &((uint8_t const *)memchunk)[i * item_size];
-							switch (search_type) {
-							case SEARCH_ENTER_VALUE:
-								if (!data_equal(data_type, &value, value_here)) {
-									// eliminate this candidate
-									candidates[bitset_index/64] &= ~MASK64(bitset_index % 64);
-								}
-								break;
-							case SEARCH_SAME_DIFFERENT:
-								if (!not_sure) {
-									void const *prev_value_here = &((uint8_t const *)savchunk)[i * item_size];
-									bool this_same = data_equal(data_type, value_here, prev_value_here);
-									if (this_same != same) {
-										// eliminate this candidate
-										candidates[bitset_index/64] &= ~MASK64(bitset_index % 64);
-									}
-								}
-								break;
-							}
-							++bitset_index;
-						}
-						
-						bytes_left -= this_chunk_bytes;
-					}
-					assert(bitset_index == bitset_index_end);
-					start = end;
+		bool any_valid = false;
+		bool valid[DATA_TYPE_COUNT] = {0};
+		char filter_error[128] = "";
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+			DataType type = (DataType)t;
+			if (!searching_for(state, type)) continue;
+			if (data_type_is_string(type)) {
+				valid[type] = string_pattern_init(&pass->pattern, type, value_text, case_insensitive);
+				predicate[type] = PREDICATE_STRING;
+				params[type].pattern = &pass->pattern;
+			} else {
+				valid[type] = data_range_from_str(value_text, type, state->float_tolerance, &params[type].lo, &params[type].hi);
+				// for exact integers, we can just check for equality
+				bool exact = !data_type_is_float(type) && params[type].lo == params[type].hi;
+				predicate[type] = exact ? PREDICATE_EQUAL : PREDICATE_RANGE;
+				if (!valid[type]) {
+					// maybe it's an expression, like x / 8 == 100
+					valid[type] = search_filter_init(state, pass, type, value_text, false,
+						&predicate[type], filter_error, sizeof filter_error);
 				}
-				if (prev_mem) {
-					fsetpos(prev_mem, &map_base_pos);
-					fseek(prev_mem, (long)map->size, SEEK_CUR);
+			}
+			any_valid |= valid[type];
+		}
+		if (any_valid) {
+			for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+				DataType type = (DataType)t;
+				if (searching_for(state, type) && !valid[type]) {
+					// e.g. -3 or 1.5 when searching for multiple types -- it can't be a u32.
+					for (unsigned p = 0; p < state->n_processes; ++p)
+						process_clear_candidates(&state->processes[p], type);
 				}
 			}
-		} else success = false;
-		memory_reader_close(state, memory_reader);
-	} else success = false;
-	
+		} else {
+			// (only complain about expressions if it looks like one was intended)
+			if (*filter_error && strpbrk(value_text, "xp"))
+				display_error(state, "Bad expression: %s (%s).", value_text, filter_error);
+			success = false;
+		}
+	} break;
+	case SEARCH_SAME_DIFFERENT: {
+		GtkToggleButton *same_button = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "same"));
+		bool same = gtk_toggle_button_get_active(same_button);
+		GtkToggleButton *not_sure_button = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "not-sure"));
+		bool not_sure = gtk_toggle_button_get_active(not_sure_button);
+		GtkToggleButton *expression_button = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "expression"));
+		bool expression = gtk_toggle_button_get_active(expression_button);
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+			// if not sure, only values which go past the end of their map are eliminated
+			predicate[t] = not_sure ? PREDICATE_ANY : same ? PREDICATE_SAME : PREDICATE_DIFFERENT;
+			params[t].tolerance = state->float_tolerance;
+		}
+		if (expression) {
+			// e.g. x - p == 5
+			char const *expression_text = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "expression-text")));
+			char filter_error[128] = "";
+			bool any_valid = false;
+			bool valid[DATA_TYPE_COUNT] = {0};
+			for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+				DataType type = (DataType)t;
+				if (!searching_for(state, type)) continue;
+				valid[type] = search_filter_init(state, pass, type, expression_text, true,
+					&predicate[type], filter_error, sizeof filter_error);
+				any_valid |= valid[type];
+			}
+			if (any_valid) {
+				for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+					DataType type = (DataType)t;
+					if (searching_for(state, type) && !valid[type]) {
+						for (unsigned p = 0; p < state->n_processes; ++p)
+							process_clear_candidates(&state->processes[p], type);
+					}
+				}
+			} else {
+				display_error(state, "Bad expression: %s (%s).", expression_text, filter_error);
+				success = false;
+			}
+		}
+	} break;
+	}
 	if (success) {
-		GtkLabel *steps_completed_label = GTK_LABEL(gtk_builder_get_object(builder, "steps-completed"));
-		long steps_completed = 1 + atol(gtk_label_get_text(steps_completed_label));
-		{
-			char text[32];
-			sprintf(text, "%ld", steps_completed);
-			gtk_label_set_text(steps_completed_label, text);
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+			DataType type = (DataType)t;
+			if (!searching_for(state, type)) continue;
+			pass->stride[type] = search_stride(state, type);
+			pass->scan[type] = scan_function(type, predicate[type], state->search_unaligned);
+			// number of bytes taken up by a match
+			// (the pattern is only set for string searches -- same/different steps just compare single items)
+			size_t span = predicate[type] == PREDICATE_STRING ? pass->pattern.len * data_type_size(type) : data_type_size(type);
+			if (span > pass->stride[type] && span - pass->stride[type] > pass->overlap)
+				pass->overlap = span - pass->stride[type];
 		}
+		pass->group = search_type == SEARCH_ENTER_VALUE && state->group.n_fields ? &state->group : NULL;
+		if (pass->group && pass->group->window + 8 > pass->overlap)
+			pass->overlap = pass->group->window + 8; // fields can start up to window-1 bytes after a candidate
+		// (same/different steps compare with the last step's memory, which changes every time)
+		if (search_type == SEARCH_ENTER_VALUE && state->skip_unchanged_pages)
+			pass->signature = search_pass_signature(pass);
+		pass->view_type = state->data_type;
+		pass->max_found = state->memory_view_n_items;
+		// (this is where candidates-left counts down from)
 		update_candidates(state);
-		update_memory_view(state, true);
+		memcpy(pass->n_candidates_before, state->n_candidates, sizeof state->n_candidates);
+		
+		pass->jobs = calloc(state->n_processes, sizeof *pass->jobs);
+		if (pass->jobs)
+			pass->pool = g_thread_pool_new(search_job_run, NULL, (gint)g_get_num_processors(), false, NULL);
+		if (!pass->pool) {
+			display_error_nofmt(state, "Not enough memory available for search.");
+			success = false;
+		}
+	}
+	if (success) {
+		pass->n_jobs = state->n_processes;
+		pass->pause_start = g_get_monotonic_time();
+		// open all the readers first (this stops the processes, if that's turned on)
+		for (unsigned p = 0; p < pass->n_jobs; ++p) {
+			SearchJob *job = &pass->jobs[p];
+			job->pass = pass;
+			job->proc = &state->processes[p];
+			job->reader = memory_reader_open(state, job->proc->pid);
+			if (job->reader) ++pass->jobs_left;
+			else if (p == 0) success = false;
+		}
+		if (!success) {
+			for (unsigned p = 0; p < pass->n_jobs; ++p)
+				if (pass->jobs[p].reader)
+					memory_reader_close(state, pass->jobs[p].proc->pid, pass->jobs[p].reader);
+			g_thread_pool_free(pass->pool, false, true);
+		}
+	}
+	if (!success) {
+		g_mutex_clear(&pass->mutex);
+		free(pass->jobs);
+		free(pass);
+		return;
+	}
+	
+	// search the processes in parallel, while frame_callback keeps the UI up to date
+	state->search_pass = pass;
+	GtkWidget *data_type_box = GTK_WIDGET(gtk_builder_get_object(builder, "data-type-box"));
+	pass->data_types_sensitive = gtk_widget_get_sensitive(data_type_box);
+	gtk_widget_set_sensitive(data_type_box, 0);
+	search_pass_set_sensitive(state, false);
+	update_memory_view(state, true);
+	for (unsigned p = 0; p < pass->n_jobs; ++p)
+		if (pass->jobs[p].reader)
+			g_thread_pool_push(pass->pool, &pass->jobs[p], NULL);
+}
+
+// the step that's running is done
+static void search_finish(State *state) {
+	GtkBuilder *builder = state->builder;
+	if (!search_pass_end(state)) return;
+	
+	GtkLabel *steps_completed_label = GTK_LABEL(gtk_builder_get_object(builder, "steps-completed"));
+	long steps_completed = 1 + atol(gtk_label_get_text(steps_completed_label));
+	{
+		char text[32];
+		sprintf(text, "%ld", steps_completed);
+		gtk_label_set_text(steps_completed_label, text);
+	}
+	update_candidates(state);
+	
+	// stop searching for types with no candidates left (as long as there's something left)
+	int best_type = -1, n_types = 0;
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+		if (!searching_for(state, (DataType)t)) continue;
+		++n_types;
+		if (best_type == -1 || state->n_candidates[t] > state->n_candidates[best_type])
+			best_type = t;
+	}
+	if (n_types > 1 && state->n_candidates[best_type] > 0) {
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+			if (searching_for(state, (DataType)t) && state->n_candidates[t] == 0) {
+				for (unsigned p = 0; p < state->n_processes; ++p) {
+					Process *proc = &state->processes[p];
+					bitset_free(proc->search_candidates[t]);
+					proc->search_candidates[t] = NULL;
+					free(proc->map_candidates[t]);
+					proc->map_candidates[t] = NULL;
+				}
+			}
+		}
+		show_candidates_left(state);
+		if (!searching_for(state, state->data_type)) {
+			// switch to the type with the most candidates
+			char id[32];
+			sprintf(id, "type-%s", data_type_name((DataType)best_type));
+			gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, id)), 1);
+			update_configuration(NULL, state);
+		}
+	}
+	update_memory_view(state, true);
+	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "session-autosave")))) {
+		session_save(state, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "session-path"))), steps_completed);
+	}
+}
+
+// show how the running step is going (and finish it if it's done)
+static void search_pass_poll(State *state) {
+	SearchPass *pass = state->search_pass;
+	GtkBuilder *builder = state->builder;
+	Address bytes_total = 0, bytes_done = 0, n_removed[DATA_TYPE_COUNT] = {0};
+	unsigned n_found = 0;
+	g_mutex_lock(&pass->mutex);
+	bool done = pass->jobs_left == 0;
+	for (unsigned p = 0; p < pass->n_jobs; ++p) {
+		SearchJob const *job = &pass->jobs[p];
+		bytes_total += job->bytes_total;
+		bytes_done += job->bytes_done;
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+			n_removed[t] += job->n_removed[t];
+		n_found += job->n_found;
+	}
+	g_mutex_unlock(&pass->mutex);
+	if (done) {
+		search_finish(state);
+		return;
 	}
 	
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+		state->n_candidates[t] = pass->n_candidates_before[t] - n_removed[t];
+	show_candidates_left(state);
+	{
+		GtkProgressBar *progress = GTK_PROGRESS_BAR(gtk_builder_get_object(builder, "search-progress"));
+		char done_text[32], total_text[32], text[80];
+		bytes_to_text(bytes_done, done_text, sizeof done_text);
+		bytes_to_text(bytes_total, total_text, sizeof total_text);
+		snprintf(text, sizeof text, "Searched %s of %s", done_text, total_text);
+		gtk_progress_bar_set_fraction(progress, bytes_total ? (double)bytes_done / (double)bytes_total : 0);
+		gtk_progress_bar_set_text(progress, text);
+	}
+	if (n_found != pass->n_found_shown) {
+		pass->n_found_shown = n_found;
+		update_memory_view(state, true);
+	}
+}
+
+// stop the running step, leaving the candidates in memory it hasn't gotten to yet as they are.
+G_MODULE_EXPORT void search_finish_early(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	SearchPass *pass = state->search_pass;
+	if (!pass) return;
+	g_mutex_lock(&pass->mutex);
+	pass->cancel = true;
+	g_mutex_unlock(&pass->mutex);
 }
 
 G_MODULE_EXPORT void search_stop(GtkWidget *_widget, gpointer user_data) {
 	State *state = user_data;
 	GtkBuilder *builder = state->builder;
-	free(state->search_candidates);
-	state->search_candidates = NULL;
-	if (state->prev_memory) {
-		fclose(state->prev_memory);
-		state->prev_memory = NULL;
+	if (state->search_pass) {
+		search_finish_early(NULL, state);
+		search_pass_end(state);
 	}
+	export_stop(state, true); // (it's using the candidates)
+	for (unsigned p = 0; p < state->n_processes; ++p)
+		process_free(&state->processes[p]);
+	free(state->processes);
+	state->processes = NULL;
+	state->n_processes = 0;
+	state->searching = false;
+	state->group.n_fields = 0;
+	state->region_focus_pid = 0;
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "regions-focus")), 0);
+	show_candidates_left(state);
 	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "search-common")));
 	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "search-enter-value")));
 	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "search-same-different")));
 	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "save-search-candidates")));
+	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "save-session")));
+	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "export-buttons")));
+	gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "regions-box")));
 	gtk_widget_show(GTK_WIDGET(gtk_builder_get_object(builder, "pre-search")));
 	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "data-type-box")), 1);
 	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "protection")), 1);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "region-filter")), 1);
 }
 
+// auto-refresh goes from 10 times a second (while values are changing) down to once every 3.2 seconds
+#define AUTO_REFRESH_MIN_INTERVAL 100000
+#define AUTO_REFRESH_MAX_INTERVAL 3200000
+
 // this function is run once per frame
 static gboolean frame_callback(gpointer user_data) {
 	State *state = user_data;
@@ -689,8 +1907,15 @@ static gboolean frame_callback(gpointer user_data) {
 	
 	GtkWidget *search_box = GTK_WIDGET(gtk_builder_get_object(builder, "search-box"));
 	
+	if (state->search_pass)
+		search_pass_poll(state);
+	if (state->export)
+		export_poll(state);
+	if (profile_poll(state))
+		update_profile(state);
+	
 	// sometimes we disable search-box. see search_update.
-	if (!gtk_widget_get_sensitive(search_box)) {
+	if (!gtk_widget_get_sensitive(search_box) && !state->search_pass) {
 		static int frame_counter;
 		if (frame_counter) {
 			gtk_widget_set_sensitive(search_box, 1);
@@ -703,7 +1928,18 @@ static gboolean frame_callback(gpointer user_data) {
 	
 	GtkToggleButton *auto_refresh = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "auto-refresh"));
 	if (gtk_toggle_button_get_active(auto_refresh)) {
-		update_memory_view(state, false);
+		// refresh often while values are changing, and less and less often while they aren't
+		gint64 now = g_get_monotonic_time();
+		if (now >= state->auto_refresh_next) {
+			if (memory_view_refresh(state, true) || !state->auto_refresh_interval)
+				state->auto_refresh_interval = AUTO_REFRESH_MIN_INTERVAL;
+			else if (state->auto_refresh_interval < AUTO_REFRESH_MAX_INTERVAL)
+				state->auto_refresh_interval *= 2;
+			state->auto_refresh_next = now + state->auto_refresh_interval;
+		}
+	} else if (state->view_readers) {
+		memory_view_readers_close(state);
+		state->auto_refresh_interval = 0;
 	}
 	return 1;
 }
@@ -727,6 +1963,301 @@ G_MODULE_EXPORT void memfile_do_write_candidates(GtkWidget *_widget, gpointer us
 	memfile_write_candidates(state, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "memfile-path"))));
 }
 
+G_MODULE_EXPORT void export_do_csv(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	export_start(state, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "export-path"))), EXPORT_CSV);
+}
+
+G_MODULE_EXPORT void export_do_binary(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	export_start(state, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "export-path"))), EXPORT_BINARY);
+}
+
+// start profiling memory activity (see profile.c) for the selected process's maps
+G_MODULE_EXPORT void profile_do_start(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	if (!state->pid) {
+		display_error_nofmt(state, "Select a process first.");
+		return;
+	}
+	if (state->pid < 0) {
+		display_error_nofmt(state, "Only running processes can be profiled.");
+		return;
+	}
+	if (state->profile && state->profile->thread) {
+		display_error_nofmt(state, "Memory activity is already being profiled.");
+		return;
+	}
+	char const *interval_text = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "profile-interval")));
+	char *endp;
+	double interval = strtod(interval_text, &endp);
+	if (*endp || !(interval >= 0.1 && interval <= 3600)) {
+		display_error(state, "Bad time between samples: %s (it should be between 0.1 and 3600 seconds).", interval_text);
+		return;
+	}
+	// (throw away the last profile)
+	profile_stop(state);
+	Process proc = {0};
+	proc.pid = state->pid;
+	proc.nmaps = state->nmaps;
+	proc.total_memory = state->total_memory;
+	proc.maps = calloc(state->nmaps + 1, sizeof *proc.maps);
+	if (!proc.maps) {
+		display_error_nofmt(state, "Not enough memory available for profiling.");
+		return;
+	}
+	memcpy(proc.maps, state->maps, state->nmaps * sizeof *proc.maps);
+	process_read_map_names(state, &proc);
+	profile_start(state, &proc, (gint64)(interval * 1e6));
+	update_profile(state);
+}
+
+G_MODULE_EXPORT void profile_do_stop(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	profile_end(state);
+	update_profile(state);
+}
+
+// double-clicking a region in the memory activity list shows it in the memory view
+G_MODULE_EXPORT void profile_row_activated(GtkTreeView *_tree_view, GtkTreePath *path, GtkTreeViewColumn *_column, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	GtkTreeModel *tree_model = GTK_TREE_MODEL(gtk_builder_get_object(builder, "profile-regions"));
+	GtkTreeIter iter;
+	if (!gtk_tree_model_get_iter(tree_model, &iter, path)) return;
+	gchar *addr_str = NULL;
+	gtk_tree_model_get(tree_model, &iter, 0, &addr_str, -1);
+	if (!addr_str) return;
+	gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(builder, "address")), addr_str);
+	g_free(addr_str);
+	update_configuration(NULL, state);
+}
+
+// the map selected in the regions view. returns false if there isn't one.
+static bool regions_selected(State *state, Process **out_proc, unsigned *out_m) {
+	GtkBuilder *builder = state->builder;
+	GtkTreeView *tree_view = GTK_TREE_VIEW(gtk_builder_get_object(builder, "regions-view"));
+	GtkTreeModel *tree_model = GTK_TREE_MODEL(gtk_builder_get_object(builder, "regions"));
+	GtkTreeIter iter;
+	if (!gtk_tree_selection_get_selected(gtk_tree_view_get_selection(tree_view), NULL, &iter))
+		return false;
+	return regions_row_map(state, tree_model, &iter, out_proc, out_m);
+}
+
+// show only the candidates in the selected map in the memory view (or all of them again)
+G_MODULE_EXPORT void regions_do_focus(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkToggleButton *focus = GTK_TOGGLE_BUTTON(gtk_builder_get_object(state->builder, "regions-focus"));
+	state->region_focus_pid = 0;
+	if (gtk_toggle_button_get_active(focus)) {
+		Process *proc;
+		unsigned m;
+		if (regions_selected(state, &proc, &m)) {
+			state->region_focus_pid = proc->pid;
+			state->region_focus_lo = proc->maps[m].lo;
+		} else {
+			// (there's nothing to focus on)
+			gtk_toggle_button_set_active(focus, 0);
+			return;
+		}
+	}
+	update_memory_view(state, true);
+}
+
+// double-clicking a map in the regions view shows only its candidates
+G_MODULE_EXPORT void regions_row_activated(GtkTreeView *_tree_view, GtkTreePath *_path, GtkTreeViewColumn *_column, gpointer user_data) {
+	State *state = user_data;
+	if (state->search_pass) return;
+	GtkToggleButton *focus = GTK_TOGGLE_BUTTON(gtk_builder_get_object(state->builder, "regions-focus"));
+	if (gtk_toggle_button_get_active(focus))
+		regions_do_focus(NULL, state);
+	else
+		gtk_toggle_button_set_active(focus, 1); // (this calls regions_do_focus)
+}
+
+// remove all of the candidates in the selected map, of every type being searched for
+G_MODULE_EXPORT void regions_do_exclude(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	if (state->search_pass) {
+		display_error_nofmt(state, "Wait for the search step to finish first.");
+		return;
+	}
+	if (state->export) {
+		display_error_nofmt(state, "Wait for the export to finish first.");
+		return;
+	}
+	Process *proc;
+	unsigned m;
+	if (!regions_selected(state, &proc, &m)) return;
+	bool out_of_memory = false;
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+		DataType type = (DataType)t;
+		Bitset *candidates = proc->search_candidates[type];
+		if (!candidates) continue;
+		size_t stride = search_stride(state, type);
+		Address w = process_map_index(proc, m, stride) / 64;
+		Address n_words = proc->maps[m].size / stride / 64;
+		out_of_memory |= !bitset_clear_words(candidates, w, n_words);
+		if (proc->map_candidates[type])
+			proc->map_candidates[type][m] = bitset_count_words(candidates, w, n_words);
+	}
+	if (out_of_memory)
+		display_error_nofmt(state, "Not enough memory to remove all of the candidates.");
+	free(state->view_rows); state->view_rows = NULL;
+	update_candidates(state);
+	update_memory_view(state, true);
+}
+
+G_MODULE_EXPORT void layout_do_save(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	char const *filename = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "layout-path")));
+	Layout layout;
+	if (!layout_parse(gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "layout"))), &layout)) {
+		display_error_nofmt(state, "The struct layout is invalid.");
+		return;
+	}
+	FILE *fp = fopen(filename, "w");
+	if (!fp) {
+		display_error(state, "Couldn't open %s: %s.", filename, strerror(errno));
+		return;
+	}
+	// one field per line
+	static char text[LAYOUT_MAX_FIELDS * 64 + 64];
+	layout_to_str(&layout, "\n", text, sizeof text);
+	fprintf(fp, "%s\n", text);
+	if (fclose(fp) != 0)
+		display_error(state, "Couldn't write %s: %s.", filename, strerror(errno));
+}
+
+G_MODULE_EXPORT void layout_do_load(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	char const *filename = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "layout-path")));
+	FILE *fp = fopen(filename, "r");
+	if (!fp) {
+		display_error(state, "Couldn't open %s: %s.", filename, strerror(errno));
+		return;
+	}
+	static char text[LAYOUT_MAX_FIELDS * 256];
+	size_t len = fread(text, 1, sizeof text - 1, fp);
+	text[len] = '\0';
+	fclose(fp);
+	Layout layout;
+	if (!layout_parse(text, &layout)) {
+		display_error(state, "%s isn't a valid struct layout.", filename);
+		return;
+	}
+	// show it in the "layout" entry, all on one line
+	layout_to_str(&layout, ", ", text, sizeof text);
+	gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(builder, "layout")), text);
+	update_configuration(NULL, state);
+}
+
+G_MODULE_EXPORT void agent_do_connect(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	GtkEntry *path_entry = GTK_ENTRY(gtk_builder_get_object(builder, "agent-socket"));
+	if (state->search_pass) {
+		display_error_nofmt(state, "Wait for the search step to finish first.");
+		return;
+	}
+	memory_view_readers_close(state);
+	if (state->agent)
+		agent_disconnect(state);
+	else if (!agent_connect(state, gtk_entry_get_text(path_entry)))
+		return;
+	gtk_button_set_label(GTK_BUTTON(gtk_builder_get_object(builder, "agent-connect")), state->agent ? "Disconnect" : "Connect");
+	gtk_widget_set_sensitive(GTK_WIDGET(path_entry), !state->agent);
+	// (we might be able to see more of the process's memory now)
+	if (state->agent && state->pid && !state->searching)
+		update_maps(state);
+	update_memory_view(state, false);
+}
+
+G_MODULE_EXPORT void session_do_save(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	long steps_completed = atol(gtk_label_get_text(GTK_LABEL(gtk_builder_get_object(builder, "steps-completed"))));
+	session_save(state, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "session-path"))), steps_completed);
+}
+
+G_MODULE_EXPORT void session_do_load(GtkWidget *_widget, gpointer user_data) {
+	State *state = user_data;
+	GtkBuilder *builder = state->builder;
+	Session session = {0};
+	if (!session_load(state, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(builder, "session-path"))), &session))
+		return;
+	if (state->searching)
+		search_stop(NULL, state);
+	if (!state->pid) {
+		// go back to the processes the session was saved from
+		char pid_text[1024] = "";
+		for (unsigned p = 0; p < session.n_processes; ++p) {
+			size_t len = strlen(pid_text);
+			snprintf(pid_text + len, sizeof pid_text - len, "%s%lld", p ? "," : "", (long long)session.processes[p].pid);
+		}
+		gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(builder, "pid")), pid_text);
+		select_pid(NULL, state);
+		if (!state->pid) {
+			session_free(&session);
+			return;
+		}
+	}
+	if (state->n_pids != session.n_processes) {
+		display_error(state, "The session is for %u processes, but %u are selected.", session.n_processes, state->n_pids);
+		session_free(&session);
+		return;
+	}
+	
+	// restore the search settings
+	int n_types = 0;
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+		if (session.processes[0].search_candidates[t])
+			++n_types;
+	{
+		char id[32];
+		sprintf(id, "type-%s", data_type_name(session.data_type));
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, id)), 1);
+	}
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder,
+		session.search_type == SEARCH_SAME_DIFFERENT ? "same-different" : "enter-value")), 1);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "unaligned")), session.unaligned);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "all-types")), n_types > 1);
+	{
+		char text[64];
+		if (session.tolerance.relative)
+			snprintf(text, sizeof text, "%g%%", session.tolerance.amount * 100);
+		else
+			snprintf(text, sizeof text, "%g", session.tolerance.amount);
+		gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(builder, "float-tolerance")), text);
+	}
+	gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(builder, "protection")), session.protection);
+	update_configuration(NULL, state);
+	
+	state->search_unaligned = session.unaligned;
+	state->float_tolerance = session.tolerance;
+	// the candidates are positions in the maps at the time the session was saved, so the processes keep those maps.
+	// they're matched up with the selected processes in order (their PIDs change if they've been restarted).
+	state->processes = session.processes;
+	state->n_processes = session.n_processes;
+	for (unsigned p = 0; p < state->n_processes; ++p) {
+		state->processes[p].pid = state->pids[p];
+		process_read_map_names(state, &state->processes[p]);
+	}
+	session.processes = NULL;
+	session.n_processes = 0;
+	search_calibrate(state);
+	search_show(state, n_types > 1, session.steps_completed);
+	session_free(&session);
+	update_configuration(NULL, state);
+	update_candidates(state);
+	update_memory_view(state, true);
+}
+
 static void on_activate(GtkApplication *app, gpointer user_data) {
 	char const *glade_file = "ui.glade";
 	if (access(glade_file, F_OK) != 0) {
@@ -748,17 +2279,34 @@ static void on_activate(GtkApplication *app, gpointer user_data) {
 	gtk_window_set_application(window, app);
 	update_configuration(NULL, state);
 	
-	g_timeout_add(200, frame_callback, state);
+	g_timeout_add(100, frame_callback, state);
 	
 	gtk_widget_show_all(GTK_WIDGET(window));
 }
 
 int main(int argc, char **argv) {
+	if (argc == 3 && strcmp(argv[1], "--agent") == 0)
+		return agent_main(argv[2]);
 	GtkApplication *app = gtk_application_new("com.pommicket.pokemem", G_APPLICATION_FLAGS_NONE);
 	State state = {0};
 	state.editing_memory = -1;
+	g_mutex_init(&state.agent_mutex);
 	g_signal_connect(app, "activate", G_CALLBACK(on_activate), &state);
 	int status = g_application_run(G_APPLICATION(app), argc, argv);
+	if (state.search_pass) {
+		// we quit in the middle of a step -- make sure the processes don't stay stopped
+		SearchPass *pass = state.search_pass;
+		search_finish_early(NULL, &state);
+		g_thread_pool_free(pass->pool, false, true);
+		state.search_pass = NULL;
+		for (unsigned p = 0; p < pass->n_jobs; ++p)
+			if (pass->jobs[p].reader)
+				memory_reader_close(&state, pass->jobs[p].proc->pid, pass->jobs[p].reader);
+	}
+	export_stop(&state, false);
+	profile_stop(&state);
+	for (int i = 0; i < SOURCE_MAX; ++i)
+		source_close(-1 - i);
 	g_object_unref(app);
 	return status;
 }
@@ -1,10 +1,24 @@
 // low-level stuff for reading/writing the memory of another process
 
+static void memory_view_readers_close(State *state) {
+	if (state->view_readers) {
+		for (unsigned p = 0; p < state->n_pids; ++p)
+			if (state->view_readers[p] > 0)
+				close(state->view_readers[p]);
+		free(state->view_readers);
+		state->view_readers = NULL;
+	}
+}
+
 static void close_process(State *state, char const *reason) {
 	GtkBuilder *builder = state->builder;
+	memory_view_readers_close(state);
 	free(state->maps); state->maps = NULL;
 	state->nmaps = 0;
 	state->pid = 0;
+	free(state->pids); state->pids = NULL;
+	state->n_pids = 0;
+	free(state->view_rows); state->view_rows = NULL;
 	{
 		GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "memory"));
 		gtk_list_store_clear(store);
@@ -15,20 +29,48 @@ static void close_process(State *state, char const *reason) {
 		display_info_nofmt(state, "Can't access process anymore.");
 }
 
+// couldn't access one of the selected processes other than state->pid
+static void close_other_process(State *state, PID pid, char const *reason) {
+	display_info(state, "Can't access process %lld anymore: %s", (long long)pid, reason);
+}
+
+// should the process be stopped each time its memory is accessed?
+// (while a search step or an export is running, it decides when the processes are stopped)
+static bool memory_stop_each_access(State const *state) {
+	return state->stop_while_accessing_memory && !state->search_pass && !state->export;
+}
+
 // don't use this function; use one of the ones below
-static int memory_open(State *state, int flags) {
-	if (state->pid) {
-		if (state->stop_while_accessing_memory) {
-			if (kill(state->pid, SIGSTOP) == -1) {
-				close_process(state, strerror(errno));
+static int memory_open(State *state, PID pid, int flags) {
+	if (pid < 0) {
+		// a memory file or core dump (see source.c), which is its own reader
+		if (flags != O_RDONLY) {
+			display_error_nofmt(state, "Memory files and core dumps can't be written to.");
+			return 0;
+		}
+		return source_get(pid) ? pid : 0;
+	}
+	if (pid) {
+		if (memory_stop_each_access(state)) {
+			if (agent_kill(state, pid, SIGSTOP) == -1) {
+				if (pid == state->pid)
+					close_process(state, strerror(errno));
+				else
+					close_other_process(state, pid, strerror(errno));
 				return 0;
 			}
 		}
-		char name[64];
-		sprintf(name, "/proc/%lld/mem", (long long)state->pid);
-		int fd = open(name, flags);
+		int fd = agent_open_memory(state, pid, flags);
 		if (fd == -1) {
-			close_process(state, strerror(errno));
+			if (flags != O_RDONLY && errno == EPERM) {
+				// the process can still be read (e.g. the agent only lets its user write to their own processes)
+				display_error(state, "Can't write to process %lld: %s", (long long)pid, strerror(errno));
+			} else if (pid == state->pid)
+				close_process(state, strerror(errno));
+			else
+				close_other_process(state, pid, strerror(errno));
+			if (memory_stop_each_access(state))
+				agent_kill(state, pid, SIGCONT);
 			return 0;
 		}
 		return fd;
@@ -36,52 +78,337 @@ static int memory_open(State *state, int flags) {
 	return 0;
 }
 
-static void memory_close(State *state, int fd) {
-	if (state->stop_while_accessing_memory) {
-		kill(state->pid, SIGCONT);
+static void memory_close(State *state, PID pid, int fd) {
+	if (memory_stop_each_access(state)) {
+		agent_kill(state, pid, SIGCONT);
 	}
-	if (fd) close(fd);
+	if (fd > 0) close(fd);
 }
 
 	
-// get a file descriptor for reading memory from the process
+// get a file descriptor for reading memory from process pid (usually state->pid)
+// (or for a memory source, its PID -- the reading functions below check for that)
 // returns 0 on failure
-static int memory_reader_open(State *state) {
-	return memory_open(state, O_RDONLY);
+static int memory_reader_open(State *state, PID pid) {
+	return memory_open(state, pid, O_RDONLY);
 }
 
-static void memory_reader_close(State *state, int reader) {
-	memory_close(state, reader);
+static void memory_reader_close(State *state, PID pid, int reader) {
+	memory_close(state, pid, reader);
+}
+
+// let the process continue before the reader is closed (if it was stopped)
+// (this can be called from any thread)
+static void memory_reader_resume(State const *state, PID pid) {
+	if (state->stop_while_accessing_memory) {
+		agent_kill(state, pid, SIGCONT);
+	}
 }
 
 // like memory_reader_open, but for writing to memory
-static int memory_writer_open(State *state) {
-	return memory_open(state, O_WRONLY);
+static int memory_writer_open(State *state, PID pid) {
+	return memory_open(state, pid, O_WRONLY);
+}
+
+static void memory_writer_close(State *state, PID pid, int writer) {
+	memory_close(state, pid, writer);
 }
 
-static void memory_writer_close(State *state, int writer) {
-	memory_close(state, writer);
+// get a reader for process #p of state->pids which is kept open between auto-refreshes of the
+// memory view (until memory_view_readers_close). unlike memory_reader_open, this doesn't stop the
+// process -- use memory_view_reader_stop/continue around reads.
+// returns 0 on failure (and doesn't try again until the readers are closed)
+static int memory_view_reader(State *state, unsigned p) {
+	if (!state->view_readers) {
+		state->view_readers = calloc(state->n_pids, sizeof *state->view_readers);
+		if (!state->view_readers) return 0;
+	}
+	if (state->pids[p] < 0)
+		return source_get(state->pids[p]) ? state->pids[p] : 0;
+	if (!state->view_readers[p]) {
+		PID pid = state->pids[p];
+		int fd = agent_open_memory(state, pid, O_RDONLY);
+		if (fd == -1) {
+			state->view_readers[p] = -1;
+			if (pid == state->pid)
+				close_process(state, strerror(errno));
+			else
+				close_other_process(state, pid, strerror(errno));
+			return 0;
+		}
+		state->view_readers[p] = fd;
+	}
+	return state->view_readers[p] > 0 ? state->view_readers[p] : 0;
+}
+
+// stop the process before reading with a memory_view_reader (if that's turned on)
+static void memory_view_reader_stop(State *state, PID pid) {
+	if (memory_stop_each_access(state))
+		agent_kill(state, pid, SIGSTOP);
+}
+
+static void memory_view_reader_continue(State *state, PID pid) {
+	if (memory_stop_each_access(state))
+		agent_kill(state, pid, SIGCONT);
 }
 
+// (these use pread so that they're safe to use from multiple threads at once)
 static uint8_t memory_read_byte(int reader, Address addr) {
-	lseek(reader, (off_t)addr, SEEK_SET);
 	uint8_t byte = 0;
-	read(reader, &byte, 1);
+	if (reader < 0)
+		source_read(reader, addr, &byte, 1);
+	else
+		pread(reader, &byte, 1, (off_t)addr);
 	return byte;
 }
 
 // returns number of bytes successfully read
 static Address memory_read_bytes(int reader, Address addr, uint8_t *memory, Address nbytes) {
-	lseek(reader, (off_t)addr, SEEK_SET);
+	if (reader < 0)
+		return source_read(reader, addr, memory, nbytes);
 	Address idx = 0;
 	while (idx < nbytes) {
-		ssize_t n = read(reader, &memory[idx], (size_t)(nbytes - idx));
+		ssize_t n = pread(reader, &memory[idx], (size_t)(nbytes - idx), (off_t)(addr + idx));
 		if (n <= 0) { break; }
 		idx += (Address)n;
 	}
 	return idx;
 }
 
+// read memory, zeroing the pages which can't be read
+static void memory_read_zeroed(int reader, Address addr, uint8_t *memory, Address nbytes) {
+	memset(memory, 0, nbytes);
+	Address done = 0;
+	while (done < nbytes) {
+		done += memory_read_bytes(reader, addr + done, memory + done, nbytes - done);
+		if (done < nbytes) {
+			// skip over the page we couldn't read
+			done = (addr + done + 4096) / 4096 * 4096 - addr;
+		}
+	}
+}
+
+// limits for ReadTuning.run_max
+#define READ_RUN_MIN (64 * 1024)
+#define READ_RUN_LIMIT (4 * 1024 * 1024)
+static ReadTuning const read_tuning_default = {256 * 1024, 0};
+
+// the ReadTuning to use for reading state's processes
+static ReadTuning read_tuning(State const *state) {
+	return state->read_tuning.run_max ? state->read_tuning : read_tuning_default;
+}
+
+// average time for a read, in microseconds
+static double read_time(int reader, Address addr, uint8_t *buffer, size_t nbytes, int times) {
+	gint64 start = g_get_monotonic_time();
+	for (int i = 0; i < times; ++i)
+		memory_read_bytes(reader, addr, buffer, nbytes);
+	return (double)(g_get_monotonic_time() - start) / times;
+}
+
+// time some reads of the process's memory, to figure out how much to read at once.
+// each read takes about (fixed cost) + (bytes read) / (bandwidth):
+// reading over a gap is worth it if that takes less than the fixed cost, and runs are made
+// big enough that the fixed cost is only a small part of the time spent reading.
+static void read_tuning_calibrate(State *state, int reader, Map const *maps, unsigned nmaps) {
+	// time reads from the biggest map (up to 1MB of it)
+	Map const *map = NULL;
+	for (unsigned m = 0; m < nmaps; ++m)
+		if (!map || maps[m].size > map->size)
+			map = &maps[m];
+	if (!map || map->size < READ_RUN_MIN) return;
+	size_t big = map->size < (1 << 20) ? (size_t)map->size : (1 << 20);
+	uint8_t *buffer = malloc(big);
+	if (!buffer) return;
+	if (memory_read_bytes(reader, map->lo, buffer, big) == big) { // (this also gets the pages ready)
+		// (take the best of a few tries, since something else could get in the way)
+		double small_time = INFINITY, big_time = INFINITY;
+		for (int i = 0; i < 3; ++i) {
+			small_time = fmin(small_time, read_time(reader, map->lo, buffer, 4096, 16));
+			big_time = fmin(big_time, read_time(reader, map->lo, buffer, big, 1));
+		}
+		double bandwidth = (double)(big - 4096) / (big_time - small_time); // bytes per microsecond
+		double fixed_cost = small_time - 4096 / bandwidth;
+		if (big_time > small_time && fixed_cost > 0) {
+			double gap_max = fixed_cost * bandwidth;
+			if (gap_max > 1 << 20) gap_max = 1 << 20;
+			ReadTuning *tuning = &state->read_tuning;
+			tuning->gap_max = (size_t)gap_max / 4096 * 4096;
+			tuning->run_max = READ_RUN_MIN;
+			while ((double)tuning->run_max < 32 * gap_max && tuning->run_max < READ_RUN_LIMIT)
+				tuning->run_max *= 2;
+		}
+	}
+	free(buffer);
+}
+
+// Reading ahead: a thread reads a list of requests into a ring of buffers, so that
+// the next reads happen while the main thread is working on the memory from the last one.
+// In snapshot mode, everything is read up front instead, so the process can be
+// stopped for as short a time as possible.
+#define READ_AHEAD_SLOTS 3
+typedef struct {
+	Address addr;
+	size_t size;
+	size_t buffer_size; // size of the buffer the memory goes in
+	size_t buffer_offset; // where in the buffer to put the memory
+} ReadRequest;
+
+typedef struct {
+	int reader;
+	ReadRequest const *requests;
+	size_t n_requests;
+	bool snapshot;
+	uint8_t *buffers[READ_AHEAD_SLOTS]; // not used in snapshot mode
+	uint8_t *snapshot_memory; // all of the buffers, one after another (snapshot mode only)
+	size_t *snapshot_offsets; // offset of each request's buffer in snapshot_memory
+	GThread *thread; // NULL if we're just reading on the main thread
+	GMutex mutex;
+	GCond cond;
+	// these are protected by mutex
+	size_t n_read; // number of requests which have been read
+	size_t n_released; // number of requests the main thread is done with
+	bool cancel;
+} ReadAhead;
+
+static uint8_t *read_ahead_buffer(ReadAhead *ra, size_t i) {
+	if (ra->snapshot)
+		return ra->snapshot_memory + ra->snapshot_offsets[i];
+	else
+		return ra->buffers[i % READ_AHEAD_SLOTS];
+}
+
+// read a request into its buffer. memory which can't be read is zeroed.
+static void read_ahead_do(ReadAhead *ra, size_t i) {
+	ReadRequest const *request = &ra->requests[i];
+	uint8_t *buffer = read_ahead_buffer(ra, i);
+	memset(buffer, 0, request->buffer_offset);
+	memset(buffer + request->buffer_offset + request->size, 0, request->buffer_size - request->buffer_offset - request->size);
+	memory_read_zeroed(ra->reader, request->addr, buffer + request->buffer_offset, request->size);
+}
+
+static gpointer read_ahead_thread(gpointer user_data) {
+	ReadAhead *ra = user_data;
+	for (size_t i = 0; i < ra->n_requests; ++i) {
+		g_mutex_lock(&ra->mutex);
+		// wait for a free buffer
+		while (i - ra->n_released >= READ_AHEAD_SLOTS && !ra->cancel)
+			g_cond_wait(&ra->cond, &ra->mutex);
+		bool cancel = ra->cancel;
+		g_mutex_unlock(&ra->mutex);
+		if (cancel) break;
+		read_ahead_do(ra, i);
+		g_mutex_lock(&ra->mutex);
+		ra->n_read = i + 1;
+		g_cond_broadcast(&ra->cond);
+		g_mutex_unlock(&ra->mutex);
+	}
+	return NULL;
+}
+
+// start reading requests (which should stay valid until read_ahead_stop).
+// if snapshot is true, this tries to read all of them before returning (check ra->snapshot
+// to see if it did -- if there isn't enough memory for that, the requests are read ahead as usual).
+// returns false if there isn't enough memory.
+static bool read_ahead_start(ReadAhead *ra, int reader, ReadRequest const *requests, size_t n_requests, bool snapshot) {
+	memset(ra, 0, sizeof *ra);
+	ra->reader = reader;
+	ra->requests = requests;
+	ra->n_requests = n_requests;
+	g_mutex_init(&ra->mutex);
+	g_cond_init(&ra->cond);
+	// (memory sources don't change, and reading them is just copying, so don't bother with any of that)
+	bool source = reader < 0;
+	if (source) snapshot = false;
+	
+	if (snapshot) {
+		size_t total_size = 0;
+		ra->snapshot_offsets = calloc(n_requests + 1, sizeof *ra->snapshot_offsets);
+		if (ra->snapshot_offsets) {
+			for (size_t i = 0; i < n_requests; ++i) {
+				ra->snapshot_offsets[i] = total_size;
+				total_size += (requests[i].buffer_size + 7) / 8 * 8; // keep buffers aligned
+			}
+			ra->snapshot_memory = malloc(total_size + 1);
+		}
+		if (ra->snapshot_memory) {
+			ra->snapshot = true;
+			for (size_t i = 0; i < n_requests; ++i)
+				read_ahead_do(ra, i);
+			ra->n_read = n_requests;
+			return true;
+		}
+		free(ra->snapshot_offsets);
+		ra->snapshot_offsets = NULL;
+	}
+	
+	size_t buffer_size = 0;
+	for (size_t i = 0; i < n_requests; ++i)
+		if (requests[i].buffer_size > buffer_size)
+			buffer_size = requests[i].buffer_size;
+	for (int i = 0; i < READ_AHEAD_SLOTS; ++i) {
+		ra->buffers[i] = malloc(buffer_size + 1);
+		if (!ra->buffers[i]) {
+			for (int j = 0; j < i; ++j) free(ra->buffers[j]);
+			g_cond_clear(&ra->cond);
+			g_mutex_clear(&ra->mutex);
+			return false;
+		}
+	}
+	if (n_requests > 1 && !source) {
+		GError *error = NULL;
+		ra->thread = g_thread_try_new("read-ahead", read_ahead_thread, ra, &error);
+		// if that failed, we'll just read everything on the main thread
+		g_clear_error(&error);
+	}
+	return true;
+}
+
+// wait for request #i to be read, and get its buffer.
+// this has to be called for each request in order, with read_ahead_release called in between.
+static uint8_t const *read_ahead_get(ReadAhead *ra, size_t i) {
+	if (ra->reader < 0) {
+		// memory sources are already in memory, so use that if the request is in one piece
+		ReadRequest const *request = &ra->requests[i];
+		uint8_t const *memory = source_pointer(ra->reader, request->addr, request->size);
+		if (memory) return memory - request->buffer_offset;
+	}
+	if (ra->thread) {
+		g_mutex_lock(&ra->mutex);
+		while (ra->n_read <= i)
+			g_cond_wait(&ra->cond, &ra->mutex);
+		g_mutex_unlock(&ra->mutex);
+	} else if (!ra->snapshot) {
+		read_ahead_do(ra, i);
+	}
+	return read_ahead_buffer(ra, i);
+}
+
+// we're done with request #i; its buffer can be reused.
+static void read_ahead_release(ReadAhead *ra, size_t i) {
+	g_mutex_lock(&ra->mutex);
+	ra->n_released = i + 1;
+	g_cond_broadcast(&ra->cond);
+	g_mutex_unlock(&ra->mutex);
+}
+
+static void read_ahead_stop(ReadAhead *ra) {
+	if (ra->thread) {
+		g_mutex_lock(&ra->mutex);
+		ra->cancel = true;
+		g_cond_broadcast(&ra->cond);
+		g_mutex_unlock(&ra->mutex);
+		g_thread_join(ra->thread);
+	}
+	g_cond_clear(&ra->cond);
+	g_mutex_clear(&ra->mutex);
+	for (int i = 0; i < READ_AHEAD_SLOTS; ++i)
+		free(ra->buffers[i]);
+	free(ra->snapshot_memory);
+	free(ra->snapshot_offsets);
+	memset(ra, 0, sizeof *ra);
+}
+
 // returns # of bytes written (so either 0 or 1)
 static Address memory_write_byte(int writer, Address addr, uint8_t byte) {
 	lseek(writer, (off_t)addr, SEEK_SET);
@@ -103,11 +430,341 @@ static Address memory_write_bytes(int writer, Address addr, uint8_t const *bytes
 	return idx;
 }
 
+// most writes which are passed to process_vm_readv/writev at once (IOV_MAX on Linux)
+#define JOURNAL_CHUNK_WRITES 1024
+// a JournalBatch is written once it has this many bytes
+#define JOURNAL_BATCH_MAX_BYTES ((size_t)16 << 20)
+
+// in Journal.fp, each operation is a series of chunks: a JournalChunk, then n_writes JournalEntry's,
+// each followed by the old bytes and then the new bytes.
+typedef struct {
+	PID pid;
+	uint32_t n_writes;
+} JournalChunk;
+
+typedef struct {
+	Address addr;
+	uint64_t size;
+} JournalEntry;
+
+typedef struct {
+	Address addr;
+	size_t size;
+	size_t offset; // where the bytes are in JournalBatch.data
+} JournalWrite;
+
+// writes which haven't been made yet (see journal_add)
+typedef struct {
+	PID pid;
+	JournalWrite *writes;
+	size_t n_writes, writes_cap;
+	uint8_t *data;
+	size_t data_size, data_cap;
+	bool out_of_memory;
+} JournalBatch;
+
+// update the undo button
+static void journal_show(State *state) {
+	Journal *journal = &state->journal;
+	GtkWidget *undo = GTK_WIDGET(gtk_builder_get_object(state->builder, "undo"));
+	if (journal->n_ops) {
+		JournalOp const *op = &journal->ops[journal->n_ops - 1];
+		char tooltip[128];
+		snprintf(tooltip, sizeof tooltip, "Undo %s (%" PRIdADDR " write%s). Ctrl+Z in the memory view does this too.",
+			op->what, op->n_writes, op->n_writes == 1 ? "" : "s");
+		gtk_widget_set_tooltip_text(undo, tooltip);
+	}
+	gtk_widget_set_sensitive(undo, journal->n_ops != 0);
+}
+
+static void journal_clear(State *state) {
+	Journal *journal = &state->journal;
+	if (journal->fp) fclose(journal->fp);
+	free(journal->ops);
+	memset(journal, 0, sizeof *journal);
+	journal_show(state);
+}
+
+// read (or write) the n pieces of memory in remote, using as few system calls as possible.
+// process_vm_readv/writev can't write to read-only memory, so pieces it fails on go through fd instead.
+// done[i] is set to whether all of piece #i was read/written.
+static void journal_transfer(PID pid, int fd, bool write, struct iovec *local, struct iovec *remote, size_t n, bool *done) {
+	bool vectored = true;
+	size_t i = 0;
+	while (i < n) {
+		ssize_t ret = -1;
+		if (vectored) {
+			ret = write ? process_vm_writev(pid, &local[i], n - i, &remote[i], n - i, 0)
+				: process_vm_readv(pid, &local[i], n - i, &remote[i], n - i, 0);
+			if (ret < 0 && (errno == ENOSYS || errno == EPERM))
+				vectored = false;
+		}
+		// (these calls stop at the first piece they can't do)
+		size_t nbytes = ret > 0 ? (size_t)ret : 0;
+		while (i < n && nbytes >= local[i].iov_len) {
+			nbytes -= local[i].iov_len;
+			done[i++] = true;
+		}
+		if (i < n) {
+			size_t len = local[i].iov_len;
+			off_t offset = (off_t)(uintptr_t)remote[i].iov_base;
+			ssize_t n_transferred = write ? pwrite(fd, local[i].iov_base, len, offset) : pread(fd, local[i].iov_base, len, offset);
+			done[i] = n_transferred == (ssize_t)len;
+			++i;
+		}
+	}
+}
+
+// make the writes in batch, recording them in the journal
+static void journal_flush(State *state, JournalBatch *batch) {
+	Journal *journal = &state->journal;
+	if (!batch->n_writes) return;
+	JournalOp *op = &journal->ops[journal->n_ops - 1];
+	PID pid = batch->pid;
+	uint8_t *old = malloc(batch->data_size);
+	int fd = old ? memory_open(state, pid, O_RDWR) : 0;
+	if (!old) batch->out_of_memory = true;
+	if (fd) {
+		static struct iovec local[JOURNAL_CHUNK_WRITES], remote[JOURNAL_CHUNK_WRITES];
+		static size_t index[JOURNAL_CHUNK_WRITES];
+		static bool done[JOURNAL_CHUNK_WRITES];
+		for (size_t start = 0; start < batch->n_writes; start += JOURNAL_CHUNK_WRITES) {
+			size_t n = batch->n_writes - start;
+			if (n > JOURNAL_CHUNK_WRITES) n = JOURNAL_CHUNK_WRITES;
+			JournalWrite const *writes = &batch->writes[start];
+			// read the old bytes, all at once
+			for (size_t i = 0; i < n; ++i) {
+				local[i].iov_base = &old[writes[i].offset];
+				local[i].iov_len = remote[i].iov_len = writes[i].size;
+				remote[i].iov_base = (void *)(uintptr_t)writes[i].addr;
+			}
+			memset(done, 0, n * sizeof *done);
+			journal_transfer(pid, fd, false, local, remote, n, done);
+			// write the new bytes (where the old ones could be read)
+			size_t n_write = 0;
+			for (size_t i = 0; i < n; ++i) {
+				if (done[i]) {
+					local[n_write].iov_base = &batch->data[writes[i].offset];
+					local[n_write].iov_len = remote[n_write].iov_len = writes[i].size;
+					remote[n_write].iov_base = (void *)(uintptr_t)writes[i].addr;
+					index[n_write++] = i;
+				}
+			}
+			memset(done, 0, n_write * sizeof *done);
+			journal_transfer(pid, fd, true, local, remote, n_write, done);
+			// record the writes that were made
+			JournalChunk chunk = {pid, 0};
+			for (size_t i = 0; i < n_write; ++i)
+				chunk.n_writes += done[i];
+			if (chunk.n_writes) {
+				fwrite(&chunk, sizeof chunk, 1, journal->fp);
+				for (size_t i = 0; i < n_write; ++i) {
+					if (!done[i]) continue;
+					JournalWrite const *w = &writes[index[i]];
+					JournalEntry entry = {w->addr, w->size};
+					fwrite(&entry, sizeof entry, 1, journal->fp);
+					fwrite(&old[w->offset], 1, w->size, journal->fp);
+					fwrite(&batch->data[w->offset], 1, w->size, journal->fp);
+				}
+				op->n_writes += chunk.n_writes;
+			}
+		}
+		memory_close(state, pid, fd);
+	}
+	free(old);
+	batch->n_writes = 0;
+	batch->data_size = 0;
+}
+
+// start an operation which can be undone as a whole. returns false (after showing an error) on failure.
+// what is a description of the operation, like "set all".
+static bool journal_begin(State *state, JournalBatch *batch, char const *what) {
+	Journal *journal = &state->journal;
+	memset(batch, 0, sizeof *batch);
+	if (state->pid < 0) {
+		display_error_nofmt(state, "Memory files and core dumps can't be written to.");
+		return false;
+	}
+	if (!journal->fp) {
+		journal->fp = tmpfile();
+		if (!journal->fp) {
+			display_error(state, "Couldn't create a file to undo writes with: %s.", strerror(errno));
+			return false;
+		}
+	}
+	JournalOp *ops = realloc(journal->ops, (journal->n_ops + 1) * sizeof *ops);
+	if (!ops) {
+		display_error_nofmt(state, "Out of memory.");
+		return false;
+	}
+	journal->ops = ops;
+	JournalOp *op = &ops[journal->n_ops++];
+	memset(op, 0, sizeof *op);
+	fseeko(journal->fp, 0, SEEK_END);
+	op->start = ftello(journal->fp);
+	snprintf(op->what, sizeof op->what, "%s", what);
+	return true;
+}
+
+// write size bytes to addr in process pid (the write is actually made by journal_flush/journal_end)
+static void journal_add(State *state, JournalBatch *batch, PID pid, Address addr, void const *bytes, size_t size) {
+	if (pid != batch->pid) {
+		journal_flush(state, batch);
+		batch->pid = pid;
+	}
+	if (batch->n_writes >= batch->writes_cap) {
+		size_t cap = batch->writes_cap * 2 + 64;
+		JournalWrite *writes = realloc(batch->writes, cap * sizeof *writes);
+		if (!writes) {
+			batch->out_of_memory = true;
+			return;
+		}
+		batch->writes = writes;
+		batch->writes_cap = cap;
+	}
+	if (batch->data_size + size > batch->data_cap) {
+		size_t cap = batch->data_cap * 2 + size + 4096;
+		uint8_t *data = realloc(batch->data, cap);
+		if (!data) {
+			batch->out_of_memory = true;
+			return;
+		}
+		batch->data = data;
+		batch->data_cap = cap;
+	}
+	JournalWrite *w = &batch->writes[batch->n_writes++];
+	w->addr = addr;
+	w->size = size;
+	w->offset = batch->data_size;
+	memcpy(&batch->data[batch->data_size], bytes, size);
+	batch->data_size += size;
+	if (batch->data_size >= JOURNAL_BATCH_MAX_BYTES)
+		journal_flush(state, batch);
+}
+
+// finish the operation started by journal_begin. returns the number of writes which were made.
+static Address journal_end(State *state, JournalBatch *batch) {
+	Journal *journal = &state->journal;
+	journal_flush(state, batch);
+	free(batch->writes);
+	free(batch->data);
+	if (batch->out_of_memory)
+		display_error_nofmt(state, "Out of memory.");
+	JournalOp *op = &journal->ops[journal->n_ops - 1];
+	Address n_writes = op->n_writes;
+	if (!n_writes)
+		--journal->n_ops;
+	if (fflush(journal->fp) != 0 || ferror(journal->fp)) {
+		// we don't know which writes were recorded anymore
+		display_error(state, "Couldn't record writes to undo them later: %s.", strerror(errno));
+		journal_clear(state);
+	}
+	journal_show(state);
+	return n_writes;
+}
+
+// undo the last operation in the journal
+static void journal_undo(State *state) {
+	Journal *journal = &state->journal;
+	if (!journal->n_ops) return;
+	JournalOp const *op = &journal->ops[journal->n_ops - 1];
+	FILE *fp = journal->fp;
+	// find where each chunk of the operation starts (chunks[n_chunks] is the end of the last one)
+	off_t *chunks = NULL;
+	size_t n_chunks = 0;
+	bool bad = fflush(fp) != 0 || fseeko(fp, op->start, SEEK_SET) != 0;
+	while (!bad) {
+		off_t *new_chunks = realloc(chunks, (n_chunks + 1) * sizeof *chunks);
+		if (!new_chunks) {
+			bad = true;
+			break;
+		}
+		chunks = new_chunks;
+		chunks[n_chunks] = ftello(fp);
+		JournalChunk chunk = {0};
+		if (fread(&chunk, sizeof chunk, 1, fp) != 1) break;
+		for (uint32_t i = 0; i < chunk.n_writes && !bad; ++i) {
+			JournalEntry entry = {0};
+			bad = fread(&entry, sizeof entry, 1, fp) != 1
+				|| fseeko(fp, (off_t)(2 * entry.size), SEEK_CUR) != 0;
+		}
+		++n_chunks;
+	}
+	// put the old bytes back, starting with the last chunk (the bytes written by a later chunk
+	// might have been written by an earlier one too)
+	Address n_failed = 0;
+	PID fd_pid = 0;
+	int fd = 0;
+	uint8_t *data = NULL;
+	size_t data_cap = 0;
+	for (size_t c = n_chunks; c-- > 0 && !bad; ) {
+		static struct iovec local[JOURNAL_CHUNK_WRITES], remote[JOURNAL_CHUNK_WRITES];
+		static bool done[JOURNAL_CHUNK_WRITES];
+		JournalChunk chunk = {0};
+		fseeko(fp, chunks[c], SEEK_SET);
+		if (fread(&chunk, sizeof chunk, 1, fp) != 1 || chunk.n_writes > JOURNAL_CHUNK_WRITES) {
+			bad = true;
+			break;
+		}
+		size_t size = (size_t)(chunks[c + 1] - chunks[c]) - sizeof chunk; // size of the entries
+		if (size > data_cap) {
+			free(data);
+			data_cap = size;
+			data = malloc(data_cap);
+			if (!data) {
+				bad = true;
+				break;
+			}
+		}
+		if (fread(data, 1, size, fp) != size) {
+			bad = true;
+			break;
+		}
+		size_t pos = 0;
+		for (uint32_t i = 0; i < chunk.n_writes; ++i) {
+			JournalEntry entry;
+			memcpy(&entry, &data[pos], sizeof entry);
+			pos += sizeof entry;
+			local[i].iov_base = &data[pos];
+			local[i].iov_len = remote[i].iov_len = (size_t)entry.size;
+			remote[i].iov_base = (void *)(uintptr_t)entry.addr;
+			pos += 2 * (size_t)entry.size;
+		}
+		if (chunk.pid != fd_pid) {
+			if (fd) memory_close(state, fd_pid, fd);
+			fd_pid = chunk.pid;
+			fd = memory_open(state, fd_pid, O_WRONLY);
+		}
+		memset(done, 0, chunk.n_writes * sizeof *done);
+		if (fd) journal_transfer(chunk.pid, fd, true, local, remote, chunk.n_writes, done);
+		for (uint32_t i = 0; i < chunk.n_writes; ++i)
+			n_failed += !done[i];
+	}
+	if (fd) memory_close(state, fd_pid, fd);
+	free(data);
+	free(chunks);
+	if (bad) {
+		display_error_nofmt(state, "Couldn't read the writes to undo.");
+		journal_clear(state);
+		return;
+	}
+	if (n_failed)
+		display_error(state, "Couldn't undo %" PRIdADDR " of the %" PRIdADDR " writes.", n_failed, op->n_writes);
+	// remove the operation from the end of the journal
+	if (ftruncate(fileno(fp), op->start) != 0) {
+		display_error(state, "Couldn't update the writes to undo: %s.", strerror(errno));
+		journal_clear(state);
+		return;
+	}
+	fseeko(fp, 0, SEEK_END);
+	--journal->n_ops;
+	journal_show(state);
+}
+
 typedef struct {
 	FILE *fp;
 	Address curr_addr;
 } MemfileWriter;
-static char const MEMFILE_IDENT[4] = {'\xff', 'M', 'E', 'M'};
 
 static bool memfile_writer_open(State *state, MemfileWriter *writer, char const *filename) {
 	memset(writer, 0, sizeof *writer);
@@ -127,8 +784,8 @@ static void memfile_writer_close(MemfileWriter *writer) {
 }
 
 
-// write up to 64K of consecutive memory.
-static void memfile_write_bytes(MemfileWriter *writer, Address addr, uint8_t const *data, size_t nbytes) {
+// start writing nbytes of consecutive memory at addr. they should be written with fwrite right after this.
+static void memfile_write_header(MemfileWriter *writer, Address addr, size_t nbytes) {
 	Address addr_increment = addr - writer->curr_addr;
 	// set address
 	if (addr_increment < 64) {
@@ -150,11 +807,15 @@ static void memfile_write_bytes(MemfileWriter *writer, Address addr, uint8_t con
 		putc(0xE0, writer->fp);
 		fwrite(&nbytes, sizeof nbytes, 1, writer->fp);
 	}
-	fwrite(data, 1, nbytes, writer->fp);
-	
 	writer->curr_addr = addr + nbytes;
 }
 
+// write consecutive memory.
+static void memfile_write_bytes(MemfileWriter *writer, Address addr, uint8_t const *data, size_t nbytes) {
+	memfile_write_header(writer, addr, nbytes);
+	fwrite(data, 1, nbytes, writer->fp);
+}
+
 static void memfile_write_byte(MemfileWriter *writer, Address addr, uint8_t byte) {
 	memfile_write_bytes(writer, addr, &byte, 1);
 }
@@ -163,54 +824,59 @@ static void memfile_write_all(State *state, char const *filename) {
 	if (!state->pid) return;
 	MemfileWriter writer = {0};
 	if (memfile_writer_open(state, &writer, filename)) {
-		int reader = memory_reader_open(state);
+		size_t chunk_size = read_tuning(state).run_max;
+		uint8_t *chunk = malloc(chunk_size);
+		int reader = chunk ? memory_reader_open(state, state->pid) : 0;
 		if (reader) {
 			for (unsigned m = 0; m < state->nmaps; ++m) {
 				Map *map = &state->maps[m];
-				uint8_t chunk[4096] = {0}; // page size is probably a multiple of 4096.
-				for (Address offset = 0; offset < map->size; offset += sizeof chunk) {
+				// (each map is written in one piece, so that it can be searched straight from the file -- see source.c)
+				memfile_write_header(&writer, map->lo, (size_t)map->size);
+				for (Address offset = 0; offset < map->size; offset += chunk_size) {
 					Address addr = map->lo + offset;
-					memory_read_bytes(reader, addr, chunk, sizeof chunk);
-					memfile_write_bytes(&writer, addr, chunk, sizeof chunk);
+					size_t nbytes = chunk_size;
+					if (nbytes > map->size - offset) nbytes = (size_t)(map->size - offset);
+					memory_read_zeroed(reader, addr, chunk, nbytes);
+					fwrite(chunk, 1, nbytes, writer.fp);
 				}
 			}
-			memory_reader_close(state, reader);
+			memory_reader_close(state, state->pid, reader);
+		} else if (!chunk) {
+			display_error_nofmt(state, "Not enough memory available.");
 		}
+		free(chunk);
 		memfile_writer_close(&writer);
 	}
 }
 
+// (memory files don't say which process memory is from, so this only saves the candidates in state->pid)
 static void memfile_write_candidates(State *state, char const *filename) {
-	if (!state->pid) return;
+	if (!state->pid || !searching_for(state, state->data_type)) return;
+	Process const *proc = &state->processes[0];
 	size_t item_size = data_type_size(state->data_type);
+	size_t stride = search_stride(state, state->data_type);
 	MemfileWriter writer = {0};
 	if (memfile_writer_open(state, &writer, filename)) {
-		int reader = memory_reader_open(state);
+		int reader = memory_reader_open(state, proc->pid);
 		if (reader) {
-			Address bitset_index = 0;
-			uint64_t *search_candidates = state->search_candidates;
-			for (unsigned m = 0; m < state->nmaps; ++m) {
-				Map *map = &state->maps[m];
-				Address n_items = map->size / item_size;
-				for (Address i = 0; i < n_items; ) {
-					if (bitset_index % 64 == 0 && search_candidates[bitset_index / 64] == 0) {
-						// no candidates here
-						i += 64;
-						bitset_index += 64;
-					} else {
-						if (search_candidates[bitset_index / 64] & MASK64(bitset_index % 64)) {
-							// a candidate!
-							Address addr = map->lo + i * item_size;
-							uint64_t value = 0;
-							memory_read_bytes(reader, addr, (uint8_t *)&value, item_size);
-							memfile_write_bytes(&writer, addr, (uint8_t const *)&value, item_size);
-						}
-						++i;
-						++bitset_index;
-					}
+			Bitset const *search_candidates = proc->search_candidates[state->data_type];
+			Address map_base = 0; // bitset index of the start of map #m
+			unsigned m = 0;
+			for (Address bitset_index = bitset_next(search_candidates, 0);
+				bitset_index < search_candidates->n_words * 64;
+				bitset_index = bitset_next(search_candidates, bitset_index + 1)) {
+				// a candidate! find the map it's in
+				while (m < proc->nmaps && bitset_index >= map_base + proc->maps[m].size / stride) {
+					map_base += proc->maps[m].size / stride;
+					++m;
 				}
+				if (m >= proc->nmaps) break;
+				Address addr = proc->maps[m].lo + (bitset_index - map_base) * stride;
+				uint64_t value = 0;
+				memory_read_bytes(reader, addr, (uint8_t *)&value, item_size);
+				memfile_write_bytes(&writer, addr, (uint8_t const *)&value, item_size);
 			}
-			memory_reader_close(state, reader);
+			memory_reader_close(state, proc->pid, reader);
 		}
 		memfile_writer_close(&writer);
 	}
@@ -218,77 +884,23 @@ static void memfile_write_candidates(State *state, char const *filename) {
 
 static void memfile_load(State *state, char const *filename) {
 	if (!state->pid) return;
-	FILE *fp = fopen(filename, "rb");
-	if (fp) {
-		char ident[sizeof MEMFILE_IDENT] = {0};
-		fread(ident, sizeof ident, 1, fp);
-		if (memcmp(ident, MEMFILE_IDENT, sizeof MEMFILE_IDENT) != 0) {
-			display_error(state, "%s is not a memory file.", filename);
-		} else {
-			int writer = memory_writer_open(state);
-			if (writer) {
-				Address addr = 0;
-				
-				int first_byte;
-				while ((first_byte = getc(fp)) != EOF) {
-					uint64_t val = 0;
-					size_t nbytes = 0;
-					switch (first_byte & 0xE0) {
-					case 0x00:
-					case 0x20:
-						// 6 bits address increment
-						addr += first_byte & 0x3F;
-						break;
-					case 0x40:
-						// 5 bits + 1 byte address increment
-						addr += first_byte & 0x1F;
-						addr += (unsigned)getc(fp) << 5;
-						break;
-					case 0x60:
-						// constant 4/8-byte address
-						if (first_byte != 0x60)
-							goto invalid;
-						fread(&val, sizeof(Address), 1, fp);
-						addr = val;
-						break;
-					case 0x80:
-					case 0xA0:
-						// 6 bit length; data
-						nbytes = first_byte & 0x3F;
-						goto read_data;
-					case 0xC0:
-						if (first_byte != 0xC0) goto invalid;
-						// 2 bytes length; data
-						fread(&nbytes, 2, 1, fp);
-						goto read_data;
-					case 0xE0:
-						if (first_byte != 0xE0) goto invalid;
-						// 4/8 bytes length; data
-						fread(&nbytes, sizeof(size_t), 1, fp);
-						goto read_data;
-					read_data: {
-						uint8_t chunk[4096] = {0};
-						size_t bytes_left = nbytes;
-						while (bytes_left > 0) {
-							size_t chunk_len = bytes_left;
-							if (chunk_len > sizeof chunk) chunk_len = sizeof chunk;
-							fread(chunk, 1, chunk_len, fp);
-							memory_write_bytes(writer, addr, chunk, chunk_len);
-							addr += chunk_len;
-							bytes_left -= chunk_len;
-						}
-					} break;
-					invalid:
-						display_error(state, "%s is an invalid memory file.", filename);
-						goto eof;
-					}
+	MemorySource source = {0};
+	if (!source_load(state, &source, filename)) return;
+	if (source.kind != SOURCE_MEMFILE) {
+		display_error(state, "%s is not a memory file.", filename);
+	} else {
+		JournalBatch batch;
+		if (journal_begin(state, &batch, "loading a memory file")) {
+			for (unsigned r = 0; r < source.n_ranges; ++r) {
+				SourceRange const *range = &source.ranges[r];
+				for (Address offset = 0; offset < range->size; offset += 4096) {
+					size_t nbytes = 4096;
+					if (nbytes > range->size - offset) nbytes = (size_t)(range->size - offset);
+					journal_add(state, &batch, state->pid, range->lo + offset, source.data + range->offset + offset, nbytes);
 				}
-			eof:
-				memory_writer_close(state, writer);
 			}
+			journal_end(state, &batch);
 		}
-		fclose(fp);
-	} else {
-		display_error(state, "Couldn't open %s: %s.", filename, strerror(errno));
 	}
+	source_free(&source);
 }
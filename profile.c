@@ -0,0 +1,423 @@
+// finding out which parts of a process's memory change, and how often, to help decide what to search
+//
+// this runs on its own thread, and looks at every page of the maps every so often (a "sample").
+// where the kernel keeps soft-dirty bits, those say which pages have been written to since they were
+// last cleared, which only costs reading 8 bytes of /proc/<pid>/pagemap per page. otherwise, pages are
+// hashed (see page_hash) and compared with their hash from last time, a slice of the maps at a time
+// (going round and round them), so that it only ever takes about PROFILE_CPU_FRACTION of a core.
+// the process is never stopped, so this can be left running on a process that needs to keep going.
+
+#include <sys/mman.h>
+#include <time.h>
+
+// set in a /proc/<pid>/pagemap entry if the page has been written to since the soft-dirty bits were cleared
+#define PAGEMAP_SOFT_DIRTY MASK64(55)
+// how much of a core the sampling thread should take up
+#define PROFILE_CPU_FRACTION 0.02
+// most pages looked at in one go
+#define PROFILE_BATCH_PAGES 256
+// how often pages changed, as a fraction of the times they were checked: never, up to 10%, up to 50%, more than that
+#define PROFILE_BUCKETS 4
+// most regions shown in the memory activity list
+#define PROFILE_MAX_ROWS 200
+
+struct Profile {
+	State const *state;
+	Process proc; // the process and its maps when profiling started
+	Address n_pages;
+	Address *map_page; // index of the first page of each map (nmaps + 1 of these)
+	int reader; // for reading memory, if soft-dirty bits aren't being used
+	int pagemap, clear_refs; // -1 if soft-dirty bits aren't being used
+	bool soft_dirty; // are soft-dirty bits being used?
+	gint64 interval; // microseconds between samples
+	// these are only used by the thread
+	uint64_t *hashes; // the hash of each page from when it was last read (0 if it hasn't been)
+	uint8_t *buffer; // PROFILE_BATCH_PAGES pages
+	unsigned next_map;
+	Address next_page; // where the next sample starts hashing from
+	Address pages_per_sample;
+	GThread *thread;
+	GMutex mutex;
+	GCond cond; // signalled when stop is set
+	// these are protected by mutex
+	uint32_t *samples; // how many times each page has been checked
+	uint32_t *changes; // how many of those times each page had changed
+	unsigned n_samples;
+	double cpu_time; // seconds of CPU time the thread has used
+	gint64 start_time, end_time;
+	bool stop;
+	bool done;
+	bool updated; // have there been samples since profile_poll last returned true?
+	int error; // errno value if the process couldn't be looked at anymore (e.g. it exited)
+};
+
+// a map and how much it's been changing
+typedef struct {
+	unsigned map;
+	Address pages_changed; // pages which have changed at all
+	double activity; // how many pages change per sample, on average
+} ProfileRegion;
+
+// does the kernel set soft-dirty bits? -1 if it hasn't been checked yet (see profile_soft_dirty_works)
+static int profile_kernel_soft_dirty = -1;
+
+// (if the kernel wasn't built with CONFIG_MEM_SOFT_DIRTY, soft-dirty bits can still be cleared,
+// but they're never set.) this is found out once, with a page of our own.
+static bool profile_soft_dirty_works(void) {
+	int works = profile_kernel_soft_dirty;
+	if (works >= 0) return works;
+	works = 0;
+	int clear_refs = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+	int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	uint8_t *page = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (clear_refs != -1 && pagemap != -1 && page != MAP_FAILED && write(clear_refs, "4", 1) == 1) {
+		*(uint8_t volatile *)page = 1;
+		uint64_t entry = 0;
+		if (pread(pagemap, &entry, sizeof entry, (off_t)((uintptr_t)page / 4096 * sizeof entry)) == sizeof entry
+			&& (entry & PAGEMAP_SOFT_DIRTY))
+			works = 1;
+	}
+	if (page != MAP_FAILED) munmap(page, 4096);
+	if (pagemap != -1) close(pagemap);
+	if (clear_refs != -1) close(clear_refs);
+	profile_kernel_soft_dirty = works;
+	return works;
+}
+
+// check which pages have been written to since the last sample. returns 0, or an errno value.
+static int profile_sample_soft_dirty(Profile *profile) {
+	Process const *proc = &profile->proc;
+	uint64_t entries[PROFILE_BATCH_PAGES];
+	for (unsigned m = 0; m < proc->nmaps; ++m) {
+		Map const *map = &proc->maps[m];
+		Address n = map->size / 4096;
+		for (Address i = 0; i < n; i += PROFILE_BATCH_PAGES) {
+			Address k = n - i < PROFILE_BATCH_PAGES ? n - i : PROFILE_BATCH_PAGES;
+			ssize_t got = pread(profile->pagemap, entries, k * sizeof *entries,
+				(off_t)((map->lo / 4096 + i) * sizeof *entries));
+			if (got < 0) return errno;
+			// (pagemap reads nothing once the process is gone)
+			if (got == 0) return ESRCH;
+			if ((size_t)got < k * sizeof *entries)
+				memset((char *)entries + got, 0, k * sizeof *entries - (size_t)got);
+			Address first = profile->map_page[m] + i;
+			g_mutex_lock(&profile->mutex);
+			for (Address j = 0; j < k; ++j) {
+				++profile->samples[first + j];
+				profile->changes[first + j] += (entries[j] & PAGEMAP_SOFT_DIRTY) != 0;
+			}
+			g_mutex_unlock(&profile->mutex);
+		}
+	}
+	// start over for the next sample
+	if (write(profile->clear_refs, "4", 1) != 1) return errno ? errno : ESRCH;
+	return 0;
+}
+
+// hash the next pages_per_sample pages, and see which ones have changed. returns 0, or an errno value.
+static int profile_sample_hashes(Profile *profile) {
+	Process const *proc = &profile->proc;
+	Address todo = profile->pages_per_sample;
+	uint64_t hashes[PROFILE_BATCH_PAGES];
+	while (todo) {
+		unsigned m = profile->next_map;
+		Address page = profile->next_page;
+		Address k = profile->map_page[m + 1] - page;
+		if (k > PROFILE_BATCH_PAGES) k = PROFILE_BATCH_PAGES;
+		if (k > todo) k = todo;
+		Address addr = proc->maps[m].lo + (page - profile->map_page[m]) * 4096;
+		size_t size = (size_t)k * 4096;
+		ssize_t got = pread(profile->reader, profile->buffer, size, (off_t)addr);
+		// (reading fails for pages which aren't there anymore, but reads nothing once the process is gone)
+		if (got == 0) return ESRCH;
+		if (got != (ssize_t)size)
+			memory_read_zeroed(profile->reader, addr, profile->buffer, size);
+		for (Address j = 0; j < k; ++j)
+			hashes[j] = page_hash(profile->buffer + j * 4096, 4096, 0) | 1; // (0 means there's no hash yet)
+		g_mutex_lock(&profile->mutex);
+		for (Address j = 0; j < k; ++j) {
+			uint64_t *prev = &profile->hashes[page + j];
+			if (*prev) {
+				++profile->samples[page + j];
+				profile->changes[page + j] += *prev != hashes[j];
+			}
+			*prev = hashes[j];
+		}
+		g_mutex_unlock(&profile->mutex);
+		todo -= k;
+		page += k;
+		if (page == profile->map_page[m + 1]) {
+			// on to the next map
+			if (++m == proc->nmaps) m = 0;
+			page = profile->map_page[m];
+		}
+		profile->next_map = m;
+		profile->next_page = page;
+	}
+	return 0;
+}
+
+static double profile_cpu_seconds(void) {
+	struct timespec ts = {0};
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static gpointer profile_thread(gpointer user_data) {
+	Profile *profile = user_data;
+	gint64 wait = profile->interval;
+	g_mutex_lock(&profile->mutex);
+	while (true) {
+		gint64 wake = g_get_monotonic_time() + wait;
+		while (!profile->stop && g_cond_wait_until(&profile->cond, &profile->mutex, wake));
+		if (profile->stop) break;
+		g_mutex_unlock(&profile->mutex);
+		double cpu_start = profile_cpu_seconds();
+		int error = profile->soft_dirty ? profile_sample_soft_dirty(profile) : profile_sample_hashes(profile);
+		double cpu = profile_cpu_seconds() - cpu_start;
+		double budget = (double)profile->interval * 1e-6 * PROFILE_CPU_FRACTION;
+		if (!profile->soft_dirty && cpu > 0) {
+			// hash as many pages as fit in the budget next time
+			double pages = (double)profile->pages_per_sample * budget / cpu;
+			if (pages < 16) pages = 16;
+			if (pages > (double)profile->n_pages) pages = (double)profile->n_pages;
+			profile->pages_per_sample = (Address)pages;
+		}
+		// if it's still too slow (e.g. reading pagemap for a huge process), wait for longer
+		wait = profile->interval;
+		if (cpu > budget)
+			wait = (gint64)(cpu / PROFILE_CPU_FRACTION * 1e6);
+		g_mutex_lock(&profile->mutex);
+		profile->cpu_time += cpu;
+		if (error) {
+			profile->error = error;
+			break;
+		}
+		++profile->n_samples;
+		profile->updated = true;
+	}
+	profile->done = true;
+	g_mutex_unlock(&profile->mutex);
+	return NULL;
+}
+
+// close the files the thread was using
+static void profile_close(Profile *profile) {
+	if (profile->reader != -1) close(profile->reader);
+	if (profile->pagemap != -1) close(profile->pagemap);
+	if (profile->clear_refs != -1) close(profile->clear_refs);
+	profile->reader = profile->pagemap = profile->clear_refs = -1;
+	free(profile->hashes);
+	free(profile->buffer);
+	profile->hashes = NULL;
+	profile->buffer = NULL;
+}
+
+static void profile_free(Profile *profile) {
+	profile_close(profile);
+	free(profile->samples);
+	free(profile->changes);
+	free(profile->map_page);
+	process_free(&profile->proc);
+	free(profile);
+}
+
+// start profiling proc's maps (taking ownership of proc), with interval microseconds between samples.
+// returns false (after showing an error) if it couldn't be started.
+static bool profile_start(State *state, Process *proc, gint64 interval) {
+	if (state->profile) {
+		display_error_nofmt(state, "Memory activity is already being profiled.");
+		process_free(proc);
+		return false;
+	}
+	Profile *profile = calloc(1, sizeof *profile);
+	if (!profile) {
+		display_error_nofmt(state, "Not enough memory available for profiling.");
+		process_free(proc);
+		return false;
+	}
+	profile->proc = *proc;
+	memset(proc, 0, sizeof *proc);
+	proc = &profile->proc;
+	profile->state = state;
+	profile->interval = interval;
+	profile->reader = profile->pagemap = profile->clear_refs = -1;
+	bool success = (profile->map_page = calloc(proc->nmaps + 1, sizeof *profile->map_page)) != NULL;
+	for (unsigned m = 0; success && m < proc->nmaps; ++m)
+		profile->map_page[m + 1] = profile->map_page[m] + proc->maps[m].size / 4096;
+	profile->n_pages = success ? profile->map_page[proc->nmaps] : 0;
+	if (success) {
+		profile->samples = calloc(profile->n_pages + 1, sizeof *profile->samples);
+		profile->changes = calloc(profile->n_pages + 1, sizeof *profile->changes);
+		success = profile->samples && profile->changes;
+	}
+	if (success && profile_soft_dirty_works()) {
+		profile->pagemap = agent_open_pagemap(state, proc->pid);
+		profile->clear_refs = agent_open_clear_refs(state, proc->pid);
+		if (profile->pagemap == -1 || profile->clear_refs == -1 || write(profile->clear_refs, "4", 1) != 1) {
+			// (fall back to hashing)
+			if (profile->pagemap != -1) close(profile->pagemap);
+			if (profile->clear_refs != -1) close(profile->clear_refs);
+			profile->pagemap = profile->clear_refs = -1;
+		}
+	}
+	profile->soft_dirty = profile->pagemap != -1;
+	if (success && !profile->soft_dirty) {
+		profile->reader = agent_open_memory(state, proc->pid, O_RDONLY);
+		if (profile->reader == -1) {
+			display_error(state, "Couldn't open memory of process %lld: %s.", (long long)proc->pid, strerror(errno));
+		} else {
+			profile->hashes = calloc(profile->n_pages + 1, sizeof *profile->hashes);
+			profile->buffer = malloc(PROFILE_BATCH_PAGES * 4096);
+			if (!profile->hashes || !profile->buffer) {
+				display_error_nofmt(state, "Not enough memory available for profiling.");
+				success = false;
+			}
+		}
+		// start with 1MB, and see how long that takes
+		profile->pages_per_sample = PROFILE_BATCH_PAGES;
+		if (profile->pages_per_sample > profile->n_pages)
+			profile->pages_per_sample = profile->n_pages;
+	} else if (!success) {
+		display_error_nofmt(state, "Not enough memory available for profiling.");
+	}
+	if (!success || (profile->pagemap == -1 && profile->reader == -1) || !profile->n_pages) {
+		if (success && !profile->n_pages)
+			display_error_nofmt(state, "There's no memory to profile.");
+		profile_free(profile);
+		return false;
+	}
+	g_mutex_init(&profile->mutex);
+	g_cond_init(&profile->cond);
+	profile->start_time = g_get_monotonic_time();
+	GError *error = NULL;
+	profile->thread = g_thread_try_new("profile", profile_thread, profile, &error);
+	if (!profile->thread) {
+		// (unlike an export, this can't just be done here)
+		display_error(state, "Couldn't start profiling: %s.", error ? error->message : "unknown error");
+		g_clear_error(&error);
+		g_cond_clear(&profile->cond);
+		g_mutex_clear(&profile->mutex);
+		profile_free(profile);
+		return false;
+	}
+	state->profile = profile;
+	return true;
+}
+
+// how often the pages have changed (see PROFILE_BUCKETS), and the maps which have changed, most active first.
+// histogram[PROFILE_BUCKETS] is the number of pages which haven't been checked yet.
+// returns the number of regions put in *out_regions (allocated with malloc), or 0 if none have changed.
+static unsigned profile_summarize(Profile *profile, Address histogram[PROFILE_BUCKETS + 1], ProfileRegion **out_regions) {
+	Process const *proc = &profile->proc;
+	memset(histogram, 0, (PROFILE_BUCKETS + 1) * sizeof *histogram);
+	ProfileRegion *regions = *out_regions = calloc(proc->nmaps + 1, sizeof *regions);
+	unsigned n_regions = 0;
+	if (profile->thread) g_mutex_lock(&profile->mutex);
+	for (unsigned m = 0; m < proc->nmaps; ++m) {
+		ProfileRegion region = {m, 0, 0};
+		for (Address i = profile->map_page[m]; i < profile->map_page[m + 1]; ++i) {
+			uint32_t samples = profile->samples[i], changes = profile->changes[i];
+			if (!samples) {
+				++histogram[PROFILE_BUCKETS];
+				continue;
+			}
+			double frequency = (double)changes / (double)samples;
+			region.activity += frequency;
+			region.pages_changed += changes != 0;
+			if (!changes) ++histogram[0];
+			else if (frequency <= 0.1) ++histogram[1];
+			else if (frequency <= 0.5) ++histogram[2];
+			else ++histogram[3];
+		}
+		if (regions && region.pages_changed)
+			regions[n_regions++] = region;
+	}
+	if (profile->thread) g_mutex_unlock(&profile->mutex);
+	// most active first (there aren't many maps, so this doesn't need to be fancy)
+	for (unsigned i = 1; i < n_regions; ++i) {
+		ProfileRegion region = regions[i];
+		unsigned j;
+		for (j = i; j > 0 && regions[j - 1].activity < region.activity; --j)
+			regions[j] = regions[j - 1];
+		regions[j] = region;
+	}
+	return n_regions;
+}
+
+// describe how profiling is going, e.g. "Hashing pages every 1s: 12 samples, using 1.9% of a core."
+static void profile_status(Profile *profile, Address const histogram[PROFILE_BUCKETS + 1], char *text, size_t text_size) {
+	bool running = profile->thread != NULL;
+	if (running) g_mutex_lock(&profile->mutex);
+	unsigned n_samples = profile->n_samples;
+	double cpu_time = profile->cpu_time;
+	int error = profile->error;
+	if (running) g_mutex_unlock(&profile->mutex);
+	gint64 end = running ? g_get_monotonic_time() : profile->end_time;
+	double seconds = (double)(end - profile->start_time) * 1e-6;
+	double cpu_percent = seconds > 0 ? cpu_time / seconds * 100 : 0;
+	char checked[64] = {0};
+	if (!profile->soft_dirty && histogram[PROFILE_BUCKETS]) {
+		// (it takes a while to get round to every page)
+		double fraction = 1 - (double)histogram[PROFILE_BUCKETS] / (double)profile->n_pages;
+		snprintf(checked, sizeof checked, " (%.0f%% of memory checked so far)", fraction * 100);
+	}
+	if (running) {
+		snprintf(text, text_size, "%s every %gs: %u samples%s, using %.1f%% of a core.",
+			profile->soft_dirty ? "Checking soft-dirty bits" : "Hashing pages", (double)profile->interval * 1e-6,
+			n_samples, checked, cpu_percent);
+	} else if (error) {
+		snprintf(text, text_size, "Stopped after %u samples: %s.", n_samples,
+			error == ESRCH ? "the process has exited" : strerror(error));
+	} else {
+		snprintf(text, text_size, "Stopped after %u samples%s.", n_samples, checked);
+	}
+}
+
+// stop the thread and close everything, but keep what's been found, to keep showing it
+static void profile_end(State *state) {
+	Profile *profile = state->profile;
+	if (!profile || !profile->thread) return;
+	g_mutex_lock(&profile->mutex);
+	profile->stop = true;
+	g_cond_signal(&profile->cond);
+	g_mutex_unlock(&profile->mutex);
+	g_thread_join(profile->thread);
+	profile->thread = NULL;
+	g_cond_clear(&profile->cond);
+	g_mutex_clear(&profile->mutex);
+	profile->end_time = g_get_monotonic_time();
+	profile_close(profile);
+	profile->updated = true; // (to show that it's stopped)
+}
+
+// are there new samples (or has profiling stopped) since this last returned true?
+static bool profile_poll(State *state) {
+	Profile *profile = state->profile;
+	if (!profile) return false;
+	if (!profile->thread) {
+		bool updated = profile->updated;
+		profile->updated = false;
+		return updated;
+	}
+	g_mutex_lock(&profile->mutex);
+	bool done = profile->done;
+	bool updated = profile->updated;
+	profile->updated = false;
+	g_mutex_unlock(&profile->mutex);
+	if (done) {
+		profile_end(state);
+		profile->updated = false;
+		return true;
+	}
+	return updated;
+}
+
+// stop profiling and forget about it
+static void profile_stop(State *state) {
+	Profile *profile = state->profile;
+	if (!profile) return;
+	profile_end(state);
+	state->profile = NULL;
+	profile_free(profile);
+}
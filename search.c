@@ -0,0 +1,1050 @@
+// searching through chunks of memory
+
+// a stretch of chunks with search candidates in them, which is read all at once.
+// reading more than a page at a time cuts down on the number of system calls.
+// (how big runs can get is up to state->read_tuning)
+typedef struct {
+	unsigned map;
+	uint32_t kind; // kind of map it's in (runs are searched in MapKind order)
+	Address offset; // offset of the start of the run in the map (a multiple of 4096)
+	size_t size;
+} SearchRun;
+
+// order runs by the kind of map they're in, then by where they are
+static int search_run_cmp(void const *av, void const *bv) {
+	SearchRun const *a = av, *b = bv;
+	if (a->kind != b->kind) return a->kind < b->kind ? -1 : 1;
+	if (a->map != b->map) return a->map < b->map ? -1 : 1;
+	if (a->offset != b->offset) return a->offset < b->offset ? -1 : 1;
+	return 0;
+}
+
+// distance in bytes between search candidate positions for the given type
+static size_t search_stride(State const *state, DataType type) {
+	return state->search_unaligned ? 1 : data_type_size(type);
+}
+
+static uint64_t const bitset_zeroes[BITSET_BLOCK_WORDS];
+#define BITSET_ONES_8 UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX
+// (this is read by the search threads, so it's filled in here rather than at run time)
+static uint64_t const bitset_ones[BITSET_BLOCK_WORDS] = {
+	BITSET_ONES_8, BITSET_ONES_8, BITSET_ONES_8, BITSET_ONES_8,
+	BITSET_ONES_8, BITSET_ONES_8, BITSET_ONES_8, BITSET_ONES_8
+};
+#undef BITSET_ONES_8
+// (if BITSET_BLOCK_WORDS changes, so does the number of BITSET_ONES_8s above)
+typedef char bitset_ones_check[BITSET_BLOCK_WORDS == 64 ? 1 : -1];
+
+static void bitset_free(Bitset *bs) {
+	if (!bs) return;
+	if (bs->leaves) {
+		for (Address b = 0; b < bs->n_blocks; ++b)
+			free(bs->leaves[b]);
+	}
+	free(bs->leaves);
+	free(bs->summary);
+	free(bs);
+}
+
+// n_bits should be a multiple of 64. returns NULL if there isn't enough memory.
+static Bitset *bitset_new(Address n_bits, bool set) {
+	Bitset *bs = calloc(1, sizeof *bs);
+	if (!bs) return NULL;
+	bs->n_words = n_bits / 64;
+	bs->n_blocks = (bs->n_words + BITSET_BLOCK_WORDS - 1) / BITSET_BLOCK_WORDS;
+	bs->summary = malloc(bs->n_blocks + 1);
+	bs->leaves = calloc(bs->n_blocks + 1, sizeof *bs->leaves);
+	if (!bs->summary || !bs->leaves) {
+		bitset_free(bs);
+		return NULL;
+	}
+	memset(bs->summary, set ? BITSET_SET : BITSET_CLEAR, bs->n_blocks);
+	return bs;
+}
+
+static void bitset_clear_all(Bitset *bs) {
+	for (Address b = 0; b < bs->n_blocks; ++b) {
+		free(bs->leaves[b]);
+		bs->leaves[b] = NULL;
+	}
+	memset(bs->summary, BITSET_CLEAR, bs->n_blocks);
+}
+
+// words #w onwards, up to the end of w's block. don't modify these.
+static uint64_t const *bitset_words(Bitset const *bs, Address w) {
+	Address b = w / BITSET_BLOCK_WORDS;
+	size_t i = (size_t)(w % BITSET_BLOCK_WORDS);
+	switch ((BitsetBlock)bs->summary[b]) {
+	case BITSET_CLEAR: return &bitset_zeroes[i];
+	case BITSET_SET: return &bitset_ones[i];
+	case BITSET_MIXED: break;
+	}
+	return &bs->leaves[b][i];
+}
+
+// are any of words #w to #w+n-1 (which must be in the same block) nonzero?
+static bool bitset_any_words(Bitset const *bs, Address w, size_t n) {
+	switch ((BitsetBlock)bs->summary[w / BITSET_BLOCK_WORDS]) {
+	case BITSET_CLEAR: return false;
+	case BITSET_SET: return true;
+	case BITSET_MIXED: break;
+	}
+	uint64_t const *words = bitset_words(bs, w);
+	for (size_t i = 0; i < n; ++i)
+		if (words[i])
+			return true;
+	return false;
+}
+
+static bool bitset_get(Bitset const *bs, Address i) {
+	return (bitset_words(bs, i / 64)[0] & MASK64(i % 64)) != 0;
+}
+
+// give the block containing word #w its own words, so that they can be modified.
+// returns false if there isn't enough memory.
+static bool bitset_split(Bitset *bs, Address w) {
+	Address b = w / BITSET_BLOCK_WORDS;
+	if (bs->summary[b] == BITSET_MIXED) return true;
+	uint64_t *leaf = malloc(BITSET_BLOCK_WORDS * sizeof *leaf);
+	if (!leaf) return false;
+	memcpy(leaf, bs->summary[b] == BITSET_SET ? bitset_ones : bitset_zeroes, BITSET_BLOCK_WORDS * sizeof *leaf);
+	bs->leaves[b] = leaf;
+	bs->summary[b] = BITSET_MIXED;
+	return true;
+}
+
+// free the words of the block containing word #w if they're all clear or all set.
+static void bitset_merge(Bitset *bs, Address w) {
+	Address b = w / BITSET_BLOCK_WORDS;
+	if (bs->summary[b] != BITSET_MIXED) return;
+	uint64_t const *leaf = bs->leaves[b];
+	uint64_t any = 0, all = UINT64_MAX;
+	// (the last block might not be full)
+	Address n_words = bs->n_words - b * BITSET_BLOCK_WORDS;
+	if (n_words > BITSET_BLOCK_WORDS) n_words = BITSET_BLOCK_WORDS;
+	for (Address i = 0; i < n_words; ++i) {
+		any |= leaf[i];
+		all &= leaf[i];
+	}
+	if (any && all != UINT64_MAX) return;
+	bs->summary[b] = any ? BITSET_SET : BITSET_CLEAR;
+	free(bs->leaves[b]);
+	bs->leaves[b] = NULL;
+}
+
+// returns false if there isn't enough memory.
+static bool bitset_set(Bitset *bs, Address i) {
+	if (bitset_get(bs, i)) return true;
+	if (!bitset_split(bs, i / 64)) return false;
+	bs->leaves[i / 64 / BITSET_BLOCK_WORDS][i / 64 % BITSET_BLOCK_WORDS] |= MASK64(i % 64);
+	return true;
+}
+
+static void bitset_clear(Bitset *bs, Address i) {
+	if (!bitset_get(bs, i)) return;
+	if (!bitset_split(bs, i / 64)) return;
+	bs->leaves[i / 64 / BITSET_BLOCK_WORDS][i / 64 % BITSET_BLOCK_WORDS] &= ~MASK64(i % 64);
+	bitset_merge(bs, i / 64);
+}
+
+// get words #w to #w+n-1 (which must be in the same block) so that they can be modified.
+// if the block doesn't have its own words, they're copied to scratch.
+// call bitset_update_end afterwards.
+static uint64_t *bitset_update_begin(Bitset *bs, Address w, size_t n, uint64_t *scratch) {
+	Address b = w / BITSET_BLOCK_WORDS;
+	if (bs->summary[b] == BITSET_MIXED)
+		return &bs->leaves[b][w % BITSET_BLOCK_WORDS];
+	memcpy(scratch, bitset_words(bs, w), n * sizeof *scratch);
+	return scratch;
+}
+
+// returns false if there wasn't enough memory to store the words.
+static bool bitset_update_end(Bitset *bs, Address w, size_t n, uint64_t const *words) {
+	Address b = w / BITSET_BLOCK_WORDS;
+	if (bs->summary[b] != BITSET_MIXED) {
+		if (memcmp(words, bitset_words(bs, w), n * sizeof *words) == 0)
+			return true; // nothing changed
+		if (!bitset_split(bs, w))
+			return false;
+		memcpy(&bs->leaves[b][w % BITSET_BLOCK_WORDS], words, n * sizeof *words);
+	}
+	bitset_merge(bs, w);
+	return true;
+}
+
+// number of bits set in words #w to #w+n-1
+static Address bitset_count_words(Bitset const *bs, Address w, Address n) {
+	Address count = 0;
+	while (n) {
+		Address b = w / BITSET_BLOCK_WORDS;
+		Address n_here = BITSET_BLOCK_WORDS - w % BITSET_BLOCK_WORDS;
+		if (n_here > n) n_here = n;
+		switch ((BitsetBlock)bs->summary[b]) {
+		case BITSET_CLEAR:
+			break;
+		case BITSET_SET:
+			count += n_here * 64;
+			break;
+		case BITSET_MIXED: {
+			uint64_t const *words = &bs->leaves[b][w % BITSET_BLOCK_WORDS];
+			for (Address i = 0; i < n_here; ++i)
+				count += (unsigned)__builtin_popcountll(words[i]);
+		} break;
+		}
+		w += n_here;
+		n -= n_here;
+	}
+	return count;
+}
+
+// number of bits set
+static Address bitset_count(Bitset const *bs) {
+	return bitset_count_words(bs, 0, bs->n_words);
+}
+
+// clear words #w to #w+n-1. returns false if there wasn't enough memory to clear all of them.
+static bool bitset_clear_words(Bitset *bs, Address w, Address n) {
+	bool success = true;
+	while (n) {
+		Address b = w / BITSET_BLOCK_WORDS;
+		size_t n_here = BITSET_BLOCK_WORDS - (size_t)(w % BITSET_BLOCK_WORDS);
+		if (n_here > n) n_here = (size_t)n;
+		if (w % BITSET_BLOCK_WORDS == 0 && (n_here == BITSET_BLOCK_WORDS || w + n_here == bs->n_words)) {
+			// the whole block
+			free(bs->leaves[b]);
+			bs->leaves[b] = NULL;
+			bs->summary[b] = BITSET_CLEAR;
+		} else {
+			uint64_t scratch[BITSET_BLOCK_WORDS];
+			uint64_t *words = bitset_update_begin(bs, w, n_here, scratch);
+			memset(words, 0, n_here * sizeof *words);
+			success &= bitset_update_end(bs, w, n_here, words);
+		}
+		w += n_here;
+		n -= n_here;
+	}
+	return success;
+}
+
+// index of the first bit set at or after i, or n_words * 64 if there isn't one.
+static Address bitset_next(Bitset const *bs, Address i) {
+	Address n_bits = bs->n_words * 64;
+	while (i < n_bits) {
+		Address b = i / (64 * BITSET_BLOCK_WORDS);
+		switch ((BitsetBlock)bs->summary[b]) {
+		case BITSET_CLEAR:
+			i = (b + 1) * 64 * BITSET_BLOCK_WORDS;
+			break;
+		case BITSET_SET:
+			return i;
+		case BITSET_MIXED: {
+			uint64_t const *leaf = bs->leaves[b];
+			Address w = i / 64;
+			uint64_t bits = leaf[w % BITSET_BLOCK_WORDS] & (UINT64_MAX << (i % 64));
+			while (!bits) {
+				++w;
+				if (w % BITSET_BLOCK_WORDS == 0 || w >= bs->n_words) break;
+				bits = leaf[w % BITSET_BLOCK_WORDS];
+			}
+			if (bits)
+				return w * 64 + (Address)__builtin_ctzll(bits);
+			i = w * 64;
+		} break;
+		}
+	}
+	return n_bits;
+}
+
+// find the stretches of proc's memory with candidates in them (for each type whose candidates aren't NULL),
+// each of which is read all at once. gaps of up to tuning.gap_max bytes with no candidates in them are
+// read over, since that's quicker than starting another read. map_offset[m] is the offset of the start of
+// map #m from the start of the first one. returns false if there isn't enough memory.
+static bool search_runs_find(Process const *proc, Bitset *const *candidates, size_t const *stride,
+	Address const *map_offset, ReadTuning tuning, SearchRun **out_runs, size_t *out_n_runs) {
+	SearchRun *runs = NULL;
+	size_t n_runs = 0, runs_capacity = 0;
+	for (unsigned m = 0; m < proc->nmaps; ++m) {
+		Map const *map = &proc->maps[m];
+		// chunk offsets are multiples of 4096, so they line up with the 64-position bitset words.
+		for (Address chunk_offset = 0; chunk_offset < map->size; chunk_offset += 4096) {
+			size_t this_chunk_bytes = 4096;
+			if (this_chunk_bytes > map->size - chunk_offset)
+				this_chunk_bytes = (size_t)(map->size - chunk_offset);
+			
+			// skip over chunks with no candidates
+			bool any_candidates = false;
+			for (int t = 0; t < DATA_TYPE_COUNT && !any_candidates; ++t) {
+				if (!candidates[t]) continue;
+				Address w = (map_offset[m] + chunk_offset) / stride[t] / 64;
+				any_candidates = bitset_any_words(candidates[t], w, this_chunk_bytes / stride[t] / 64);
+			}
+			if (!any_candidates) continue;
+			
+			SearchRun *last = n_runs ? &runs[n_runs - 1] : NULL;
+			if (last && last->map == m && chunk_offset - (last->offset + last->size) <= tuning.gap_max
+				&& chunk_offset + this_chunk_bytes - last->offset <= tuning.run_max) {
+				last->size = (size_t)(chunk_offset + this_chunk_bytes - last->offset);
+			} else {
+				if (n_runs >= runs_capacity) {
+					runs_capacity = runs_capacity * 2 + 64;
+					SearchRun *new_runs = realloc(runs, runs_capacity * sizeof *runs);
+					if (!new_runs) {
+						free(runs);
+						return false;
+					}
+					runs = new_runs;
+				}
+				SearchRun *run = &runs[n_runs++];
+				run->map = m;
+				run->kind = map->kind;
+				run->offset = chunk_offset;
+				run->size = this_chunk_bytes;
+			}
+		}
+	}
+	*out_runs = runs;
+	*out_n_runs = n_runs;
+	return true;
+}
+
+// is type being searched for?
+static bool searching_for(State const *state, DataType type) {
+	return state->n_processes && state->processes[0].search_candidates[type];
+}
+
+static void process_free(Process *proc) {
+	if (proc->map_names) {
+		for (unsigned m = 0; m < proc->nmaps; ++m)
+			free(proc->map_names[m]);
+	}
+	free(proc->map_names);
+	free(proc->maps);
+	free(proc->page_hashes);
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+		bitset_free(proc->search_candidates[t]);
+		free(proc->map_candidates[t]);
+	}
+	if (proc->prev_memory)
+		fclose(proc->prev_memory);
+	memset(proc, 0, sizeof *proc);
+}
+
+// the process being searched with this PID, or NULL if there isn't one
+static Process *process_find(State *state, PID pid) {
+	for (unsigned p = 0; p < state->n_processes; ++p)
+		if (state->processes[p].pid == pid)
+			return &state->processes[p];
+	return NULL;
+}
+
+// index of proc's map which starts at lo, or proc->nmaps if there isn't one
+static unsigned process_find_map(Process const *proc, Address lo) {
+	// (maps are in order of address)
+	unsigned lo_index = 0, hi_index = proc->nmaps;
+	while (lo_index < hi_index) {
+		unsigned mid = lo_index + (hi_index - lo_index) / 2;
+		if (proc->maps[mid].lo < lo)
+			lo_index = mid + 1;
+		else
+			hi_index = mid;
+	}
+	return lo_index < proc->nmaps && proc->maps[lo_index].lo == lo ? lo_index : proc->nmaps;
+}
+
+// bitset index of the first position in map #m of proc
+static Address process_map_index(Process const *proc, unsigned m, size_t stride) {
+	Address offset = 0;
+	for (unsigned i = 0; i < m; ++i)
+		offset += proc->maps[i].size;
+	return offset / stride;
+}
+
+// number of candidates of this type in proc. the candidates in each map are counted the first time
+// (see Process.map_candidates), then the counts are kept up to date as candidates are removed.
+static Address process_count_candidates(State const *state, Process *proc, DataType type) {
+	Bitset const *candidates = proc->search_candidates[type];
+	if (!candidates) return 0;
+	if (!proc->map_candidates[type]) {
+		Address *counts = calloc(proc->nmaps + 1, sizeof *counts);
+		if (!counts) return bitset_count(candidates);
+		size_t stride = search_stride(state, type);
+		Address w = 0;
+		for (unsigned m = 0; m < proc->nmaps; ++m) {
+			Address n_words = proc->maps[m].size / stride / 64;
+			counts[m] = bitset_count_words(candidates, w, n_words);
+			w += n_words;
+		}
+		proc->map_candidates[type] = counts;
+	}
+	Address total = 0;
+	for (unsigned m = 0; m < proc->nmaps; ++m)
+		total += proc->map_candidates[type][m];
+	return total;
+}
+
+// remove all of proc's candidates of this type
+static void process_clear_candidates(Process *proc, DataType type) {
+	bitset_clear_all(proc->search_candidates[type]);
+	if (proc->map_candidates[type])
+		memset(proc->map_candidates[type], 0, proc->nmaps * sizeof *proc->map_candidates[type]);
+}
+
+#define PAGE_HASH_PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define PAGE_HASH_PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PAGE_HASH_PRIME3 UINT64_C(0x165667B19E3779F9)
+#define PAGE_HASH_PRIME4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PAGE_HASH_PRIME5 UINT64_C(0x27D4EB2F165667C5)
+
+static uint64_t page_hash_rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t page_hash_round(uint64_t acc, uint64_t input) {
+	acc += input * PAGE_HASH_PRIME2;
+	return page_hash_rotl(acc, 31) * PAGE_HASH_PRIME1;
+}
+
+// a fast 64-bit hash of some bytes (this is XXH64), used to tell if memory has changed.
+// it goes through 32 bytes at a time with four independent lanes, so it keeps up with the scan functions.
+static uint64_t page_hash(void const *data, size_t n, uint64_t seed) {
+	uint8_t const *p = data, *end = p + n;
+	uint64_t h;
+	if (n >= 32) {
+		uint64_t v[4] = {seed + PAGE_HASH_PRIME1 + PAGE_HASH_PRIME2, seed + PAGE_HASH_PRIME2, seed, seed - PAGE_HASH_PRIME1};
+		for (; end - p >= 32; p += 32) {
+			for (int i = 0; i < 4; ++i) {
+				uint64_t x;
+				memcpy(&x, p + 8 * i, 8);
+				v[i] = page_hash_round(v[i], x);
+			}
+		}
+		h = page_hash_rotl(v[0], 1) + page_hash_rotl(v[1], 7) + page_hash_rotl(v[2], 12) + page_hash_rotl(v[3], 18);
+		for (int i = 0; i < 4; ++i)
+			h = (h ^ page_hash_round(0, v[i])) * PAGE_HASH_PRIME1 + PAGE_HASH_PRIME4;
+	} else {
+		h = seed + PAGE_HASH_PRIME5;
+	}
+	h += (uint64_t)n;
+	for (; end - p >= 8; p += 8) {
+		uint64_t x;
+		memcpy(&x, p, 8);
+		h = page_hash_rotl(h ^ page_hash_round(0, x), 27) * PAGE_HASH_PRIME1 + PAGE_HASH_PRIME4;
+	}
+	if (end - p >= 4) {
+		uint32_t x;
+		memcpy(&x, p, 4);
+		h = page_hash_rotl(h ^ (uint64_t)x * PAGE_HASH_PRIME1, 23) * PAGE_HASH_PRIME2 + PAGE_HASH_PRIME3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		h = page_hash_rotl(h ^ *p * PAGE_HASH_PRIME5, 11) * PAGE_HASH_PRIME1;
+	h ^= h >> 33;
+	h *= PAGE_HASH_PRIME2;
+	h ^= h >> 29;
+	h *= PAGE_HASH_PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+// a string being searched for (with type TYPE_ASCII, TYPE_UTF16, or TYPE_UTF32)
+typedef struct {
+	DataType type;
+	size_t len; // length in items (e.g. UTF-16 code units)
+	bool case_insensitive;
+	uint32_t chars[STRING_MAX_CHARS]; // case-folded if case_insensitive
+	// before comparing the whole string, we check that
+	//    (item[filter_index[k]] | filter_or[k]) == filter_value[k]
+	// for k = 0, 1. this can be done for 64 positions at once without any branches.
+	size_t filter_index[2];
+	uint32_t filter_or[2], filter_value[2];
+} StringPattern;
+
+// try to use the character at index idx for filter #k. returns false if it has no cheap test.
+static bool string_pattern_set_filter(StringPattern *pattern, size_t k, size_t idx) {
+	DataType type = pattern->type;
+	uint32_t c = pattern->chars[idx];
+	uint32_t or_bits = 0;
+	if (pattern->case_insensitive) {
+		if (type == TYPE_ASCII && isalpha((int)c)) {
+			// ASCII letters only differ in case by bit 5
+			or_bits = 0x20;
+		} else if (char_has_case(type, c)) {
+			return false;
+		}
+		c = char_fold_case(type, c);
+	}
+	pattern->filter_index[k] = idx;
+	pattern->filter_or[k] = or_bits;
+	pattern->filter_value[k] = c | or_bits;
+	return true;
+}
+
+// returns false if str isn't a valid string
+static bool string_pattern_init(StringPattern *pattern, DataType type, char const *str, bool case_insensitive) {
+	memset(pattern, 0, sizeof *pattern);
+	pattern->type = type;
+	pattern->case_insensitive = case_insensitive;
+	size_t len = pattern->len = string_from_str(str, type, pattern->chars);
+	if (len == 0) return false;
+	
+	for (size_t k = 0; k < 2; ++k) {
+		// no filter; (x | 0xffffffff) == 0xffffffff is always true.
+		pattern->filter_index[k] = 0;
+		pattern->filter_or[k] = pattern->filter_value[k] = UINT32_MAX;
+	}
+	// ideally we filter on the first and last characters, but in case-insensitive mode
+	// we can only use characters which have a cheap test.
+	for (size_t i = 0; i < len; ++i) {
+		if (string_pattern_set_filter(pattern, 0, i)) {
+			for (size_t j = len - 1; j > i; --j)
+				if (string_pattern_set_filter(pattern, 1, j))
+					break;
+			break;
+		}
+	}
+	if (case_insensitive) {
+		for (size_t i = 0; i < len; ++i)
+			pattern->chars[i] = char_fold_case(type, pattern->chars[i]);
+	}
+	return true;
+}
+
+// which test a search step does at each candidate position
+typedef enum {
+	PREDICATE_EQUAL,     // value == lo
+	PREDICATE_RANGE,     // lo <= value <= hi
+	PREDICATE_STRING,    // the string `pattern` starts here
+	PREDICATE_SAME,      // value hasn't changed since the last step
+	PREDICATE_DIFFERENT, // value has changed since the last step
+	PREDICATE_ANY,       // anything (as long as the whole value is in the map)
+	PREDICATE_EXPRESSION, // the filter expression `filter` is true
+	PREDICATE_COUNT
+} Predicate;
+
+// everything a scan function needs to know besides the memory itself
+typedef struct {
+	uint64_t lo, hi; // PREDICATE_EQUAL/PREDICATE_RANGE values, in the type's representation
+	StringPattern const *pattern; // PREDICATE_STRING
+	FloatTolerance tolerance; // PREDICATE_SAME/PREDICATE_DIFFERENT
+	uint8_t const *prev_bytes; // PREDICATE_SAME/PREDICATE_DIFFERENT/PREDICATE_EXPRESSION: the memory at the last step, lined up with bytes
+	Filter const *filter; // PREDICATE_EXPRESSION
+} ScanParams;
+
+// Eliminate candidates which don't satisfy a predicate.
+// candidate #i starts at bytes[i * stride], and the candidate bits for the
+// n_positions positions (a multiple of 64) are in candidates[0 .. n_positions/64].
+// values can run past the position of the last candidate, up to avail_bytes;
+// candidates whose value goes past avail_bytes are eliminated.
+typedef void (*ScanFunction)(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates);
+
+// the body of a scan function for values of type T.
+// for each 64 positions, MATCH (which can use the value x, and its offset off in bytes)
+// is evaluated without any branches, so the compiler can vectorize it.
+// the stride is a compile-time constant: either sizeof(T) for aligned searches,
+// or 1 for unaligned ones, where every byte offset is tried using the same chunk of memory.
+#define SCAN_LOOP(T, STRIDE, MATCH) \
+	for (size_t w = 0; w < n_positions / 64; ++w) { \
+		uint64_t cand = candidates[w]; \
+		if (!cand) continue; \
+		size_t base = w * 64; \
+		uint64_t mask = 0; \
+		if ((base + 63) * STRIDE + sizeof(T) <= avail_bytes) { \
+			for (unsigned i = 0; i < 64; ++i) { \
+				size_t off = (base + i) * STRIDE; \
+				T x; memcpy(&x, &bytes[off], sizeof x); \
+				mask |= (uint64_t)(MATCH) << i; \
+			} \
+		} else { \
+			/* near the end of the map */ \
+			for (unsigned i = 0; i < 64; ++i) { \
+				size_t off = (base + i) * STRIDE; \
+				if (off + sizeof(T) > avail_bytes) break; \
+				T x; memcpy(&x, &bytes[off], sizeof x); \
+				mask |= (uint64_t)(MATCH) << i; \
+			} \
+		} \
+		candidates[w] = cand & mask; \
+	}
+
+#define SCAN_SAME_INT(prev, x, tolerance) ((prev) == (x))
+#define SCAN_SAME_FLOAT(prev, x, tolerance) float_same(prev, x, tolerance)
+
+// the scan functions for a numeric type T, with the given stride.
+// SAME is one of the SCAN_SAME_ macros.
+#define SCAN_FUNCTIONS(suffix, T, STRIDE, SAME) \
+static T scan_load_##suffix(uint8_t const *p) { T x; memcpy(&x, p, sizeof x); return x; } \
+static void scan_equal_##suffix(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates) { \
+	T lo; memcpy(&lo, &params->lo, sizeof lo); \
+	SCAN_LOOP(T, STRIDE, x == lo) \
+} \
+static void scan_range_##suffix(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates) { \
+	T lo, hi; memcpy(&lo, &params->lo, sizeof lo); memcpy(&hi, &params->hi, sizeof hi); \
+	/* NaNs are eliminated too, since both comparisons are false */ \
+	SCAN_LOOP(T, STRIDE, (x >= lo) & (x <= hi)) \
+} \
+static void scan_same_##suffix(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates) { \
+	uint8_t const *prev_bytes = params->prev_bytes; FloatTolerance tolerance = params->tolerance; (void)tolerance; \
+	SCAN_LOOP(T, STRIDE, SAME(scan_load_##suffix(&prev_bytes[off]), x, tolerance)) \
+} \
+static void scan_different_##suffix(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates) { \
+	uint8_t const *prev_bytes = params->prev_bytes; FloatTolerance tolerance = params->tolerance; (void)tolerance; \
+	SCAN_LOOP(T, STRIDE, !SAME(scan_load_##suffix(&prev_bytes[off]), x, tolerance)) \
+} \
+static void scan_any_##suffix(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates) { \
+	SCAN_LOOP(T, STRIDE, 1) \
+} \
+/* load the values (and previous values) for 64 positions, then run the filter on all of them at once */ \
+static void scan_expression_##suffix(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates) { \
+	Filter const *filter = params->filter; \
+	uint8_t const *prev_bytes = filter->uses_prev ? params->prev_bytes : NULL; \
+	for (size_t w = 0; w < n_positions / 64; ++w) { \
+		uint64_t cand = candidates[w]; \
+		if (!cand) continue; \
+		size_t base = w * 64; \
+		unsigned n = 64; /* number of positions whose value is all there */ \
+		if ((base + 63) * STRIDE + sizeof(T) > avail_bytes) { \
+			/* near the end of the map */ \
+			for (n = 0; n < 64 && (base + n) * STRIDE + sizeof(T) <= avail_bytes; ++n); \
+		} \
+		union { int64_t i[64]; double f[64]; } x = {0}, p = {0}; \
+		if (filter->is_float) { \
+			for (unsigned i = 0; i < n; ++i) x.f[i] = (double)scan_load_##suffix(&bytes[(base + i) * STRIDE]); \
+			if (prev_bytes) for (unsigned i = 0; i < n; ++i) p.f[i] = (double)scan_load_##suffix(&prev_bytes[(base + i) * STRIDE]); \
+			cand &= filter_eval_float(filter, x.f, p.f); \
+		} else { \
+			for (unsigned i = 0; i < n; ++i) x.i[i] = (int64_t)scan_load_##suffix(&bytes[(base + i) * STRIDE]); \
+			if (prev_bytes) for (unsigned i = 0; i < n; ++i) p.i[i] = (int64_t)scan_load_##suffix(&prev_bytes[(base + i) * STRIDE]); \
+			cand &= filter_eval_int(filter, x.i, p.i); \
+		} \
+		if (n < 64) cand &= MASK64(n) - 1; \
+		candidates[w] = cand; \
+	} \
+}
+SCAN_FUNCTIONS(u8,            uint8_t,  1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(s8,            int8_t,   1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(u16,           uint16_t, 2, SCAN_SAME_INT)
+SCAN_FUNCTIONS(s16,           int16_t,  2, SCAN_SAME_INT)
+SCAN_FUNCTIONS(u32,           uint32_t, 4, SCAN_SAME_INT)
+SCAN_FUNCTIONS(s32,           int32_t,  4, SCAN_SAME_INT)
+SCAN_FUNCTIONS(u64,           uint64_t, 8, SCAN_SAME_INT)
+SCAN_FUNCTIONS(s64,           int64_t,  8, SCAN_SAME_INT)
+SCAN_FUNCTIONS(f32,           float,    4, SCAN_SAME_FLOAT)
+SCAN_FUNCTIONS(f64,           double,   8, SCAN_SAME_FLOAT)
+SCAN_FUNCTIONS(u16_unaligned, uint16_t, 1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(s16_unaligned, int16_t,  1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(u32_unaligned, uint32_t, 1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(s32_unaligned, int32_t,  1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(u64_unaligned, uint64_t, 1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(s64_unaligned, int64_t,  1, SCAN_SAME_INT)
+SCAN_FUNCTIONS(f32_unaligned, float,    1, SCAN_SAME_FLOAT)
+SCAN_FUNCTIONS(f64_unaligned, double,   1, SCAN_SAME_FLOAT)
+#undef SCAN_FUNCTIONS
+
+
+// scan functions for PREDICATE_STRING: eliminate candidates which aren't the start of a match for the pattern.
+// the filter characters are checked for 64 positions at once, then the whole string is compared
+// at the positions which pass.
+#define SCAN_STRING_FUNCTION(name, T, STRIDE) \
+static T name##_load(uint8_t const *p) { T x; memcpy(&x, p, sizeof x); return x; } \
+static void name(ScanParams const *params, uint8_t const *bytes, size_t n_positions, size_t avail_bytes, uint64_t *candidates) { \
+	StringPattern const *pattern = params->pattern; \
+	size_t len = pattern->len, span = len * sizeof(T); \
+	size_t fo0 = pattern->filter_index[0] * sizeof(T), fo1 = pattern->filter_index[1] * sizeof(T); \
+	T or0 = (T)pattern->filter_or[0], or1 = (T)pattern->filter_or[1]; \
+	T val0 = (T)pattern->filter_value[0], val1 = (T)pattern->filter_value[1]; \
+	for (size_t w = 0; w < n_positions / 64; ++w) { \
+		uint64_t cand = candidates[w]; \
+		if (!cand) continue; \
+		size_t base = w * 64; \
+		uint8_t const *p = &bytes[base * STRIDE]; \
+		uint64_t mask = 0; \
+		if ((base + 63) * STRIDE + span <= avail_bytes) { \
+			for (unsigned i = 0; i < 64; ++i) { \
+				uint64_t match = ((T)(name##_load(&p[i * STRIDE + fo0]) | or0) == val0) \
+					& ((T)(name##_load(&p[i * STRIDE + fo1]) | or1) == val1); \
+				mask |= match << i; \
+			} \
+		} else { \
+			/* near the end of the map */ \
+			for (unsigned i = 0; i < 64; ++i) { \
+				if ((base + i) * STRIDE + span > avail_bytes) break; \
+				uint64_t match = ((T)(name##_load(&p[i * STRIDE + fo0]) | or0) == val0) \
+					& ((T)(name##_load(&p[i * STRIDE + fo1]) | or1) == val1); \
+				mask |= match << i; \
+			} \
+		} \
+		mask &= cand; \
+		uint64_t verified = 0; \
+		while (mask) { \
+			unsigned i = (unsigned)__builtin_ctzll(mask); \
+			mask &= mask - 1; \
+			uint8_t const *s = &p[i * STRIDE]; \
+			size_t j; \
+			if (pattern->case_insensitive) { \
+				for (j = 0; j < len; ++j) \
+					if (char_fold_case(pattern->type, name##_load(&s[j * sizeof(T)])) != pattern->chars[j]) \
+						break; \
+			} else { \
+				for (j = 0; j < len; ++j) \
+					if (name##_load(&s[j * sizeof(T)]) != pattern->chars[j]) \
+						break; \
+			} \
+			if (j == len) verified |= MASK64(i); \
+		} \
+		candidates[w] = verified; \
+	} \
+}
+SCAN_STRING_FUNCTION(scan_string8,            uint8_t,  1)
+SCAN_STRING_FUNCTION(scan_string16,           uint16_t, 2)
+SCAN_STRING_FUNCTION(scan_string32,           uint32_t, 4)
+SCAN_STRING_FUNCTION(scan_string16_unaligned, uint16_t, 1)
+SCAN_STRING_FUNCTION(scan_string32_unaligned, uint32_t, 1)
+#undef SCAN_STRING_FUNCTION
+#undef SCAN_LOOP
+
+// the scan function for each type and predicate, aligned and unaligned.
+// (for 1-byte types, these are the same.)
+#define SCAN_NUMERIC(suffix, unaligned_suffix) { \
+	[PREDICATE_EQUAL]     = {scan_equal_##suffix,     scan_equal_##unaligned_suffix}, \
+	[PREDICATE_RANGE]     = {scan_range_##suffix,     scan_range_##unaligned_suffix}, \
+	[PREDICATE_SAME]      = {scan_same_##suffix,      scan_same_##unaligned_suffix}, \
+	[PREDICATE_DIFFERENT] = {scan_different_##suffix, scan_different_##unaligned_suffix}, \
+	[PREDICATE_ANY]       = {scan_any_##suffix,       scan_any_##unaligned_suffix}, \
+	[PREDICATE_EXPRESSION] = {scan_expression_##suffix, scan_expression_##unaligned_suffix}, \
+}
+// strings are compared item-by-item (like unsigned integers) in same/different searches
+#define SCAN_STRING(string_suffix, string_unaligned_suffix, suffix, unaligned_suffix) { \
+	[PREDICATE_STRING]    = {scan_string##string_suffix, scan_string##string_unaligned_suffix}, \
+	[PREDICATE_SAME]      = {scan_same_##suffix,      scan_same_##unaligned_suffix}, \
+	[PREDICATE_DIFFERENT] = {scan_different_##suffix, scan_different_##unaligned_suffix}, \
+	[PREDICATE_ANY]       = {scan_any_##suffix,       scan_any_##unaligned_suffix}, \
+}
+static ScanFunction const scan_functions[DATA_TYPE_COUNT][PREDICATE_COUNT][2] = {
+	[TYPE_U8]    = SCAN_NUMERIC(u8,  u8),
+	[TYPE_S8]    = SCAN_NUMERIC(s8,  s8),
+	[TYPE_U16]   = SCAN_NUMERIC(u16, u16_unaligned),
+	[TYPE_S16]   = SCAN_NUMERIC(s16, s16_unaligned),
+	[TYPE_U32]   = SCAN_NUMERIC(u32, u32_unaligned),
+	[TYPE_S32]   = SCAN_NUMERIC(s32, s32_unaligned),
+	[TYPE_U64]   = SCAN_NUMERIC(u64, u64_unaligned),
+	[TYPE_S64]   = SCAN_NUMERIC(s64, s64_unaligned),
+	[TYPE_ASCII] = SCAN_STRING(8,  8,            u8,  u8),
+	[TYPE_UTF16] = SCAN_STRING(16, 16_unaligned, u16, u16_unaligned),
+	[TYPE_UTF32] = SCAN_STRING(32, 32_unaligned, u32, u32_unaligned),
+	[TYPE_F32]   = SCAN_NUMERIC(f32, f32_unaligned),
+	[TYPE_F64]   = SCAN_NUMERIC(f64, f64_unaligned),
+};
+#undef SCAN_NUMERIC
+#undef SCAN_STRING
+
+// pick the scan function to use for a search pass
+static ScanFunction scan_function(DataType type, Predicate predicate, bool unaligned) {
+	ScanFunction function = scan_functions[type][predicate][unaligned];
+	assert(function);
+	return function;
+}
+
+// parse the fields of a group search, e.g. "f32 3.5, u16 7, u8 <10".
+// returns false if they're invalid.
+static bool group_parse(char const *str, FloatTolerance tolerance, Group *group) {
+	group->n_fields = 0;
+	while (true) {
+		char const *end = strchr(str, ',');
+		if (!end) end = str + strlen(str);
+		char field_str[128], name[16];
+		snprintf(field_str, sizeof field_str, "%.*s", (int)(end - str), str);
+		int name_len = 0;
+		if (sscanf(field_str, " %15s %n", name, &name_len) != 1)
+			return false;
+		int type = -1;
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+			if (strcmp(name, data_type_name((DataType)t)) == 0)
+				type = t;
+		if (type == -1 || data_type_is_string((DataType)type) || group->n_fields >= GROUP_MAX_FIELDS)
+			return false;
+		GroupField *field = &group->fields[group->n_fields++];
+		field->type = (DataType)type;
+		field->lo = field->hi = 0;
+		if (!data_range_from_str(field_str + name_len, field->type, tolerance, &field->lo, &field->hi))
+			return false;
+		if (!*end) break;
+		str = end + 1;
+	}
+	return true;
+}
+
+// parse a size like 4096, 64K, 1.5M or 2G
+static bool region_size_from_str(char const *str, Address *size) {
+	char *end;
+	double value = strtod(str, &end);
+	if (end == str || value < 0) return false;
+	double multiplier = 1;
+	switch (toupper((unsigned char)*end)) {
+	case 'K': multiplier = 1ul << 10; ++end; break;
+	case 'M': multiplier = 1ul << 20; ++end; break;
+	case 'G': multiplier = 1ul << 30; ++end; break;
+	}
+	if (toupper((unsigned char)*end) == 'B') ++end;
+	if (*end) return false;
+	*size = (Address)(value * multiplier);
+	return true;
+}
+
+// parse region filter rules, separated by spaces, e.g. "heap anon -*nvidia* <1G".
+// each rule is one of:
+//    anon, file, heap, stack, or [name] -- anonymous maps, file-backed maps, or maps with a special name
+//    a glob for the pathname of the map (e.g. /usr/lib/*)
+//    >size, >=size, <size, <=size -- limits on the size of the map (e.g. >=64K)
+// rules starting with - exclude maps which match them. if there are any other rules (besides sizes),
+// maps have to match at least one of them to be searched.
+// returns false if the rules are invalid.
+static bool region_filter_parse(char const *str, RegionFilter *filter) {
+	filter->n_rules = 0;
+	char word[sizeof filter->rules[0].pattern];
+	int len = 0;
+	while (sscanf(str, " %127s%n", word, &len) == 1) {
+		str += len;
+		if (filter->n_rules >= REGION_FILTER_MAX_RULES) return false;
+		RegionRule *rule = &filter->rules[filter->n_rules++];
+		memset(rule, 0, sizeof *rule);
+		char const *text = word;
+		if (*text == '-' || *text == '+') {
+			rule->exclude = *text == '-';
+			++text;
+		}
+		if (*text == '>' || *text == '<') {
+			bool min = *text == '>';
+			bool inclusive = text[1] == '=';
+			text += inclusive ? 2 : 1;
+			if (rule->exclude || !region_size_from_str(text, &rule->size)) return false;
+			rule->kind = min ? REGION_RULE_SIZE_MIN : REGION_RULE_SIZE_MAX;
+			if (!inclusive) {
+				if (min) ++rule->size;
+				else if (rule->size) --rule->size;
+				else return false;
+			}
+		} else if (strcmp(text, "anon") == 0) {
+			rule->kind = REGION_RULE_ANON;
+		} else if (strcmp(text, "file") == 0) {
+			rule->kind = REGION_RULE_FILE;
+		} else if (strcmp(text, "heap") == 0 || strcmp(text, "stack") == 0) {
+			rule->kind = REGION_RULE_NAME;
+			snprintf(rule->pattern, sizeof rule->pattern, "[%s]", text);
+		} else if (*text == '[') {
+			rule->kind = REGION_RULE_NAME;
+			snprintf(rule->pattern, sizeof rule->pattern, "%s", text);
+		} else if (*text) {
+			rule->kind = REGION_RULE_GLOB;
+			snprintf(rule->pattern, sizeof rule->pattern, "%s", text);
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// should the map with this pathname ("" for anonymous maps) and size be searched?
+static bool region_filter_match(RegionFilter const *filter, char const *pathname, Address size) {
+	bool any_includes = false, included = false;
+	for (unsigned i = 0; i < filter->n_rules; ++i) {
+		RegionRule const *rule = &filter->rules[i];
+		bool match = false;
+		switch (rule->kind) {
+		case REGION_RULE_SIZE_MIN:
+			if (size < rule->size) return false;
+			continue;
+		case REGION_RULE_SIZE_MAX:
+			if (size > rule->size) return false;
+			continue;
+		case REGION_RULE_ANON:
+			match = !*pathname;
+			break;
+		case REGION_RULE_FILE:
+			match = *pathname == '/';
+			break;
+		case REGION_RULE_NAME:
+			match = strcmp(pathname, rule->pattern) == 0;
+			break;
+		case REGION_RULE_GLOB:
+			match = *pathname && fnmatch(rule->pattern, pathname, 0) == 0;
+			break;
+		}
+		if (rule->exclude) {
+			if (match) return false;
+		} else {
+			any_includes = true;
+			included |= match;
+		}
+	}
+	return included || !any_includes;
+}
+
+// are any of the bits lo, lo+1, ..., hi-1 set?
+static bool bitset_any(uint64_t const *bits, size_t lo, size_t hi) {
+	for (size_t w = lo / 64; w * 64 < hi; ++w) {
+		uint64_t word = bits[w];
+		if (w == lo / 64) word &= ~(uint64_t)0 << (lo % 64);
+		if ((w + 1) * 64 > hi) word &= MASK64(hi % 64) - 1;
+		if (word) return true;
+	}
+	return false;
+}
+
+// Eliminate candidates which don't have a value matching each of the group's fields
+// less than group->window bytes before or after them.
+// bytes[0] is the start of the chunk; bytes[-GROUP_MAX_WINDOW] to bytes[avail_bytes - 1] can be read,
+// but only the memory from bytes[-before] onwards is actually in the map.
+static void group_search_chunk(Group const *group, bool unaligned, uint8_t const *bytes, size_t before,
+	size_t stride, size_t n_positions, size_t avail_bytes, uint64_t *candidates) {
+	// for each field, which positions from bytes[-GROUP_MAX_WINDOW] to bytes[4096 + GROUP_MAX_WINDOW] match it.
+	// the candidates are usually sparse by the time we get here, so it's faster to look for
+	// the fields all at once and then check each candidate's neighbourhood with a few bit operations.
+	// (not static, since processes are searched on multiple threads)
+	uint64_t matches[GROUP_MAX_FIELDS][(4096 + 2 * GROUP_MAX_WINDOW) / 64];
+	uint8_t const *window_bytes = bytes - GROUP_MAX_WINDOW;
+	size_t window_size = 4096 + 2 * GROUP_MAX_WINDOW;
+	size_t window = group->window;
+	
+	bool any_candidates = false;
+	for (size_t w = 0; w < n_positions / 64; ++w)
+		any_candidates |= candidates[w] != 0;
+	if (!any_candidates) return;
+	
+	size_t field_stride[GROUP_MAX_FIELDS];
+	for (unsigned f = 0; f < group->n_fields; ++f) {
+		GroupField const *field = &group->fields[f];
+		size_t fstride = field_stride[f] = unaligned ? 1 : data_type_size(field->type);
+		size_t n = window_size / fstride;
+		memset(matches[f], 0xff, n / 8);
+		ScanParams params = {.lo = field->lo, .hi = field->hi};
+		scan_function(field->type, PREDICATE_RANGE, unaligned)(&params, window_bytes, n, GROUP_MAX_WINDOW + avail_bytes, matches[f]);
+		// values before the start of the map don't count
+		for (size_t p = 0; p * fstride < GROUP_MAX_WINDOW - before; ++p)
+			matches[f][p / 64] &= ~MASK64(p % 64);
+	}
+	
+	for (size_t w = 0; w < n_positions / 64; ++w) {
+		uint64_t cand = candidates[w];
+		uint64_t remaining = cand;
+		while (remaining) {
+			unsigned i = (unsigned)__builtin_ctzll(remaining);
+			remaining &= remaining - 1;
+			size_t pos = GROUP_MAX_WINDOW + (w * 64 + i) * stride; // position of candidate in window_bytes
+			for (unsigned f = 0; f < group->n_fields; ++f) {
+				size_t fstride = field_stride[f];
+				// fields can be anywhere within the window except at the candidate itself
+				size_t lo = (pos - window + fstride) / fstride, hi = (pos + window + fstride - 1) / fstride;
+				bool found;
+				if (pos % fstride == 0)
+					found = bitset_any(matches[f], lo, pos / fstride) || bitset_any(matches[f], pos / fstride + 1, hi);
+				else
+					found = bitset_any(matches[f], lo, hi);
+				if (!found) {
+					cand &= ~MASK64(i);
+					break;
+				}
+			}
+		}
+		candidates[w] = cand;
+	}
+}
+
+// the most candidates shown while a step of a search is running (memory-n-items is at most 999)
+#define SEARCH_PASS_MAX_FOUND 1000
+
+// searching one process, which can be done on any thread
+typedef struct {
+	SearchPass *pass;
+	Process *proc;
+	int reader;
+	gint64 pause_end; // when the process was allowed to continue (0 if it wasn't until the reader was closed)
+	bool out_of_memory;
+	// these are protected by pass->mutex
+	Address bytes_total, bytes_done; // how much memory there is to search, and how much has been searched
+	Address n_removed[DATA_TYPE_COUNT]; // number of candidates eliminated so far
+	// candidates (of type pass->view_type) which have been checked so far
+	Address found[SEARCH_PASS_MAX_FOUND];
+	unsigned n_found;
+} SearchJob;
+
+// one step of a search. the processes are searched on other threads, while frame_callback
+// shows how it's going.
+struct SearchPass {
+	State const *state;
+	SearchType search_type;
+	size_t stride[DATA_TYPE_COUNT]; // 0 for types which aren't being searched for
+	// the functions which do the actual work are picked once, here, rather than for each chunk
+	ScanFunction scan[DATA_TYPE_COUNT];
+	ScanParams params[DATA_TYPE_COUNT];
+	StringPattern pattern; // for string searches
+	Filter filters[DATA_TYPE_COUNT]; // for expression searches
+	// how many bytes past the last position in a chunk do we need to look at?
+	size_t overlap;
+	Group const *group; // NULL if this isn't a group search
+	ReadTuning tuning;
+	// a hash of everything that decides which positions match (see search_pass_signature),
+	// or 0 if unchanged pages aren't being skipped on this step
+	uint64_t signature;
+	DataType view_type; // the type of candidates the memory view is showing
+	unsigned max_found; // how many candidates each job should keep for the memory view
+	SearchJob *jobs; // one for each process
+	unsigned n_jobs;
+	GThreadPool *pool;
+	gint64 pause_start;
+	Address n_candidates_before[DATA_TYPE_COUNT];
+	unsigned n_found_shown; // number of candidates in the memory view
+	bool data_types_sensitive; // was data-type-box sensitive before the step started?
+	GMutex mutex;
+	// these are protected by mutex
+	unsigned jobs_left;
+	bool cancel; // stop the step early
+};
+
+// add what a filter does to the hash h.
+// (this and search_pass_signature hash each field, since the structs' padding and unused entries aren't always zeroed)
+static uint64_t search_filter_signature(Filter const *filter, uint64_t h) {
+	h = page_hash(&filter->tolerance.amount, sizeof filter->tolerance.amount, h);
+	h = page_hash(&filter->tolerance.relative, sizeof filter->tolerance.relative, h);
+	for (unsigned c = 0; c < filter->n_code; ++c) {
+		FilterOp op = filter->code[c];
+		h = page_hash(&op.opcode, sizeof op.opcode, h);
+		if (op.opcode == FILTER_CONST)
+			h = page_hash(&filter->consts[op.constant], sizeof *filter->consts, h);
+	}
+	return h;
+}
+
+// a hash of what a step is looking for. if a page of memory was checked on a step with the same signature,
+// and it hasn't changed since, all the candidates left in it must still match, so it can be skipped.
+// (candidates are only ever removed, so this is still true if other steps happened in between.)
+static uint64_t search_pass_signature(SearchPass const *pass) {
+	uint64_t h = page_hash(&pass->search_type, sizeof pass->search_type, 0);
+	h = page_hash(pass->stride, sizeof pass->stride, h);
+	h = page_hash(&pass->overlap, sizeof pass->overlap, h);
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+		ScanParams const *params = &pass->params[t];
+		if (!pass->scan[t]) continue;
+		h = page_hash(&pass->scan[t], sizeof pass->scan[t], h);
+		h = page_hash(&params->lo, sizeof params->lo, h);
+		h = page_hash(&params->hi, sizeof params->hi, h);
+		if (params->filter)
+			h = search_filter_signature(params->filter, h);
+		if (params->pattern) {
+			StringPattern const *pattern = params->pattern;
+			h = page_hash(&pattern->type, sizeof pattern->type, h);
+			h = page_hash(&pattern->case_insensitive, sizeof pattern->case_insensitive, h);
+			h = page_hash(pattern->chars, pattern->len * sizeof *pattern->chars, h);
+		}
+	}
+	if (pass->group) {
+		Group const *group = pass->group;
+		h = page_hash(&group->window, sizeof group->window, h);
+		for (unsigned f = 0; f < group->n_fields; ++f) {
+			GroupField const *field = &group->fields[f];
+			h = page_hash(&field->type, sizeof field->type, h);
+			h = page_hash(&field->lo, sizeof field->lo, h);
+			h = page_hash(&field->hi, sizeof field->hi, h);
+		}
+	}
+	return h ? h : 1;
+}
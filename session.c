@@ -0,0 +1,430 @@
+// search sessions: saving a search to a file so it can be picked up again later
+//
+// a session file is:
+//    SessionHeader
+//    for each process being searched:
+//       SessionProcess
+//       Map maps[process.nmaps]
+//       for each type being searched for: SessionCandidates, then the candidates (padded to a multiple of 8 bytes)
+// everything is in the native byte order, and the file is memory-mapped when it's loaded.
+// for same/different searches, the memory at the previous step is kept in <session file>.snapshot
+// (<session file>.snapshot.1, .2, ... for the other processes). the search never writes to these --
+// they're copied from/to its own temporary file when the session is saved/loaded, so they always go
+// with the candidates in the session file.
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static char const SESSION_IDENT[4] = {'\xff', 'S', 'E', 'S'};
+#define SESSION_VERSION 3
+
+typedef struct {
+	char ident[4];
+	uint32_t version;
+	uint32_t data_type;
+	uint32_t search_type;
+	uint32_t unaligned;
+	uint32_t tolerance_relative;
+	double tolerance_amount;
+	uint64_t steps_completed;
+	char protection[8];
+	uint64_t n_processes; // number of SessionProcesses
+} SessionHeader;
+
+typedef struct {
+	int64_t pid;
+	uint64_t nmaps;
+	uint64_t n_types; // number of SessionCandidates
+} SessionProcess;
+
+typedef enum {
+	// one LEB128 varint per candidate, giving the difference between its bitset index and the previous one's.
+	SESSION_CANDIDATES_DELTAS,
+	// the bitset itself (used when most positions are still candidates).
+	SESSION_CANDIDATES_BITSET
+} SessionCandidatesEncoding;
+
+typedef struct {
+	uint32_t type;
+	uint32_t encoding;
+	uint64_t count; // number of candidates
+	uint64_t nbytes; // size of encoded candidates, not including padding
+} SessionCandidates;
+
+// search state read from a session file
+typedef struct {
+	DataType data_type;
+	SearchType search_type;
+	bool unaligned;
+	FloatTolerance tolerance;
+	long steps_completed;
+	char protection[8];
+	// maps, candidates and snapshots of the processes (with the PIDs they had when the session was saved)
+	Process *processes;
+	unsigned n_processes;
+} Session;
+
+static void session_free(Session *session) {
+	for (unsigned p = 0; p < session->n_processes; ++p)
+		process_free(&session->processes[p]);
+	free(session->processes);
+	memset(session, 0, sizeof *session);
+}
+
+// name of the snapshot file for process #p
+static void session_snapshot_name(char const *filename, unsigned p, char *out, size_t out_size) {
+	if (p)
+		snprintf(out, out_size, "%s.snapshot.%u", filename, p);
+	else
+		snprintf(out, out_size, "%s.snapshot", filename);
+}
+
+static size_t varint_size(uint64_t x) {
+	size_t size = 1;
+	while (x >= 0x80) {
+		x >>= 7;
+		++size;
+	}
+	return size;
+}
+
+static size_t varint_encode(uint64_t x, uint8_t *out) {
+	size_t i = 0;
+	while (x >= 0x80) {
+		out[i++] = (uint8_t)(x | 0x80);
+		x >>= 7;
+	}
+	out[i++] = (uint8_t)x;
+	return i;
+}
+
+// returns the number of bytes read, or 0 if the varint is invalid/runs past end.
+static size_t varint_decode(uint8_t const *p, uint8_t const *end, uint64_t *x) {
+	uint64_t value = 0;
+	for (size_t i = 0; i < 10 && p + i < end; ++i) {
+		value |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+		if (!(p[i] & 0x80)) {
+			*x = value;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+// write the bitset indices of the candidates as deltas
+static void session_write_deltas(FILE *fp, Bitset const *bitset) {
+	uint8_t buf[4096];
+	size_t buf_used = 0;
+	uint64_t prev = 0;
+	Address n_bits = bitset->n_words * 64;
+	for (Address index = bitset_next(bitset, 0); index < n_bits; index = bitset_next(bitset, index + 1)) {
+		if (buf_used + 10 > sizeof buf) {
+			fwrite(buf, 1, buf_used, fp);
+			buf_used = 0;
+		}
+		buf_used += varint_encode(index - prev, &buf[buf_used]);
+		prev = index;
+	}
+	fwrite(buf, 1, buf_used, fp);
+}
+
+// copy all of from to to. returns false on failure.
+static bool session_copy_file(FILE *from, FILE *to) {
+	static uint8_t block[65536];
+	size_t n;
+	rewind(from);
+	while ((n = fread(block, 1, sizeof block, from)) > 0)
+		if (fwrite(block, 1, n, to) != n) return false;
+	return !ferror(from) && fflush(to) == 0;
+}
+
+// write process #p's memory at the previous step to a temporary file next to its snapshot file,
+// which session_save renames to the snapshot once the session file has been written too.
+static bool session_save_snapshot(State *state, char const *filename, unsigned p) {
+	Process *proc = &state->processes[p];
+	FILE *prev_mem = proc->prev_memory;
+	if (!prev_mem) return true;
+	char snapshot_name[4096], tmp_name[4200];
+	session_snapshot_name(filename, p, snapshot_name, sizeof snapshot_name);
+	snprintf(tmp_name, sizeof tmp_name, "%s.tmp", snapshot_name);
+	FILE *snapshot = fopen(tmp_name, "wb");
+	if (!snapshot) {
+		display_error(state, "Couldn't open %s: %s.", tmp_name, strerror(errno));
+		return false;
+	}
+	bool success = session_copy_file(prev_mem, snapshot);
+	if (fclose(snapshot) != 0) success = false;
+	if (!success) {
+		display_error(state, "Couldn't write to %s: %s.", tmp_name, strerror(errno));
+		remove(tmp_name);
+	}
+	return success;
+}
+
+// remove the temporary files session_save_snapshot wrote for the first n processes (if they're still there)
+static void session_remove_snapshots(State *state, char const *filename, unsigned n) {
+	for (unsigned p = 0; p < n; ++p) {
+		char snapshot_name[4096], tmp_name[4200];
+		session_snapshot_name(filename, p, snapshot_name, sizeof snapshot_name);
+		snprintf(tmp_name, sizeof tmp_name, "%s.tmp", snapshot_name);
+		remove(tmp_name);
+	}
+}
+
+// write a SessionProcess, then the process's maps and candidates
+static void session_write_process(FILE *fp, Process const *proc) {
+	SessionProcess process_header = {0};
+	process_header.pid = proc->pid;
+	process_header.nmaps = proc->nmaps;
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+		if (proc->search_candidates[t])
+			++process_header.n_types;
+	fwrite(&process_header, sizeof process_header, 1, fp);
+	fwrite(proc->maps, sizeof *proc->maps, proc->nmaps, fp);
+
+	for (int t = 0; t < DATA_TYPE_COUNT; ++t) {
+		DataType type = (DataType)t;
+		Bitset const *bitset = proc->search_candidates[type];
+		if (!bitset) continue;
+		Address entries = bitset->n_words;
+		SessionCandidates cands = {0};
+		cands.type = type;
+		cands.count = bitset_count(bitset);
+		uint64_t deltas_size = 0, prev = 0;
+		// (no need to keep going once we know the bitset is smaller)
+		for (Address index = bitset_next(bitset, 0); index < entries * 64 && deltas_size < entries * 8;
+			index = bitset_next(bitset, index + 1)) {
+			deltas_size += varint_size(index - prev);
+			prev = index;
+		}
+		if (deltas_size < entries * 8) {
+			cands.encoding = SESSION_CANDIDATES_DELTAS;
+			cands.nbytes = deltas_size;
+			fwrite(&cands, sizeof cands, 1, fp);
+			session_write_deltas(fp, bitset);
+		} else {
+			cands.encoding = SESSION_CANDIDATES_BITSET;
+			cands.nbytes = entries * 8;
+			fwrite(&cands, sizeof cands, 1, fp);
+			for (Address w = 0; w < entries; w += BITSET_BLOCK_WORDS) {
+				Address n = entries - w;
+				if (n > BITSET_BLOCK_WORDS) n = BITSET_BLOCK_WORDS;
+				fwrite(bitset_words(bitset, w), 8, (size_t)n, fp);
+			}
+		}
+		static uint8_t const zeroes[8];
+		fwrite(zeroes, 1, (size_t)(-cands.nbytes & 7), fp);
+	}
+}
+
+static bool session_save(State *state, char const *filename, long steps_completed) {
+	if (!state->searching) {
+		display_error_nofmt(state, "There's no search to save.");
+		return false;
+	}
+	// write everything to temporary files then rename them, so we never leave behind a half-written session
+	// (or a snapshot which doesn't go with the session's candidates).
+	unsigned n_snapshots = 0;
+	bool success = true;
+	for (; n_snapshots < state->n_processes && success; ++n_snapshots)
+		success = session_save_snapshot(state, filename, n_snapshots);
+	char tmp_name[4096];
+	snprintf(tmp_name, sizeof tmp_name, "%s.tmp", filename);
+	FILE *fp = success ? fopen(tmp_name, "wb") : NULL;
+	if (success && !fp) {
+		display_error(state, "Couldn't open %s: %s.", tmp_name, strerror(errno));
+		success = false;
+	}
+	if (!success) {
+		session_remove_snapshots(state, filename, n_snapshots);
+		return false;
+	}
+
+	SessionHeader header = {0};
+	memcpy(header.ident, SESSION_IDENT, sizeof SESSION_IDENT);
+	header.version = SESSION_VERSION;
+	header.data_type = state->data_type;
+	header.search_type = state->search_type;
+	header.unaligned = state->search_unaligned;
+	header.tolerance_relative = state->float_tolerance.relative;
+	header.tolerance_amount = state->float_tolerance.amount;
+	header.steps_completed = (uint64_t)steps_completed;
+	snprintf(header.protection, sizeof header.protection, "%s",
+		gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(state->builder, "protection"))));
+	header.n_processes = state->n_processes;
+	fwrite(&header, sizeof header, 1, fp);
+	for (unsigned p = 0; p < state->n_processes; ++p)
+		session_write_process(fp, &state->processes[p]);
+
+	success = !ferror(fp);
+	if (fclose(fp) != 0) success = false;
+	for (unsigned p = 0; p < state->n_processes && success; ++p) {
+		if (!state->processes[p].prev_memory) continue;
+		char snapshot_name[4096], snapshot_tmp_name[4200];
+		session_snapshot_name(filename, p, snapshot_name, sizeof snapshot_name);
+		snprintf(snapshot_tmp_name, sizeof snapshot_tmp_name, "%s.tmp", snapshot_name);
+		if (rename(snapshot_tmp_name, snapshot_name) != 0) success = false;
+	}
+	if (success && rename(tmp_name, filename) != 0) success = false;
+	if (!success) {
+		display_error(state, "Couldn't write to %s: %s.", filename, strerror(errno));
+		remove(tmp_name);
+		session_remove_snapshots(state, filename, n_snapshots);
+	}
+	return success;
+}
+
+// read a session from a file. on success, the processes' snapshots (if any) are copied into their prev_memory.
+static bool session_load(State *state, char const *filename, Session *session) {
+	memset(session, 0, sizeof *session);
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		display_error(state, "Couldn't open %s: %s.", filename, strerror(errno));
+		return false;
+	}
+	struct stat st = {0};
+	fstat(fd, &st);
+	size_t file_size = (size_t)st.st_size;
+	uint8_t const *data = file_size ? mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (data == MAP_FAILED) {
+		display_error(state, "%s is not a session file.", filename);
+		return false;
+	}
+	uint8_t const *end = data + file_size;
+	uint8_t const *p = data;
+	bool success = false;
+
+	SessionHeader header = {0};
+	if (file_size < sizeof header) goto invalid;
+	memcpy(&header, p, sizeof header);
+	p += sizeof header;
+	if (memcmp(header.ident, SESSION_IDENT, sizeof SESSION_IDENT) != 0) {
+		display_error(state, "%s is not a session file.", filename);
+		goto done;
+	}
+	if (header.version != SESSION_VERSION) {
+		display_error(state, "%s was saved by a different version of pokemem.", filename);
+		goto done;
+	}
+	if (header.data_type >= DATA_TYPE_COUNT || header.search_type > SEARCH_SAME_DIFFERENT
+		|| header.n_processes == 0 || header.n_processes > (size_t)(end - p) / sizeof(SessionProcess)
+		|| memchr(header.protection, '\0', sizeof header.protection) == NULL)
+		goto invalid;
+	session->data_type = (DataType)header.data_type;
+	session->search_type = (SearchType)header.search_type;
+	session->unaligned = header.unaligned != 0;
+	session->tolerance.relative = header.tolerance_relative != 0;
+	session->tolerance.amount = header.tolerance_amount;
+	session->steps_completed = (long)header.steps_completed;
+	memcpy(session->protection, header.protection, sizeof header.protection);
+	session->processes = calloc(header.n_processes, sizeof *session->processes);
+	if (!session->processes) goto out_of_memory;
+	session->n_processes = (unsigned)header.n_processes;
+
+	for (unsigned i = 0; i < session->n_processes; ++i) {
+		Process *proc = &session->processes[i];
+		SessionProcess process_header = {0};
+		if ((size_t)(end - p) < sizeof process_header) goto invalid;
+		memcpy(&process_header, p, sizeof process_header);
+		p += sizeof process_header;
+		if (process_header.nmaps > (size_t)(end - p) / sizeof(Map) || process_header.n_types > DATA_TYPE_COUNT)
+			goto invalid;
+		proc->pid = (PID)process_header.pid;
+		proc->nmaps = (unsigned)process_header.nmaps;
+		proc->maps = calloc(process_header.nmaps + 1, sizeof(Map));
+		if (!proc->maps) goto out_of_memory;
+		memcpy(proc->maps, p, process_header.nmaps * sizeof(Map));
+		p += process_header.nmaps * sizeof(Map);
+		for (unsigned m = 0; m < proc->nmaps; ++m) {
+			// bitsets rely on maps being multiples of the page size
+			if (proc->maps[m].size % 4096 || proc->maps[m].kind >= MAP_KIND_COUNT) goto invalid;
+			proc->total_memory += proc->maps[m].size;
+		}
+
+		for (uint64_t j = 0; j < process_header.n_types; ++j) {
+			SessionCandidates cands = {0};
+			if ((size_t)(end - p) < sizeof cands) goto invalid;
+			memcpy(&cands, p, sizeof cands);
+			p += sizeof cands;
+			if (cands.type >= DATA_TYPE_COUNT || proc->search_candidates[cands.type]
+				|| cands.nbytes > (size_t)(end - p))
+				goto invalid;
+			DataType type = (DataType)cands.type;
+			size_t stride = session->unaligned ? 1 : data_type_size(type);
+			Address entries = proc->total_memory / (64 * stride);
+			Bitset *bitset = proc->search_candidates[type] = bitset_new(entries * 64, false);
+			if (!bitset) goto out_of_memory;
+			uint8_t const *payload = p, *payload_end = p + cands.nbytes;
+			switch (cands.encoding) {
+			case SESSION_CANDIDATES_DELTAS: {
+				uint64_t index = 0;
+				for (uint64_t c = 0; c < cands.count; ++c) {
+					uint64_t delta = 0;
+					size_t len = varint_decode(payload, payload_end, &delta);
+					if (!len) goto invalid;
+					payload += len;
+					index += delta;
+					if (index >= entries * 64) goto invalid;
+					if (!bitset_set(bitset, index)) goto out_of_memory;
+				}
+			} break;
+			case SESSION_CANDIDATES_BITSET:
+				if (cands.nbytes != entries * 8) goto invalid;
+				for (Address w = 0; w < entries; w += BITSET_BLOCK_WORDS) {
+					uint64_t words[BITSET_BLOCK_WORDS];
+					size_t n = (size_t)(entries - w);
+					if (n > BITSET_BLOCK_WORDS) n = BITSET_BLOCK_WORDS;
+					memcpy(words, payload + w * 8, n * 8);
+					if (!bitset_update_end(bitset, w, n, words)) goto out_of_memory;
+				}
+				break;
+			default:
+				goto invalid;
+			}
+			p = payload_end;
+			p += -cands.nbytes & 7;
+			if (p > end) goto invalid;
+		}
+		// every process searches for the same types
+		for (int t = 0; t < DATA_TYPE_COUNT; ++t)
+			if (!proc->search_candidates[t] != !session->processes[0].search_candidates[t])
+				goto invalid;
+
+		if (session->search_type == SEARCH_SAME_DIFFERENT) {
+			char snapshot_name[4096];
+			session_snapshot_name(filename, i, snapshot_name, sizeof snapshot_name);
+			FILE *fp = fopen(snapshot_name, "rb");
+			struct stat snapshot_stat = {0};
+			if (!fp) {
+				display_error(state, "Couldn't open %s: %s.", snapshot_name, strerror(errno));
+				goto done;
+			}
+			if (fstat(fileno(fp), &snapshot_stat) != 0 || (Address)snapshot_stat.st_size != proc->total_memory) {
+				display_error(state, "%s doesn't match %s.", snapshot_name, filename);
+				fclose(fp);
+				goto done;
+			}
+			// (the search updates prev_memory at each step, which shouldn't change the saved session)
+			proc->prev_memory = tmpfile();
+			bool copied = proc->prev_memory && session_copy_file(fp, proc->prev_memory);
+			fclose(fp);
+			if (!copied) {
+				display_error(state, "Couldn't copy %s: %s.", snapshot_name, strerror(errno));
+				goto done;
+			}
+		}
+	}
+	success = true;
+	goto done;
+
+invalid:
+	display_error(state, "%s is an invalid session file.", filename);
+	goto done;
+out_of_memory:
+	display_error_nofmt(state, "Not enough memory available to load session.");
+done:
+	munmap((void *)data, file_size);
+	if (!success) session_free(session);
+	return success;
+}
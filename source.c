@@ -0,0 +1,455 @@
+// searching memory which was saved earlier, rather than a running process: memory files (see memfile_write_all)
+// and ELF core dumps (e.g. from gcore, or from a process which crashed).
+//
+// a memory source is opened by entering its path instead of a PID. it gets a made-up PID below 0, so the
+// rest of pokemem can treat it like a process which never changes (and can't be stopped or written to),
+// and that PID is also its "reader" (see memory_reader_open). the file is mapped into memory, so reading is
+// just copying from the mapping, and search steps look at the mapping directly wherever the memory they
+// want is in one piece in the file (see read_ahead_get).
+
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+
+static char const MEMFILE_IDENT[4] = {'\xff', 'M', 'E', 'M'};
+
+// most memory sources open at once
+#define SOURCE_MAX 16
+// zeros mapped before and after the file, so that reading a little way outside of the memory which
+// was asked for (which search steps do -- see ReadRequest) doesn't go outside of the mapping
+#define SOURCE_SLACK 8192
+
+typedef enum {
+	SOURCE_MEMFILE,
+	SOURCE_CORE
+} SourceKind;
+
+// a piece of memory which is in the file
+typedef struct {
+	Address lo, size;
+	Address file_size; // memory after this much isn't in the file, and is all zeros (core dumps leave it out)
+	uint64_t offset; // where the memory is in the file
+} SourceRange;
+
+// a map of the process the memory is from (see source_open_maps)
+typedef struct {
+	Address lo, hi;
+	char protection[8]; // empty for memory files, which don't say
+	char *pathname; // NULL if there isn't one
+} SourceMap;
+
+typedef struct {
+	SourceKind kind;
+	char filename[256];
+	PID pid; // process a core dump is from (0 if it isn't known)
+	uint8_t *mapping;
+	size_t mapping_size;
+	uint8_t const *data; // the file (in mapping, after SOURCE_SLACK bytes)
+	size_t size;
+	SourceRange *ranges; // in order of address
+	unsigned n_ranges;
+	SourceMap *maps; // in order of address, and made up of whole pages
+	unsigned n_maps;
+} MemorySource;
+
+// the memory sources which are open. source #i has the PID -1-i.
+// (this isn't in State, since reading memory can happen on any thread, with just a reader)
+static MemorySource *sources[SOURCE_MAX];
+
+static MemorySource *source_get(PID pid) {
+	if (pid >= 0 || pid < -SOURCE_MAX) return NULL;
+	return sources[-1 - pid];
+}
+
+static void source_free(MemorySource *source) {
+	if (source->mapping) munmap(source->mapping, source->mapping_size);
+	for (unsigned m = 0; m < source->n_maps; ++m)
+		free(source->maps[m].pathname);
+	free(source->maps);
+	free(source->ranges);
+	memset(source, 0, sizeof *source);
+}
+
+static bool source_add_range(MemorySource *source, Address lo, Address size, Address file_size, uint64_t offset) {
+	// (grow the array whenever its size gets to a power of 2)
+	unsigned n = source->n_ranges;
+	if ((n & (n - 1)) == 0) {
+		SourceRange *ranges = realloc(source->ranges, (n ? 2 * n : 1) * sizeof *ranges);
+		if (!ranges) return false;
+		source->ranges = ranges;
+	}
+	SourceRange *range = &source->ranges[source->n_ranges++];
+	range->lo = lo;
+	range->size = size;
+	range->file_size = file_size;
+	range->offset = offset;
+	return true;
+}
+
+static int source_range_cmp(void const *av, void const *bv) {
+	SourceRange const *a = av, *b = bv;
+	return a->lo < b->lo ? -1 : a->lo > b->lo;
+}
+
+static int source_map_cmp(void const *av, void const *bv) {
+	SourceMap const *a = av, *b = bv;
+	return a->lo < b->lo ? -1 : a->lo > b->lo;
+}
+
+// the last range starting at or before addr (or NULL if there isn't one)
+static SourceRange const *source_range_before(MemorySource const *source, Address addr) {
+	unsigned lo = 0, hi = source->n_ranges;
+	while (lo < hi) {
+		unsigned mid = (lo + hi) / 2;
+		if (source->ranges[mid].lo <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo ? &source->ranges[lo - 1] : NULL;
+}
+
+// the map addr is in (or NULL if there isn't one)
+static SourceMap const *source_map_at(MemorySource const *source, Address addr) {
+	unsigned lo = 0, hi = source->n_maps;
+	while (lo < hi) {
+		unsigned mid = (lo + hi) / 2;
+		if (source->maps[mid].lo <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo && addr < source->maps[lo - 1].hi)
+		return &source->maps[lo - 1];
+	return NULL;
+}
+
+// make the maps for a memory file: each stretch of memory in it, rounded out to whole pages
+static bool source_memfile_maps(MemorySource *source) {
+	source->maps = calloc(source->n_ranges + 1, sizeof *source->maps);
+	if (!source->maps) return false;
+	for (unsigned r = 0; r < source->n_ranges; ++r) {
+		SourceRange const *range = &source->ranges[r];
+		Address lo = range->lo / 4096 * 4096;
+		Address hi = (range->lo + range->size + 4095) / 4096 * 4096;
+		SourceMap *last = source->n_maps ? &source->maps[source->n_maps - 1] : NULL;
+		if (last && lo <= last->hi) {
+			if (hi > last->hi) last->hi = hi;
+		} else {
+			SourceMap *map = &source->maps[source->n_maps++];
+			map->lo = lo;
+			map->hi = hi;
+		}
+	}
+	return true;
+}
+
+// returns NULL on success, or what's wrong with the file
+static char const *source_load_memfile(MemorySource *source) {
+	uint8_t const *p = source->data + sizeof MEMFILE_IDENT, *end = source->data + source->size;
+	Address addr = 0;
+	// (this reads the format written by memfile_write_bytes)
+	while (p < end) {
+		uint8_t first_byte = *p++;
+		uint64_t nbytes = 0;
+		size_t length_size = 0;
+		switch (first_byte & 0xE0) {
+		case 0x00:
+		case 0x20:
+			// 6 bits address increment
+			addr += first_byte & 0x3F;
+			continue;
+		case 0x40:
+			// 5 bits + 1 byte address increment
+			if (p == end) return "it's been cut off";
+			addr += (Address)(first_byte & 0x1F) + ((Address)*p++ << 5);
+			continue;
+		case 0x60:
+			// constant 8-byte address
+			if (first_byte != 0x60) return "it's invalid";
+			if (end - p < (ptrdiff_t)sizeof addr) return "it's been cut off";
+			memcpy(&addr, p, sizeof addr);
+			p += sizeof addr;
+			continue;
+		case 0x80:
+		case 0xA0:
+			// 6 bit length
+			nbytes = first_byte & 0x3F;
+			break;
+		case 0xC0:
+			// 2 byte length
+			length_size = 2;
+			break;
+		case 0xE0:
+			// 8 byte length
+			length_size = 8;
+			break;
+		}
+		if (length_size) {
+			if ((first_byte & 0x1F) != 0) return "it's invalid";
+			if (end - p < (ptrdiff_t)length_size) return "it's been cut off";
+			memcpy(&nbytes, p, length_size);
+			p += length_size;
+		}
+		if (nbytes > (uint64_t)(end - p)) return "it's been cut off";
+		if (nbytes && !source_add_range(source, addr, nbytes, nbytes, (uint64_t)(p - source->data)))
+			return "there isn't enough memory available";
+		addr += nbytes;
+		p += nbytes;
+	}
+	if (!source->n_ranges) return "it doesn't have any memory in it";
+	qsort(source->ranges, source->n_ranges, sizeof *source->ranges, source_range_cmp);
+	if (!source_memfile_maps(source)) return "there isn't enough memory available";
+	return NULL;
+}
+
+// find the pathnames of a core dump's maps from its NT_FILE note
+static void source_core_names(MemorySource *source, uint8_t const *desc, size_t desc_size) {
+	// the note is: count, page size, count * (start, end, file offset), then count null-terminated names
+	uint64_t header[2];
+	if (desc_size < sizeof header) return;
+	memcpy(header, desc, sizeof header);
+	uint64_t count = header[0];
+	if (count > (desc_size - sizeof header) / 24) return;
+	char const *name = (char const *)desc + sizeof header + count * 24;
+	char const *names_end = (char const *)desc + desc_size;
+	for (uint64_t i = 0; i < count && name < names_end; ++i) {
+		uint64_t start;
+		memcpy(&start, desc + sizeof header + i * 24, sizeof start);
+		size_t len = strnlen(name, (size_t)(names_end - name));
+		SourceMap const *map = source_map_at(source, start);
+		if (map && map->lo == start && !map->pathname)
+			source->maps[map - source->maps].pathname = strndup(name, len);
+		name += len + 1;
+	}
+}
+
+// returns NULL on success, or what's wrong with the file
+static char const *source_load_core(MemorySource *source) {
+	Elf64_Ehdr header;
+	if (source->size < sizeof header) return "it's been cut off";
+	memcpy(&header, source->data, sizeof header);
+	if (header.e_ident[EI_CLASS] != ELFCLASS64 || header.e_ident[EI_DATA] != ELFDATA2LSB)
+		return "only 64-bit little-endian core dumps are supported";
+	if (header.e_type != ET_CORE) return "it's an ELF file, but not a core dump";
+	if (header.e_phentsize != sizeof(Elf64_Phdr) || header.e_phoff > source->size
+		|| header.e_phnum > (source->size - header.e_phoff) / sizeof(Elf64_Phdr))
+		return "its program headers are invalid";
+	source->maps = calloc((size_t)header.e_phnum + 1, sizeof *source->maps);
+	if (!source->maps) return "there isn't enough memory available";
+	for (unsigned i = 0; i < header.e_phnum; ++i) {
+		Elf64_Phdr segment;
+		memcpy(&segment, source->data + header.e_phoff + i * sizeof segment, sizeof segment);
+		if (segment.p_type != PT_LOAD || !segment.p_memsz) continue;
+		if (segment.p_vaddr % 4096 || segment.p_memsz % 4096) return "its memory isn't made of whole pages";
+		// (a core dump which was cut off just has the rest of the memory missing)
+		Address file_size = segment.p_filesz < segment.p_memsz ? segment.p_filesz : segment.p_memsz;
+		if (segment.p_offset > source->size) file_size = 0;
+		else if (file_size > source->size - segment.p_offset) file_size = source->size - segment.p_offset;
+		if (!source_add_range(source, segment.p_vaddr, segment.p_memsz, file_size, segment.p_offset))
+			return "there isn't enough memory available";
+		SourceMap *map = &source->maps[source->n_maps++];
+		sprintf(map->protection, "%c%c%cp", segment.p_flags & PF_R ? 'r' : '-',
+			segment.p_flags & PF_W ? 'w' : '-', segment.p_flags & PF_X ? 'x' : '-');
+		map->lo = segment.p_vaddr;
+		map->hi = segment.p_vaddr + segment.p_memsz;
+	}
+	if (!source->n_ranges) return "it doesn't have any memory in it";
+	// (each map is one range, so they're sorted the same way)
+	qsort(source->ranges, source->n_ranges, sizeof *source->ranges, source_range_cmp);
+	qsort(source->maps, source->n_maps, sizeof *source->maps, source_map_cmp);
+	// the notes say which process this is, and which files the maps are from
+	for (unsigned i = 0; i < header.e_phnum; ++i) {
+		Elf64_Phdr segment;
+		memcpy(&segment, source->data + header.e_phoff + i * sizeof segment, sizeof segment);
+		if (segment.p_type != PT_NOTE || segment.p_offset > source->size
+			|| segment.p_filesz > source->size - segment.p_offset)
+			continue;
+		uint8_t const *note = source->data + segment.p_offset, *notes_end = note + segment.p_filesz;
+		while (notes_end - note >= (ptrdiff_t)sizeof(Elf64_Nhdr)) {
+			Elf64_Nhdr note_header;
+			memcpy(&note_header, note, sizeof note_header);
+			size_t name_size = (note_header.n_namesz + 3) / 4 * 4, desc_size = (note_header.n_descsz + 3) / 4 * 4;
+			uint8_t const *desc = note + sizeof note_header + name_size;
+			if (name_size > (size_t)(notes_end - note) - sizeof note_header
+				|| desc_size > (size_t)(notes_end - desc))
+				break;
+			if (note_header.n_type == NT_PRSTATUS && !source->pid
+				&& note_header.n_descsz >= offsetof(struct elf_prstatus, pr_pid) + sizeof(pid_t)) {
+				pid_t pid;
+				memcpy(&pid, desc + offsetof(struct elf_prstatus, pr_pid), sizeof pid);
+				source->pid = pid;
+			} else if (note_header.n_type == NT_FILE) {
+				source_core_names(source, desc, note_header.n_descsz);
+			}
+			note = desc + desc_size;
+		}
+	}
+	return NULL;
+}
+
+// map a memory file or core dump into memory and find out what's in it.
+// returns false (after showing an error) on failure.
+static bool source_load(State *state, MemorySource *source, char const *filename) {
+	memset(source, 0, sizeof *source);
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	struct stat st = {0};
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		display_error(state, "Couldn't open %s: %s.", filename, strerror(errno));
+		if (fd != -1) close(fd);
+		return false;
+	}
+	char const *basename = strrchr(filename, '/');
+	snprintf(source->filename, sizeof source->filename, "%s", basename ? basename + 1 : filename);
+	source->size = (size_t)st.st_size;
+	// reserve the slack on either side, and put the file in between
+	source->mapping_size = SOURCE_SLACK + (source->size + 4095) / 4096 * 4096 + SOURCE_SLACK;
+	source->mapping = mmap(NULL, source->mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	char const *error = NULL;
+	if (source->mapping == MAP_FAILED) {
+		source->mapping = NULL;
+		error = strerror(errno);
+	} else if (source->size && mmap(source->mapping + SOURCE_SLACK, source->size, PROT_READ,
+		MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		error = strerror(errno);
+	}
+	close(fd);
+	source->data = source->mapping + SOURCE_SLACK;
+	if (!error && source->size >= sizeof MEMFILE_IDENT && memcmp(source->data, MEMFILE_IDENT, sizeof MEMFILE_IDENT) == 0) {
+		source->kind = SOURCE_MEMFILE;
+		error = source_load_memfile(source);
+	} else if (!error && source->size >= SELFMAG && memcmp(source->data, ELFMAG, SELFMAG) == 0) {
+		source->kind = SOURCE_CORE;
+		error = source_load_core(source);
+	} else if (!error) {
+		error = "it's not a memory file or a core dump";
+	}
+	if (error) {
+		display_error(state, "Couldn't use %s: %s.", filename, error);
+		source_free(source);
+		return false;
+	}
+	return true;
+}
+
+// open a memory file or core dump to search. returns its PID, or 0 (after showing an error) on failure.
+static PID source_open(State *state, char const *filename) {
+	int slot;
+	for (slot = 0; slot < SOURCE_MAX && sources[slot]; ++slot);
+	if (slot == SOURCE_MAX) {
+		display_error_nofmt(state, "Too many memory files and core dumps are open.");
+		return 0;
+	}
+	MemorySource *source = calloc(1, sizeof *source);
+	if (!source) {
+		display_error_nofmt(state, "Not enough memory available.");
+		return 0;
+	}
+	if (!source_load(state, source, filename)) {
+		free(source);
+		return 0;
+	}
+	sources[slot] = source;
+	return -1 - slot;
+}
+
+static void source_close(PID pid) {
+	MemorySource *source = source_get(pid);
+	if (!source) return;
+	sources[-1 - pid] = NULL;
+	source_free(source);
+	free(source);
+}
+
+// close the sources which aren't selected or being searched anymore
+static void source_close_unused(State *state) {
+	for (int i = 0; i < SOURCE_MAX; ++i) {
+		PID pid = -1 - i;
+		bool used = false;
+		for (unsigned p = 0; p < state->n_pids; ++p)
+			used |= state->pids[p] == pid;
+		for (unsigned p = 0; p < state->n_processes; ++p)
+			used |= state->processes[p].pid == pid;
+		if (!used) source_close(pid);
+	}
+}
+
+// describe a source for the process name label, e.g. "core dump of 1234 (core.1234)"
+static bool source_name(PID pid, char *out, size_t out_size) {
+	MemorySource const *source = source_get(pid);
+	if (!source) return false;
+	if (source->kind == SOURCE_MEMFILE)
+		snprintf(out, out_size, "memory file %s", source->filename);
+	else if (source->pid)
+		snprintf(out, out_size, "core dump of %lld (%s)", (long long)source->pid, source->filename);
+	else
+		snprintf(out, out_size, "core dump %s", source->filename);
+	return true;
+}
+
+// read from a source, like pread from /proc/<pid>/mem. memory in its maps which isn't in the file reads as zeros.
+// returns the number of bytes read (which stops short at the end of a map).
+// (this can be called from any thread)
+static Address source_read(PID pid, Address addr, uint8_t *memory, Address nbytes) {
+	MemorySource const *source = source_get(pid);
+	Address done = 0;
+	while (source && done < nbytes) {
+		Address at = addr + done;
+		SourceMap const *map = source_map_at(source, at);
+		if (!map) break;
+		SourceRange const *range = source_range_before(source, at);
+		Address n = nbytes - done;
+		if (n > map->hi - at) n = map->hi - at;
+		if (range && at < range->lo + range->size) {
+			Address offset = at - range->lo;
+			if (n > range->size - offset) n = range->size - offset;
+			Address in_file = offset < range->file_size ? range->file_size - offset : 0;
+			if (in_file > n) in_file = n;
+			memcpy(memory + done, source->data + range->offset + offset, in_file);
+			memset(memory + done + in_file, 0, n - in_file);
+		} else {
+			// (a gap between the ranges of a memory file)
+			SourceRange const *next = range ? range + 1 : source->ranges;
+			if (next < source->ranges + source->n_ranges && next->lo - at < n)
+				n = next->lo - at;
+			memset(memory + done, 0, n);
+		}
+		done += n;
+	}
+	return done;
+}
+
+// the nbytes at addr in a source, straight from the file, or NULL if they're not all in one piece there.
+// the SOURCE_SLACK bytes before and after them can be read too.
+// (this can be called from any thread)
+static uint8_t const *source_pointer(PID pid, Address addr, Address nbytes) {
+	MemorySource const *source = source_get(pid);
+	if (!source) return NULL;
+	SourceRange const *range = source_range_before(source, addr);
+	if (!range || addr - range->lo > range->file_size || nbytes > range->file_size - (addr - range->lo))
+		return NULL;
+	return source->data + range->offset + (addr - range->lo);
+}
+
+// open the maps of pid (in /proc/<pid>/maps format), which can be a memory source.
+// returns NULL on failure (and sets errno).
+static FILE *source_open_maps(State *state, PID pid) {
+	MemorySource const *source = source_get(pid);
+	if (pid >= 0) return agent_open_maps(state, pid);
+	if (!source) {
+		errno = ENOENT;
+		return NULL;
+	}
+	FILE *fp = tmpfile();
+	if (!fp) return NULL;
+	// memory files don't say what the protection was, so their memory goes with whatever's being searched
+	char const *any_protection = gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(state->builder, "protection")));
+	for (unsigned m = 0; m < source->n_maps; ++m) {
+		SourceMap const *map = &source->maps[m];
+		fprintf(fp, "%" PRIxADDR "-%" PRIxADDR " %s 00000000 00:00 0 %s\n", map->lo, map->hi,
+			*map->protection ? map->protection : any_protection, map->pathname ? map->pathname : "");
+	}
+	rewind(fp);
+	return fp;
+}